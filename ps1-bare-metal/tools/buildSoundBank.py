@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 sound bank builder
+
+Packs any number of mono VAG files into a single sound bank that can be loaded
+with soundBank_load() (see src/includes/spu.h) using one CD-ROM read and one SPU
+DMA transfer. The bank starts with a 2048-byte sector holding a header and a
+table of contents, followed by the ADPCM data of all sounds back to back. Each
+sound is named after its file (uppercased, without extension). Requires no
+external dependencies.
+"""
+
+__version__ = "0.1.0"
+
+import logging
+from argparse import ArgumentParser, FileType, Namespace
+from pathlib  import Path
+from struct   import Struct
+
+## Constants
+
+# Magic, version, reserved, data size, sample rate, reserved, name. The data
+# starts right after the 48-byte header.
+VAG_HEADER_STRUCT: Struct = Struct("> 4s 4I 12x 16s")
+VAG_MAGIC:         bytes  = b"VAGp"
+
+BANK_HEADER_STRUCT: Struct = Struct("< I 2H I 4x")
+BANK_ENTRY_STRUCT:  Struct = Struct("< 16s 3I 4x")
+BANK_MAGIC:         int    = 0x4b4e4253 # "SBNK"
+
+SECTOR_SIZE:     int = 2048
+BLOCK_SIZE:      int = 16
+NAME_LENGTH:     int = 16
+MAX_SOUNDS:      int = \
+	(SECTOR_SIZE - BANK_HEADER_STRUCT.size) // BANK_ENTRY_STRUCT.size
+
+## Bank builder
+
+def buildBank(sounds: list[tuple[bytes, bytes, int]]) -> bytearray:
+	entries: bytearray = bytearray()
+	data:    bytearray = bytearray()
+
+	for name, body, sampleRate in sounds:
+		# Sounds must start on an ADPCM block boundary, as the SPU can only
+		# address SPU RAM in 8-byte units and DMA works in 16-byte blocks.
+		entries.extend(
+			BANK_ENTRY_STRUCT.pack(name, len(data), len(body), sampleRate)
+		)
+		data.extend(body)
+		data.extend(bytes(-len(data) % BLOCK_SIZE))
+
+	bank: bytearray = bytearray(SECTOR_SIZE)
+
+	BANK_HEADER_STRUCT.pack_into(bank, 0, BANK_MAGIC, len(sounds), 0, len(data))
+	bank[BANK_HEADER_STRUCT.size:BANK_HEADER_STRUCT.size + len(entries)] = \
+		entries
+	bank.extend(data)
+
+	return bank
+
+def parseBank(bank: bytes) -> list[tuple[bytes, bytes, int]]:
+	magic, numSounds, _, dataLength = \
+		BANK_HEADER_STRUCT.unpack_from(bank, 0)
+
+	if (magic != BANK_MAGIC) or \
+		((SECTOR_SIZE + dataLength) != len(bank)):
+		raise ValueError("invalid bank header")
+
+	sounds: list[tuple[bytes, bytes, int]] = []
+
+	for i in range(numSounds):
+		name, offset, length, sampleRate = BANK_ENTRY_STRUCT.unpack_from(
+			bank, BANK_HEADER_STRUCT.size + BANK_ENTRY_STRUCT.size * i
+		)
+		start: int = SECTOR_SIZE + offset
+
+		sounds.append(( name.rstrip(b"\0"), bank[start:start + length], sampleRate ))
+
+	return sounds
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Packs VAG files into a sound bank that can be loaded into SPU RAM "
+			"in a single transfer.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to sound bank file to generate"
+	)
+	group.add_argument(
+		"input",
+		type  = Path,
+		nargs = "+",
+		help  = "Paths to mono VAG files to pack"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	logging.basicConfig(
+		format = "{levelname}: {message}",
+		style  = "{",
+		level  = logging.INFO
+	)
+
+	if len(args.input) > MAX_SOUNDS:
+		parser.error(f"too many sounds ({len(args.input)} > {MAX_SOUNDS})")
+
+	sounds: list[tuple[bytes, bytes, int]] = []
+
+	for path in args.input:
+		vag: bytes = path.read_bytes()
+
+		magic, _, _, length, sampleRate, _ = \
+			VAG_HEADER_STRUCT.unpack_from(vag, 0)
+
+		if magic != VAG_MAGIC:
+			parser.error(f"{path} is not a mono VAG file")
+		if (VAG_HEADER_STRUCT.size + length) > len(vag):
+			parser.error(f"{path} is truncated")
+
+		name: bytes = path.stem.upper().encode("ascii")
+		body: bytes = vag[VAG_HEADER_STRUCT.size:VAG_HEADER_STRUCT.size + length]
+
+		if len(name) >= NAME_LENGTH:
+			logging.warning(f"truncating sound name {path.stem}")
+			name = name[0:NAME_LENGTH - 1]
+
+		sounds.append(( name, body, sampleRate ))
+
+	bank: bytearray = buildBank(sounds)
+
+	# Make sure the bank reads back as what was packed into it, the same way
+	# soundBank_load() parses it.
+	if parseBank(bank) != sounds:
+		parser.error("sound bank failed to read back")
+
+	with args.output as outputFile:
+		outputFile.write(bank)
+
+if __name__ == "__main__":
+	main()
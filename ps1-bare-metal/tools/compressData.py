@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""LZ4 data compressor
+
+A simple script to compress a file into a raw LZ4 block, prefixed with a 32-bit
+little endian header holding the uncompressed length. The output can be
+unpacked on the PS1 using lz4_decompress() (see src/includes/lz4.c). Requires no
+external dependencies.
+"""
+
+__version__ = "0.1.0"
+
+from argparse import ArgumentParser, FileType, Namespace
+from struct   import Struct
+
+## LZ4 block compressor
+
+HEADER_STRUCT: Struct = Struct("< I")
+
+MIN_MATCH:     int = 4
+MAX_OFFSET:    int = 0xffff
+HASH_BITS:     int = 16
+MAX_CANDIDATES: int = 64
+
+# The LZ4 specification requires the last 5 bytes to always be literals and the
+# last match to start at least 12 bytes before the end of the block. The PS1
+# decompressor doesn't rely on this, but sticking to the spec keeps the output
+# readable by any other LZ4 tool.
+LAST_LITERALS: int = 5
+MF_LIMIT:      int = 12
+
+def _hash(data: bytes, offset: int) -> int:
+	value: int = int.from_bytes(data[offset:offset + 4], "little")
+
+	return ((value * 2654435761) & 0xffffffff) >> (32 - HASH_BITS)
+
+def _writeLength(output: bytearray, length: int):
+	while length >= 255:
+		output.append(255)
+		length -= 255
+
+	output.append(length)
+
+def _writeSequence(
+	output: bytearray, literals: bytes, matchOffset: int, matchLength: int
+):
+	literalLength: int = len(literals)
+	token:         int = min(literalLength, 15) << 4
+
+	if matchLength:
+		token |= min(matchLength - MIN_MATCH, 15)
+
+	output.append(token)
+
+	if literalLength >= 15:
+		_writeLength(output, literalLength - 15)
+
+	output.extend(literals)
+
+	if not matchLength:
+		return
+
+	output.extend(matchOffset.to_bytes(2, "little"))
+
+	if (matchLength - MIN_MATCH) >= 15:
+		_writeLength(output, matchLength - MIN_MATCH - 15)
+
+def compressLZ4(data: bytes) -> bytearray:
+	output:  bytearray            = bytearray()
+	chains:  dict[int, list[int]] = {}
+	anchor:  int                  = 0
+	offset:  int                  = 0
+	limit:   int                  = len(data) - MF_LIMIT
+
+	# Greedy parsing with a bounded hash chain search. This is slower than the
+	# reference compressor's single-entry hash table, but build time is
+	# irrelevant here and the longer matches save a few percent.
+	while offset < limit:
+		key:        int       = _hash(data, offset)
+		candidates: list[int] = chains.setdefault(key, [])
+
+		bestLength: int = 0
+		bestOffset: int = 0
+
+		for candidate in reversed(candidates[-MAX_CANDIDATES:]):
+			if (offset - candidate) > MAX_OFFSET:
+				break
+
+			length:    int = 0
+			maxLength: int = len(data) - LAST_LITERALS - offset
+
+			while (
+				(length < maxLength) and
+				(data[candidate + length] == data[offset + length])
+			):
+				length += 1
+
+			if length > bestLength:
+				bestLength = length
+				bestOffset = offset - candidate
+
+		candidates.append(offset)
+
+		if bestLength < MIN_MATCH:
+			offset += 1
+			continue
+
+		_writeSequence(output, data[anchor:offset], bestOffset, bestLength)
+
+		# Index the positions covered by the match as well, so later matches
+		# can refer back into it.
+		for position in range(offset + 1, min(offset + bestLength, limit)):
+			chains.setdefault(_hash(data, position), []).append(position)
+
+		offset += bestLength
+		anchor  = offset
+
+	_writeSequence(output, data[anchor:], 0, 0)
+	return output
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Compresses a file into a raw LZ4 block prefixed with its "
+			"uncompressed length.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = FileType("rb"),
+		help = "Path to file to compress"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to compressed file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	with args.input as inputFile:
+		data: bytes = inputFile.read()
+
+	with args.output as outputFile:
+		outputFile.write(HEADER_STRUCT.pack(len(data)))
+		outputFile.write(compressLZ4(data))
+
+if __name__ == "__main__":
+	main()
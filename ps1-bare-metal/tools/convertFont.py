@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 font atlas and metrics generator
+
+Converts a font spritesheet into a 4bpp texture and palette, plus a C header
+containing a 256-entry glyph table with precomputed GP0 UV and size words. Glyph
+positions are described in a JSON file as grids of fixed-size cells; the width
+of each glyph is measured from the image itself. The sheet may optionally be
+scaled up by an integer factor to generate a larger version of the same font.
+Requires PIL/Pillow and NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import json, logging, re
+from argparse    import ArgumentParser, FileType, Namespace
+from dataclasses import dataclass
+from pathlib     import Path
+
+import numpy
+from numpy import ndarray
+from PIL   import Image
+
+from convertImage import BLACK_COLOR, TRANSPARENT_COLOR, convertIndexedImage
+
+## Glyph measurement
+
+NUM_GLYPHS:      int = 256
+ALPHA_THRESHOLD: int = 0x20
+
+@dataclass
+class Glyph:
+	x:       int = 0
+	y:       int = 0
+	width:   int = 0
+	height:  int = 0
+	advance: int = 0
+
+def measureGlyph(
+	alpha: ndarray, x: int, y: int, width: int, height: int, trimLeft: bool
+) -> Glyph:
+	cell:    ndarray = alpha[y:y + height, x:x + width]
+	columns: ndarray = numpy.flatnonzero(cell.max(axis = 0) > ALPHA_THRESHOLD)
+
+	if not columns.size:
+		return Glyph(x, y, 0, 0, 0)
+
+	# Glyphs are left aligned within their cells, and any padding on the left
+	# is considered part of the glyph (i.e. left side bearing) unless trimming
+	# is explicitly enabled, as is the case for icons.
+	left:  int = int(columns[0]) if trimLeft else 0
+	right: int = int(columns[-1]) + 1
+
+	return Glyph(x + left, y, right - left, height, right - left)
+
+def measureFont(alpha: ndarray, description: dict) -> list[Glyph]:
+	glyphs: list[Glyph] = [ Glyph() for _ in range(NUM_GLYPHS) ]
+
+	for grid in description["grids"]:
+		first:      int  = grid["first"]
+		columns:    int  = grid.get("columns", grid["count"])
+		cellWidth:  int  = grid["cellWidth"]
+		cellHeight: int  = grid["cellHeight"]
+		trimLeft:   bool = grid.get("trimLeft", False)
+
+		for index in range(grid["count"]):
+			glyphs[first + index] = measureGlyph(
+				alpha,
+				grid["x"] + (index % columns)  * cellWidth,
+				grid["y"] + (index // columns) * cellHeight,
+				cellWidth,
+				cellHeight,
+				trimLeft
+			)
+
+	for char, advance in description.get("advances", {}).items():
+		glyphs[int(char, 0)].advance = advance
+
+	# Any character that is not part of the font (and is not blank on purpose)
+	# is replaced with the fallback glyph, so that the renderer never has to
+	# range check character codes.
+	fallback: Glyph = glyphs[description["fallback"]]
+
+	for index, glyph in enumerate(glyphs):
+		if not glyph.advance:
+			glyphs[index] = fallback
+
+	return glyphs
+
+## Header generation
+
+def toMacroName(name: str) -> str:
+	return re.sub(r"(?<!^)(?=[A-Z])", "_", name).upper()
+
+def formatChar(index: int) -> str:
+	if (0x20 < index < 0x7f) and (index != 0x5c):
+		return f"'{chr(index)}'"
+
+	return f"0x{index:02x}"
+
+def generateHeader(
+	name: str, source: str, glyphs: list[Glyph], width: int, height: int,
+	lineHeight: int, tabWidth: int
+) -> str:
+	macro: str       = toMacroName(name)
+	lines: list[str] = [
+		f"// Generated by convertFont.py from {source}, do not edit. The FontGlyph",
+		"// and FontMetrics types are defined in font.h, which must be included",
+		"// first.",
+		"",
+		"#pragma once",
+		"",
+		f"#define {macro}_WIDTH       {width}",
+		f"#define {macro}_HEIGHT      {height}",
+		f"#define {macro}_LINE_HEIGHT {lineHeight}",
+		"",
+		f"static const FontGlyph {name}Glyphs[{NUM_GLYPHS}] = {{"
+	]
+
+	for index, glyph in enumerate(glyphs):
+		uv:   int = glyph.x | (glyph.y << 8)
+		size: int = glyph.width | (glyph.height << 16)
+
+		lines.append(
+			f"\t{{ .uv = 0x{uv:04x}, .size = 0x{size:08x}, "
+			f".advance = {glyph.advance:2d} }}, // {formatChar(index)}"
+		)
+
+	lines += [
+		"};",
+		"",
+		f"static const FontMetrics {name}Metrics = {{",
+		f"\t.glyphs     = {name}Glyphs,",
+		f"\t.width      = {macro}_WIDTH,",
+		f"\t.height     = {macro}_HEIGHT,",
+		f"\t.lineHeight = {macro}_LINE_HEIGHT,",
+		f"\t.tabWidth   = {tabWidth}",
+		"};",
+		""
+	]
+
+	return "\n".join(lines)
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Converts a font spritesheet into a 4bpp texture, a 16bpp palette "
+			"and a C header containing glyph metrics.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-n", "--name",
+		type    = str,
+		default = "font",
+		help    = \
+			"Use specified prefix for the identifiers in the generated header "
+			"(default 'font')",
+		metavar = "name"
+	)
+	group.add_argument(
+		"-s", "--scale",
+		type    = int,
+		default = 1,
+		help    = \
+			"Scale the spritesheet and all metrics up by the given integer "
+			"factor (default 1)",
+		metavar = "factor"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = Path,
+		help = "Path to input spritesheet"
+	)
+	group.add_argument(
+		"description",
+		type = FileType("rt"),
+		help = "Path to JSON font description"
+	)
+	group.add_argument(
+		"headerOutput",
+		type = FileType("wt"),
+		help = "Path to C header to generate"
+	)
+	group.add_argument(
+		"imageOutput",
+		type = FileType("wb"),
+		help = "Path to raw image data file to generate"
+	)
+	group.add_argument(
+		"clutOutput",
+		type = FileType("wb"),
+		help = "Path to raw palette data file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	logging.basicConfig(
+		format = "{levelname}: {message}",
+		style  = "{",
+		level  = logging.INFO
+	)
+
+	if args.scale < 1:
+		parser.error("scale factor must be at least 1")
+
+	with args.description as _file:
+		description: dict = json.load(_file)
+
+	with Image.open(args.input) as inputImage:
+		image: Image.Image = inputImage.convert("RGBA")
+
+	glyphs: list[Glyph] = \
+		measureFont(numpy.asarray(image)[:, :, 3], description)
+
+	if args.scale > 1:
+		image = image.resize(
+			( image.width * args.scale, image.height * args.scale ),
+			Image.NEAREST
+		)
+
+		glyphs = [
+			Glyph(
+				glyph.x       * args.scale,
+				glyph.y       * args.scale,
+				glyph.width   * args.scale,
+				glyph.height  * args.scale,
+				glyph.advance * args.scale
+			) for glyph in glyphs
+		]
+
+	# The atlas must fit in a single 4bpp texture page.
+	if (image.width > 256) or (image.height > 256):
+		parser.error(f"atlas is too large ({image.width}x{image.height})")
+
+	imageData, clutData = convertIndexedImage(
+		image.quantize(16, dither = Image.NONE), 16, TRANSPARENT_COLOR,
+		BLACK_COLOR
+	)
+
+	with args.headerOutput as _file:
+		_file.write(generateHeader(
+			args.name, args.input.name, glyphs, image.width, image.height,
+			description["lineHeight"] * args.scale,
+			description["tabWidth"]   * args.scale
+		))
+	with args.imageOutput as _file:
+		_file.write(imageData)
+	with args.clutOutput as _file:
+		_file.write(clutData)
+
+if __name__ == "__main__":
+	main()
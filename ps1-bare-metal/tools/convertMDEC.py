@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""PlayStation 1 MDEC image converter
+
+Converts an image file into the format expected by the loader's MDEC decoder: a
+2048-byte header sector followed by the run-length coded macroblock stream the
+MDEC consumes directly. Unlike the .BS format used by most games the stream is
+not Huffman coded, trading some compression for not having to spend any CPU
+time on decoding. Requires PIL/Pillow and NumPy to be installed.
+"""
+
+__version__ = "0.1.0"
+
+import logging
+from argparse import ArgumentParser, FileType, Namespace
+from struct   import Struct
+
+import numpy
+from numpy import ndarray
+from PIL   import Image
+
+## Constants
+
+HEADER_STRUCT: Struct = Struct("< I 2H 2H")
+HEADER_SIZE:   int    = 2048
+IMAGE_MAGIC:   int    = 0x3149444d # "MDI1"
+
+COLUMN_WIDTH:     int = 16
+MAX_IMAGE_HEIGHT: int = 256
+COLUMN_ALIGNMENT: int = 32 * 2 # In halfwords (one MDEC DMA chunk)
+
+END_OF_BLOCK: int = 0xfe00
+
+# Must match the table uploaded by initMDEC() in src/includes/mdec.c.
+QUANT_TABLE: tuple[int, ...] = (
+	 2, 16, 16, 19, 16, 19, 22, 22,
+	22, 22, 22, 22, 26, 24, 26, 27,
+	27, 27, 26, 26, 26, 26, 27, 27,
+	27, 29, 29, 29, 34, 34, 34, 29,
+	29, 29, 27, 27, 29, 29, 32, 32,
+	34, 34, 37, 38, 37, 35, 35, 34,
+	35, 38, 38, 40, 40, 40, 48, 48,
+	46, 46, 56, 56, 58, 69, 69, 83
+)
+ZIGZAG_ORDER: tuple[int, ...] = (
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+)
+
+## DCT and quantization
+
+def createDCTMatrix() -> ndarray:
+	u: ndarray = numpy.arange(8).reshape(( 8, 1 ))
+	x: ndarray = numpy.arange(8).reshape(( 1, 8 ))
+
+	matrix: ndarray = numpy.cos((2 * x + 1) * u * numpy.pi / 16) / 2
+	matrix[0, :]    = numpy.sqrt(1 / 8)
+
+	return matrix
+
+DCT_MATRIX: ndarray = createDCTMatrix()
+
+def encodeBlock(block: ndarray, qscale: int) -> list[int]:
+	coeffs: ndarray = (DCT_MATRIX @ block @ DCT_MATRIX.T).reshape(64)
+	output: list[int] = []
+
+	# The DC coefficient is only scaled by the first entry of the quantization
+	# table, while AC coefficients are multiplied by qscale and divided by 8.
+	dc: int = int(round(coeffs[0] / QUANT_TABLE[0]))
+	dc      = max(-512, min(511, dc))
+	output.append((qscale << 10) | (dc & 0x3ff))
+
+	run: int = 0
+
+	for index in range(1, 64):
+		value: float = coeffs[ZIGZAG_ORDER[index]]
+		level: int   = \
+			int(round(value * 8 / (QUANT_TABLE[index] * qscale)))
+
+		if not level:
+			run += 1
+			continue
+
+		level = max(-512, min(511, level))
+		output.append((run << 10) | (level & 0x3ff))
+		run = 0
+
+	output.append(END_OF_BLOCK)
+	return output
+
+## Color space conversion
+
+def convertRGBtoYCbCr(image: ndarray) -> tuple[ndarray, ndarray, ndarray]:
+	r: ndarray = image[:, :, 0]
+	g: ndarray = image[:, :, 1]
+	b: ndarray = image[:, :, 2]
+
+	# The MDEC adds 128 to luma samples (when outputting unsigned pixels), so
+	# all three planes are centered around zero.
+	y:  ndarray =  0.299    * r + 0.587    * g + 0.114    * b - 128
+	cb: ndarray = -0.168736 * r - 0.331264 * g + 0.5      * b
+	cr: ndarray =  0.5      * r - 0.418688 * g - 0.081312 * b
+
+	# Subsample chroma by averaging each 2x2 group of pixels.
+	cb = (cb[0::2, 0::2] + cb[1::2, 0::2] + cb[0::2, 1::2] + cb[1::2, 1::2]) / 4
+	cr = (cr[0::2, 0::2] + cr[1::2, 0::2] + cr[0::2, 1::2] + cr[1::2, 1::2]) / 4
+
+	return y, cb, cr
+
+def encodeMacroblock(
+	y: ndarray, cb: ndarray, cr: ndarray, mx: int, my: int, qscale: int
+) -> list[int]:
+	cx: int = mx * 8
+	cy: int = my * 8
+	lx: int = mx * 16
+	ly: int = my * 16
+
+	output: list[int] = []
+
+	# The MDEC expects the chroma blocks first, followed by the four luma
+	# blocks in top-left, top-right, bottom-left, bottom-right order.
+	output += encodeBlock(cr[cy:cy + 8, cx:cx + 8], qscale)
+	output += encodeBlock(cb[cy:cy + 8, cx:cx + 8], qscale)
+
+	for by, bx in ( 0, 0 ), ( 0, 8 ), ( 8, 0 ), ( 8, 8 ):
+		output += encodeBlock(
+			y[ly + by:ly + by + 8, lx + bx:lx + bx + 8], qscale
+		)
+
+	return output
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Converts an image file into a run-length coded MDEC stream that "
+			"can be decoded straight into VRAM.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-q", "--qscale",
+		type    = int,
+		default = 4,
+		help    = \
+			"Use specified quantization scale (1-63, lower is higher quality, "
+			"default 4)",
+		metavar = "value"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"input",
+		type = Image.open,
+		help = "Path to input image file"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to MDEC image file to generate"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	logging.basicConfig(
+		format = "{levelname}: {message}",
+		style  = "{",
+		level  = logging.INFO
+	)
+
+	if not (1 <= args.qscale <= 63):
+		parser.error("quantization scale must be in 1-63 range")
+
+	with args.input as inputImage:
+		image: ndarray = numpy.asarray(inputImage.convert("RGB"), "f")
+
+	height, width, _ = image.shape
+
+	if height > MAX_IMAGE_HEIGHT:
+		parser.error(f"image is too tall ({height} > {MAX_IMAGE_HEIGHT})")
+	if width > 1024:
+		parser.error(f"image is too wide ({width} > 1024)")
+
+	# Pad the image to a whole number of macroblocks by repeating its edges,
+	# which avoids ringing artifacts along the borders.
+	padX: int = -width  % 16
+	padY: int = -height % 16
+
+	if padX or padY:
+		logging.warning(f"padding image to {width + padX}x{height + padY}")
+		image = numpy.pad(image, (( 0, padY ), ( 0, padX ), ( 0, 0 )), "edge")
+
+	height, width, _ = image.shape
+
+	y, cb, cr = convertRGBtoYCbCr(image)
+
+	numColumns: int       = width // COLUMN_WIDTH
+	offsets:    list[int] = []
+	data:       list[int] = []
+
+	# Macroblocks are stored column by column, so that each column decodes into
+	# a contiguous 16xN strip that can be uploaded to VRAM in one go.
+	for mx in range(numColumns):
+		offsets.append(len(data) // 2)
+
+		for my in range(height // 16):
+			data += encodeMacroblock(y, cb, cr, mx, my, args.qscale)
+
+		data += [ END_OF_BLOCK ] * (-len(data) % COLUMN_ALIGNMENT)
+
+	offsets.append(len(data) // 2)
+
+	header: bytearray = bytearray(HEADER_SIZE)
+	HEADER_STRUCT.pack_into(header, 0, IMAGE_MAGIC, width, height, numColumns, 0)
+	header[HEADER_STRUCT.size:HEADER_STRUCT.size + len(offsets) * 4] = \
+		numpy.array(offsets, "<I").tobytes()
+
+	with args.output as outputFile:
+		outputFile.write(header)
+		outputFile.write(numpy.array(data, "<H").tobytes())
+
+	logging.info(
+		f"{width}x{height}, {numColumns} columns, {len(data) * 2} bytes of MDEC "
+		f"data"
+	)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""CD-ROM XA audio interleaver
+
+Interleaves one or more XA-ADPCM streams, each made up of raw 2336-byte Mode 2
+sectors (such as those generated by psxavenc -t xa), into a single file that
+can be added to a disc image as an XA file and played with xa_play() (see
+src/includes/xa.h). Stream N goes into every sector whose index modulo the
+stride is N and gets N as its channel number; unused sectors are filled with
+silent audio. Requires no external dependencies.
+"""
+
+__version__ = "0.1.0"
+
+import logging
+from argparse import ArgumentParser, FileType, Namespace
+
+## Constants
+
+SECTOR_SIZE:    int = 2336
+SUBHEADER_SIZE: int = 8
+EDC_SIZE:       int = 4
+
+SUBMODE_END_OF_RECORD: int = 1 << 0
+SUBMODE_AUDIO:         int = 1 << 2
+SUBMODE_FORM2:         int = 1 << 5
+SUBMODE_REAL_TIME:     int = 1 << 6
+SUBMODE_END_OF_FILE:   int = 1 << 7
+
+# Must match XA_FILE_NUMBER in src/includes/xa.h.
+DEFAULT_FILE_NUMBER: int = 1
+
+## Sector handling
+
+def setSubheader(
+	sector: bytearray, fileNumber: int, channel: int, submode: int,
+	codingInfo: int
+):
+	# The subheader is stored twice. A zero EDC is valid for Form 2 sectors
+	# and means the field is unused, so there is no need to recalculate it
+	# after changing the subheader.
+	for offset in ( 0, 4 ):
+		sector[offset:offset + 4] = \
+			bytes(( fileNumber, channel, submode, codingInfo ))
+
+	sector[SECTOR_SIZE - EDC_SIZE:SECTOR_SIZE] = bytes(EDC_SIZE)
+
+def createSilentSector(fileNumber: int, channel: int, codingInfo: int) -> bytes:
+	# An all-zero sound group decodes to silence with any filter.
+	sector: bytearray = bytearray(SECTOR_SIZE)
+
+	setSubheader(
+		sector, fileNumber, channel,
+		SUBMODE_AUDIO | SUBMODE_FORM2 | SUBMODE_REAL_TIME, codingInfo
+	)
+	return sector
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Interleaves XA-ADPCM streams into a single multi-channel XA file.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Interleaving options")
+	group.add_argument(
+		"-s", "--stride",
+		type    = int,
+		default = 8,
+		help    = \
+			"Interleave streams every specified number of sectors (default 8, "
+			"for 37800 Hz stereo audio read at double speed)",
+		metavar = "sectors"
+	)
+	group.add_argument(
+		"-f", "--file-number",
+		type    = int,
+		default = DEFAULT_FILE_NUMBER,
+		help    = \
+			f"Use specified file number in sector headers (default "
+			f"{DEFAULT_FILE_NUMBER})",
+		metavar = "value"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to interleaved XA file to generate"
+	)
+	group.add_argument(
+		"input",
+		type  = FileType("rb"),
+		nargs = "+",
+		help  = "Paths to XA streams to interleave, one per channel"
+	)
+
+	return parser
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	logging.basicConfig(
+		format = "{levelname}: {message}",
+		style  = "{",
+		level  = logging.INFO
+	)
+
+	if not (1 <= args.stride <= 32):
+		parser.error("stride must be in 1-32 range")
+	if len(args.input) > args.stride:
+		parser.error(f"too many streams ({len(args.input)} > {args.stride})")
+
+	streams: list[list[bytes]] = []
+
+	for inputFile in args.input:
+		with inputFile:
+			data: bytes = inputFile.read()
+
+		if len(data) % SECTOR_SIZE:
+			parser.error(f"{inputFile.name} is not made up of 2336-byte sectors")
+
+		sectors: list[bytes] = [
+			data[offset:offset + SECTOR_SIZE]
+			for offset in range(0, len(data), SECTOR_SIZE)
+		]
+
+		if not sectors or not (sectors[0][2] & SUBMODE_AUDIO):
+			parser.error(f"{inputFile.name} does not contain XA audio")
+
+		streams.append(sectors)
+
+	# Pad unused channels and the ends of shorter streams with silence using
+	# the same coding parameters as the first stream, so that the drive never
+	# sees a data sector while playing.
+	codingInfo: int = streams[0][0][3]
+	length:     int = max(len(sectors) for sectors in streams)
+
+	if any(len(sectors) != length for sectors in streams):
+		logging.warning("streams have different lengths, padding with silence")
+
+	with args.output as outputFile:
+		for index in range(length):
+			for channel in range(args.stride):
+				if (channel < len(streams)) and (index < len(streams[channel])):
+					sector:  bytearray = bytearray(streams[channel][index])
+					submode: int       = sector[2]
+
+					# Only the very last sector of the file should be flagged
+					# as the end of the file.
+					submode &= ~(SUBMODE_END_OF_RECORD | SUBMODE_END_OF_FILE)
+
+					setSubheader(
+						sector, args.file_number, channel, submode, sector[3]
+					)
+				else:
+					sector = createSilentSector(
+						args.file_number, channel, codingInfo
+					)
+
+				if (index == length - 1) and (channel == args.stride - 1):
+					sector[2] |= SUBMODE_END_OF_RECORD | SUBMODE_END_OF_FILE
+					sector[6] |= SUBMODE_END_OF_RECORD | SUBMODE_END_OF_FILE
+
+				outputFile.write(sector)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""Self-extracting PlayStation 1 .EXE generator
+
+Converts an ELF executable into a compressed PlayStation 1 .EXE file, which
+unpacks itself at startup using the stub in src/includes/unpacker.s. The
+executable's image is compressed with the same LZ4 compressor used for embedded
+assets. Requires no external dependencies.
+"""
+
+__version__ = "0.1.0"
+
+from argparse import ArgumentParser, FileType, Namespace
+from struct   import Struct
+
+from compressData      import HEADER_STRUCT, compressLZ4
+from convertExecutable import \
+	ELF, ELFArchitecture, ELFType, EXE_ALIGNMENT, EXE_HEADER_MAGIC, \
+	EXE_HEADER_STRUCT, alignToMultiple
+
+## Constants
+
+PARAMS_STRUCT: Struct = Struct("< 3I")
+PARAMS_MAGIC:  int    = 0x4b43504c # "LPCK"
+
+# Highest address the packed executable may extend to. The BIOS places the
+# stack right below 0x801fff00, so some room is left for it.
+RAM_LIMIT: int = 0x801f0000
+
+## Main
+
+def createParser() -> ArgumentParser:
+	parser = ArgumentParser(
+		description = \
+			"Converts an ELF executable into a self-extracting compressed "
+			"PlayStation 1 .EXE file.",
+		add_help    = False
+	)
+
+	group = parser.add_argument_group("Tool options")
+	group.add_argument(
+		"-h", "--help",
+		action = "help",
+		help   = "Show this help message and exit"
+	)
+
+	group = parser.add_argument_group("Conversion options")
+	group.add_argument(
+		"-r", "--region-str",
+		type    = str,
+		default = "",
+		help    = "Add a custom region string to the header",
+		metavar = "string"
+	)
+
+	group = parser.add_argument_group("File paths")
+	group.add_argument(
+		"stub",
+		type = FileType("rb"),
+		help = "Path to ELF unpacker stub"
+	)
+	group.add_argument(
+		"input",
+		type = FileType("rb"),
+		help = "Path to ELF input executable"
+	)
+	group.add_argument(
+		"output",
+		type = FileType("wb"),
+		help = "Path to PS1 executable to generate"
+	)
+
+	return parser
+
+def loadELF(parser: ArgumentParser, file) -> ELF:
+	with file:
+		try:
+			elf: ELF = ELF(file)
+		except RuntimeError as err:
+			parser.error(err.args[0])
+
+	if elf.type != ELFType.EXECUTABLE:
+		parser.error("ELF file must be an executable")
+	if elf.architecture != ELFArchitecture.MIPS:
+		parser.error("ELF architecture must be MIPS")
+	if not elf.segments:
+		parser.error("ELF file must contain at least one segment")
+
+	return elf
+
+def main():
+	parser: ArgumentParser = createParser()
+	args:   Namespace      = parser.parse_args()
+
+	stub: ELF = loadELF(parser, args.stub)
+	elf:  ELF = loadELF(parser, args.input)
+
+	stubAddress, stubData = stub.flatten()
+	startAddress, data    = elf.flatten()
+
+	if stub.entryPoint != stubAddress:
+		parser.error("stub entry point must be at the beginning of its image")
+
+	# The parameter block is the last thing in the stub's image, right before
+	# the compressed data.
+	paramsOffset: int = len(stubData) - PARAMS_STRUCT.size
+	magic, _, _       = PARAMS_STRUCT.unpack_from(stubData, paramsOffset)
+
+	if magic != PARAMS_MAGIC:
+		parser.error("stub parameter block not found")
+
+	PARAMS_STRUCT.pack_into(
+		stubData, paramsOffset, PARAMS_MAGIC, startAddress, elf.entryPoint
+	)
+
+	# Place the stub right after the end of the unpacked image (including
+	# .bss, which is zeroed by the image's own startup code afterwards) so that
+	# unpacking never overwrites any compressed data that is yet to be read.
+	packed: bytearray = bytearray(stubData)
+	packed.extend(HEADER_STRUCT.pack(len(data)))
+	packed.extend(compressLZ4(data))
+	alignToMultiple(packed, EXE_ALIGNMENT)
+
+	loadAddress: int = (startAddress + len(data) + 15) & ~15
+
+	if (loadAddress + len(packed)) > RAM_LIMIT:
+		parser.error("not enough RAM to hold both packed and unpacked image")
+
+	region: bytes = args.region_str.strip().encode("ascii")
+	header: bytes = EXE_HEADER_STRUCT.pack(
+		EXE_HEADER_MAGIC, # Magic
+		loadAddress,      # Entry point
+		0,                # Initial global pointer
+		loadAddress,      # Data load address
+		len(packed),      # Data size
+		0,                # Stack offset
+		0,                # Stack size
+		region            # Region string
+	)
+
+	with args.output as file:
+		file.write(header)
+		file.write(packed)
+
+	print(
+		f"packed {len(data)} bytes into {len(packed)} "
+		f"({len(packed) * 100 // len(data)}%)"
+	)
+
+if __name__ == "__main__":
+	main()
@@ -43,6 +43,7 @@
  #include "ps1/registers.h"
  #include "controller.h"
  #include "includes/system.h"
+ #include "sio.h"
  /*void delayMicroseconds(int time) {
     // Calculate the approximate number of CPU cycles that need to be burned,
     // assuming a 33.8688 MHz clock (1 us = 33.8688 = ~33.875 = 271 / 8 cycles).
@@ -65,62 +66,24 @@
     );
 } */
  
+ // Port used by the next exchangePacket() or sendPacketNoAcknowledge() call.
+ static int _currentPort = 0;
+
  void initControllerBus(void) {
-     // Reset the serial interface, initialize it with the settings used by
-     // controllers and memory cards (250000bps, 8 data bits) and configure it to
-     // send a signal to the interrupt controller whenever the DSR input is
-     // pulsed (see below).
-     SIO_CTRL(0) = SIO_CTRL_RESET;
- 
-     SIO_MODE(0) = 0
-         | SIO_MODE_BAUD_DIV1
-         | SIO_MODE_DATA_8;
-     SIO_BAUD(0) = F_CPU / 250000;
-     SIO_CTRL(0) = 0
-         | SIO_CTRL_TX_ENABLE
-         | SIO_CTRL_RX_ENABLE
-         | SIO_CTRL_DSR_IRQ_ENABLE;
- }
- 
-bool waitForAcknowledge(int timeout) {
-     // Controllers and memory cards will acknowledge bytes received by sending
-     // short pulses over the DSR line, which will be forwarded by the serial
-     // interface to the interrupt controller. This is not guaranteed to happen
-     // (it will not if e.g. no device is connected), so we have to implement a
-     // timeout to avoid waiting forever in such cases.
-     for (; timeout > 0; timeout -= 10) {
-         if (IRQ_STAT & (1 << IRQ_SIO0)) {
-             // Reset the interrupt controller and serial interface's flags to
-             // ensure the interrupt can be triggered again.
-             IRQ_STAT     = ~(1 << IRQ_SIO0);
-             SIO_CTRL(0) |= SIO_CTRL_ACKNOWLEDGE;
- 
-             return true;
-         }
- 
-         delayMicroseconds(10);
-     }
- 
-     return false;
+     // All transfers over the bus are handled by the interrupt driven driver in
+     // sio.c, which also takes care of setting up the serial interface with the
+     // settings used by controllers and memory cards.
+     sio_init();
  }
  
-
- 
  #define DTR_DELAY       150
- #define DTR_PRE_DELAY   10
- #define DTR_POST_DELAY  10
- #define DTR_PACKET_DELAY 200
- #define DSR_TIMEOUT     120
  
  void selectPort(int port) {
-     // Set or clear the bit that controls which set of controller and memory
-     // card ports is going to have its DTR (port select) signal asserted. The
-     // actual serial bus is shared between all ports, however devices will not
-     // process packets if DTR is not asserted on the port they are plugged into.
-     if (port)
-         SIO_CTRL(0) |= SIO_CTRL_CS_PORT_2;
-     else
-         SIO_CTRL(0) &= ~SIO_CTRL_CS_PORT_2;
+     // The actual serial bus is shared between all ports, however devices will
+     // not process packets if DTR is not asserted on the port they are plugged
+     // into. The port select bit is only updated by the driver once a transfer
+     // actually starts, as another one may still be in progress.
+     _currentPort = port;
  }
  
  uint8_t exchangeByte(uint8_t value) {
@@ -141,52 +104,17 @@ bool waitForAcknowledge(int timeout) {
      DeviceAddress address, const uint8_t *request, uint8_t *response,
      int reqLength, int maxRespLength
  ) {
-     // Reset the interrupt flag and assert the DTR signal to tell the controller
-     // or memory card that we're about to send a packet. Devices may take some
-     // time to prepare for incoming bytes so we need a small delay here.
-     delayMicroseconds(DTR_PRE_DELAY);
-     IRQ_STAT     = ~(1 << IRQ_SIO0);
-     SIO_CTRL(0) |= SIO_CTRL_DTR | SIO_CTRL_ACKNOWLEDGE;
-     delayMicroseconds(DTR_DELAY);
+     // Blocking wrapper around the driver, for code that needs the response
+     // right away. Going through the queue ensures the packet doesn't collide
+     // with any transfer running in the background.
+     SIOTransfer transfer;
  
-     int respLength = 0;
- 
-     // Send the address byte and wait for the device to respond with a pulse on
-     // the DSR line. If no response is received assume no device is connected,
-     // otherwise make sure the serial interface's data buffer is empty to
-     // prepare for the actual packet transfer.
-     SIO_DATA(0) = address;
- 
-     if (waitForAcknowledge(DSR_TIMEOUT)) {
-         while (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY)
-             SIO_DATA(0);
- 
-         // Send and receive the packet simultaneously one byte at a time,
-         // padding it with zeroes if the packet we are receiving is longer than
-         // the data being sent.
-         while (respLength < maxRespLength) {
-             if (reqLength > 0) {
-                 *(response++) = exchangeByte(*(request++));
-                 reqLength--;
-             } else {
-                 *(response++) = exchangeByte(0);
-             }
- 
-             respLength++;
- 
-             // The device will keep sending DSR pulses as long as there is more
-             // data to transfer. If no more pulses are received, terminate the
-             // transfer.
-             if (!waitForAcknowledge(DSR_TIMEOUT))
-                 break;
-         }
-     }
- 
-     // Release DSR, allowing the device to go idle.
-     delayMicroseconds(DTR_DELAY);
-     SIO_CTRL(0) &= ~SIO_CTRL_DTR;
-     delayMicroseconds(DTR_POST_DELAY);
-     return respLength;
+     sio_setupTransfer(
+         &transfer, _currentPort, address, request, response, reqLength,
+         maxRespLength
+     );
+     sio_submit(&transfer);
+     return sio_wait(&transfer);
  }
  
  // All packets sent by controllers in response to a poll command include a 4-bit
@@ -230,66 +158,100 @@ bool waitForAcknowledge(int timeout) {
      "Square"    // Bit 15
  };
  
- uint16_t getButtonPress(int port) {
-     // Build the request packet.
-     uint8_t request[4], response[8];
-
- 
+ void setupPollRequest(uint8_t *request) {
      request[0] = CMD_POLL; // Command
-     request[1] = 0x00;     // Multitap address
+     request[1] = 0x01;     // Multitap address (all slots)
      request[2] = 0x00;     // Rumble motor control 1
      request[3] = 0x00;     // Rumble motor control 2
+ }
+ 
+ static void parseControllerData(
+     ControllerData *data, const uint8_t *response, int respLength
+ ) {
+     memset(data, 0, sizeof(ControllerData));
+ 
+     // All controllers reply with at least 4 bytes of data. Empty multitap
+     // slots are filled with 0xff bytes.
+     if ((respLength < 4) || (response[0] == 0xff))
+         return;
+ 
+     // The first byte of the response contains the device type ID in the upper
+     // nibble, as well as the length of the packet's payload in 2-byte units in
+     // the lower nibble. Bytes 2 and 3 hold a bitfield representing the state
+     // all buttons. As each bit is active low (i.e. a zero represents a button
+     // being pressed), the entire field must be inverted.
+     data->connected = true;
+     data->type      = response[0] >> 4;
+     data->buttons   = (response[2] | (response[3] << 8)) ^ 0xffff;
+ 
+     // Analog controllers append the right and left stick positions.
+     if (
+         ((data->type == TYPE_ANALOG) || (data->type == TYPE_ANALOG_STICK)) &&
+         (respLength >= 8)
+     ) {
+         data->rightX = response[4] - 0x80;
+         data->rightY = response[5] - 0x80;
+         data->leftX  = response[6] - 0x80;
+         data->leftY  = response[7] - 0x80;
+     }
+ }
+ 
+ int parsePollResponse(
+     ControllerData *slots, const uint8_t *response, int respLength
+ ) {
+     for (int i = 1; i < MULTITAP_SLOTS; i++)
+         memset(&slots[i], 0, sizeof(ControllerData));
+ 
+     if ((respLength < 2) || ((response[0] >> 4) != TYPE_MULTITAP)) {
+         parseControllerData(&slots[0], response, respLength);
+         return 1;
+     }
+ 
+     // A multitap replies with its own 2-byte header followed by a full poll
+     // response for each slot.
+     for (int i = 0; i < MULTITAP_SLOTS; i++) {
+         int offset = 2 + i * MULTITAP_SLOT_LENGTH;
+ 
+         parseControllerData(
+             &slots[i], &response[offset], respLength - offset
+         );
+     }
+ 
+     return MULTITAP_SLOTS;
+ }
+ 
+ uint16_t getButtonPress(int port) {
+     uint8_t request[POLL_REQUEST_LENGTH], response[POLL_RESPONSE_LENGTH];
  
      // Send the request to the specified controller port and grab the response.
-     // Note that this is a relatively slow process and should be done only once
-     // per frame, unless higher polling rates are desired.
+     // Note that this blocks until the transfer is done; code that polls every
+     // frame should submit its own transfer and collect it later instead.
+     setupPollRequest(request);
      selectPort(port);
      int respLength = exchangePacket(
          ADDR_CONTROLLER, request, response, sizeof(request), sizeof(response)
      );
  
-    // ptr += sprintf(ptr, "Port %d:\n", port + 1);
- 
-     if (respLength < 4) {
-         // All controllers reply with at least 4 bytes of data.
-    //     ptr += sprintf(ptr, "  No controller connected");
-         return 0x00;
-     }
+     ControllerData slots[MULTITAP_SLOTS];
  
-     // The first byte of the response contains the device type ID in the upper
-     // nibble, as well as the length of the packet's payload in 2-byte units in
-     // the lower nibble.
-    /*  ptr += sprintf(
-         ptr,
-         "  Controller type:\t%s\n"
-         "  Buttons pressed:\t",
-         controllerTypes[response[0] >> 4]
-     );
-     */
-     // Bytes 2 and 3 hold a bitfield representing the state all buttons. As each
-     // bit is active low (i.e. a zero represents a button being pressed), the
-     // entire field must be inverted.
-     uint16_t buttons = (response[2] | (response[3] << 8)) ^ 0xffff;
-     return buttons;
-     /*
-     for (int i = 0; i < 16; i++) {
-         if ((buttons >> i) & 1)
-             ptr += sprintf(ptr, "%s ", buttonNames[i]);
-     }
-    */
-    // ptr += sprintf(ptr, "\n  Response data:\t");
- 
-    // for (int i = 0; i < respLength; i++)
-    //     ptr += sprintf(ptr, "%02X ", response[i]);
-
+     parsePollResponse(slots, response, respLength);
+     return slots[0].buttons;
  }
 
 
 void sendPacketNoAcknowledge(
     DeviceAddress address, const uint8_t *request, int reqLength
 ) {
-    IRQ_STAT     = ~(1 << IRQ_SIO0);
-    SIO_CTRL(0) |= SIO_CTRL_DTR | SIO_CTRL_ACKNOWLEDGE;
+    // This bypasses the driver, so wait for the bus to be free first. Any
+    // acknowledge pulses are ignored by the driver's interrupt handler.
+    sio_flush();
+
+    uint16_t ctrl = SIO_CTRL(0) & ~SIO_CTRL_CS_PORT_2;
+
+    if (_currentPort)
+        ctrl |= SIO_CTRL_CS_PORT_2;
+
+    SIO_CTRL(0) = ctrl | SIO_CTRL_DTR | SIO_CTRL_ACKNOWLEDGE;
     delayMicroseconds(DTR_DELAY);
 
     SIO_DATA(0) = address;
@@ -306,18 +268,85 @@ void sendPacketNoAcknowledge(
     SIO_CTRL(0) &= ~SIO_CTRL_DTR;
 }
 
-void sendGameID(const char *str) {
-    uint8_t request[64];
+// Game ID receivers (memory card emulators) acknowledge every byte of the
+// packets addressed to them, so a short ping is enough to find out which port
+// one is plugged into. Failed exchanges are retried after a delay that doubles
+// on every attempt, as the receiver may be busy e.g. writing to its SD card.
+#define GAME_ID_RETRIES       4
+#define GAME_ID_RETRY_DELAY   1000
+#define GAME_ID_PING_LENGTH   4
+
+static bool pingGameIDReceiver(int port) {
+    uint8_t request[GAME_ID_PING_LENGTH], response[GAME_ID_PING_LENGTH];
+
+    memset(request, 0, sizeof(request));
+    request[0] = CMD_GAME_ID_PING;
+
+    selectPort(port);
+    return exchangePacket(
+        ADDR_MEMORY_CARD, request, response, sizeof(request), sizeof(response)
+    ) == sizeof(request);
+}
+
+int findGameIDReceiver(void) {
+    int delay = GAME_ID_RETRY_DELAY;
+
+    for (int i = 0; i < GAME_ID_RETRIES; i++) {
+        for (int port = 0; port < 2; port++) {
+            if (pingGameIDReceiver(port))
+                return port;
+        }
+
+        delayMicroseconds(delay);
+        delay *= 2;
+    }
+
+    return -1;
+}
+
+bool sendGameID(const char *str) {
+    uint8_t request[64], response[64];
     size_t  length = strlen(str) + 1;
 
+    if (length > (sizeof(request) - 3))
+        length = sizeof(request) - 3;
+
     request[0] = CMD_GAME_ID_SEND;
     request[1] = 0;
     request[2] = length;
-    __builtin_strncpy(&request[3], str, length);
+    __builtin_memcpy(&request[3], str, length);
+    request[length + 2] = 0;
+
+    int port = findGameIDReceiver();
 
-    // Send the ID on both ports.
-    for (int i = 0; i < 2; i++) {
-        selectPort(i);
-        sendPacketNoAcknowledge(ADDR_MEMORY_CARD, request, length+3);
+    if (port < 0) {
+        // Fall back to sending the ID blindly on both ports, in case the
+        // receiver doesn't acknowledge pings.
+        for (int i = 0; i < 2; i++) {
+            selectPort(i);
+            sendPacketNoAcknowledge(ADDR_MEMORY_CARD, request, length + 3);
+        }
+
+        return false;
     }
-}
\ No newline at end of file
+
+    // The device acknowledges all bytes but the last one, so the exchange is
+    // only successful if the whole packet was transferred.
+    int delay = GAME_ID_RETRY_DELAY;
+
+    selectPort(port);
+
+    for (int i = 0; i < GAME_ID_RETRIES; i++) {
+        int respLength = exchangePacket(
+            ADDR_MEMORY_CARD, request, response, length + 3, length + 3
+        );
+
+        if (respLength == (int) (length + 3))
+            return true;
+
+        delayMicroseconds(delay);
+        delay *= 2;
+    }
+
+    return false;
+}
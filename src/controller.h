@@ -52,18 +52,51 @@ typedef enum {
 #define BUTTON_MASK_SQUARE   (1<<15)
 #define BYTE_DELAY 30
 
+// Device type IDs, as found in the upper nibble of the first byte of a poll
+// response.
+typedef enum {
+    TYPE_MOUSE          = 0x1,
+    TYPE_NEGCON         = 0x2,
+    TYPE_DIGITAL        = 0x4,
+    TYPE_ANALOG_STICK   = 0x5,
+    TYPE_ANALOG         = 0x7,
+    TYPE_MULTITAP       = 0x8,
+    TYPE_CONFIG_MODE    = 0xf
+} ControllerType;
+
+// Polls are sent with the multitap flag set, so that a multitap replies with
+// the state of all four of its slots (8 bytes each) rather than only the first
+// one. Controllers plugged in directly ignore the flag.
+#define MULTITAP_SLOTS       4
+#define MULTITAP_SLOT_LENGTH 8
+#define POLL_REQUEST_LENGTH  4
+#define POLL_RESPONSE_LENGTH (2 + MULTITAP_SLOTS * MULTITAP_SLOT_LENGTH)
+
+// Analog axes are centered on zero, ranging from -128 (left/up) to 127
+// (right/down). They are left at zero for controllers without sticks.
+typedef struct {
+    bool     connected;
+    uint8_t  type;
+    uint16_t buttons;
+    int8_t   rightX, rightY, leftX, leftY;
+} ControllerData;
+
 
 //void delayMicroseconds(int time);
 void sendPacketNoAcknowledge(DeviceAddress address, const uint8_t *request, int reqLength);
-void sendGameID(const char *str);
+int findGameIDReceiver(void);
+bool sendGameID(const char *str);
 void initControllerBus(void);
-bool waitForAcknowledge(int timeout);
 void selectPort(int port);
 uint8_t exchangeByte(uint8_t value);
 int exchangePacket(
     DeviceAddress address, const uint8_t *request, uint8_t *response,
     int reqLength, int maxRespLength
 );
+void setupPollRequest(uint8_t *request);
+int parsePollResponse(
+    ControllerData *slots, const uint8_t *response, int respLength
+);
 uint16_t getButtonPress(int port);
 
 
@@ -0,0 +1,322 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "cover.h"
+#include "gpu.h"
+#include "vram.h"
+#include "includes/cdrom.h"
+#include "ps1/cdrom.h"
+#include "ps1/gpucmd.h"
+#include "ps1/registers.h"
+
+// Thumbnails are requested with the same DSP test command trick used for the
+// game listing: the Picostation prepares the cover for the given (1-based)
+// game index and serves it on the next read of COVER_LBA.
+#define COVER_LBA         100
+#define COVER_CMD         0xf5
+#define COVER_TIMEOUT     30 // Frames to wait for a sector before giving up
+#define COVER_RETRY_DELAY 2  // Frames to wait before asking again
+#define COVER_MAX_RETRIES 8
+
+#define COVER_FLAG_PRESENT (1 << 0)
+
+typedef struct {
+	char     magic[8];
+	uint16_t index, flags;
+	uint8_t  _reserved[116];
+} CoverHeader;
+
+typedef enum {
+	SLOT_EMPTY   = 0,
+	SLOT_LOADING = 1,
+	SLOT_READY   = 2,
+	SLOT_MISSING = 3
+} CoverSlotState;
+
+typedef struct {
+	TextureInfo texture;
+	uint32_t    lastUsed;
+	uint16_t    index;
+	uint8_t     state, retries;
+} CoverSlot;
+
+typedef enum {
+	COVER_SM_IDLE          = 0,
+	COVER_SM_WAIT_FOR_DATA = 1,
+	COVER_SM_RETRY         = 2,
+	COVER_SM_UPLOAD        = 3
+} CoverStateMachineState;
+
+static CoverSlot _slots[COVER_CACHE_SLOTS];
+static int       _numSlots = 0;
+
+// The "wanted" list is rebuilt every frame from the thumbnails drawn on screen
+// followed by the ones prefetched for the next page, so it always reflects the
+// current working set in priority order.
+static uint16_t _wanted[COVER_MAX_WANTED];
+static int      _numWanted = 0;
+static uint32_t _frame     = 0;
+
+static uint32_t               _sectorBuffer[2048 / 4];
+static CoverStateMachineState _state       = COVER_SM_IDLE;
+static CoverSlot              *_loadingSlot = 0;
+static uint32_t               _requestFrame;
+static uint32_t               _readCount;
+
+static const char _coverMagic[8] = "<cover>";
+
+static CoverSlot *_findSlot(uint16_t index) {
+	for (int i = 0; i < _numSlots; i++) {
+		if ((_slots[i].state != SLOT_EMPTY) && (_slots[i].index == index))
+			return &_slots[i];
+	}
+
+	return 0;
+}
+
+static bool _isWanted(uint16_t index) {
+	for (int i = 0; i < _numWanted; i++) {
+		if (_wanted[i] == index)
+			return true;
+	}
+
+	return false;
+}
+
+static void _want(uint16_t index) {
+	if (!index || (_numWanted >= COVER_MAX_WANTED) || _isWanted(index))
+		return;
+
+	_wanted[_numWanted++] = index;
+}
+
+// Pick the least recently used slot that is neither being loaded nor part of
+// the current working set. Never evicting wanted thumbnails prevents the
+// visible page and the prefetched one from endlessly evicting each other when
+// they don't both fit in the cache.
+static CoverSlot *_evictSlot(void) {
+	CoverSlot *victim = 0;
+
+	for (int i = 0; i < _numSlots; i++) {
+		CoverSlot *slot = &_slots[i];
+
+		if (slot->state == SLOT_EMPTY)
+			return slot;
+		if ((slot->state == SLOT_LOADING) || _isWanted(slot->index))
+			continue;
+		if (!victim || (slot->lastUsed < victim->lastUsed))
+			victim = slot;
+	}
+
+	return victim;
+}
+
+static void _startRead(CoverSlot *slot) {
+	uint8_t request[] = {
+		CDROM_TEST_DSP_CMD, COVER_CMD,
+		(slot->index >> 8) & 0xff, slot->index & 0xff
+	};
+
+	issueCDROMCommand(CDROM_CMD_TEST, request, sizeof(request));
+	startCDROMRead(COVER_LBA, _sectorBuffer, 1, 2048, false, false);
+
+	_readCount    = cdromReadCount;
+	_requestFrame = _frame;
+	_state        = COVER_SM_WAIT_FOR_DATA;
+}
+
+static void _finishLoad(CoverSlotState state) {
+	_loadingSlot->state = state;
+	_loadingSlot        = 0;
+	_state              = COVER_SM_IDLE;
+}
+
+int cover_init(void) {
+	_numSlots = 0;
+
+	for (int i = 0; i < COVER_CACHE_SLOTS; i++) {
+		if (!vram_allocTexture(
+			&_slots[i].texture, COVER_WIDTH, COVER_HEIGHT, GP0_COLOR_16BPP
+		))
+			break;
+
+		_numSlots++;
+	}
+
+	cover_flush();
+	return _numSlots;
+}
+
+void cover_flush(void) {
+	for (int i = 0; i < _numSlots; i++) {
+		// A read that is already in flight can't be cancelled. Clearing the
+		// index makes sure its data gets discarded once it arrives.
+		if (_slots[i].state == SLOT_LOADING)
+			_slots[i].index = 0;
+		else
+			_slots[i].state = SLOT_EMPTY;
+	}
+
+	_numWanted = 0;
+}
+
+void cover_beginFrame(void) {
+	_frame++;
+	_numWanted = 0;
+}
+
+void cover_draw(DMAChain *chain, uint16_t index, int x, int y, int size) {
+	CoverSlot *slot = _findSlot(index);
+	uint32_t  *ptr;
+
+	_want(index);
+
+	if (!slot || (slot->state != SLOT_READY)) {
+		// Draw a flat placeholder until the thumbnail is available (or forever
+		// if the game has no cover).
+		ptr    = allocatePacket(chain, 3);
+		ptr[0] = gp0_rgb(96, 96, 96) | gp0_rectangle(false, false, false);
+		ptr[1] = gp0_xy(x, y);
+		ptr[2] = gp0_xy(size, size);
+
+		if (slot)
+			slot->lastUsed = _frame;
+
+		return;
+	}
+
+	const TextureInfo *tex = &slot->texture;
+	int               u0   = tex->u, u1 = tex->u + tex->width  - 1;
+	int               v0   = tex->v, v1 = tex->v + tex->height - 1;
+
+	slot->lastUsed = _frame;
+
+	// Thumbnails are scaled down to the row height, so a textured quad has to
+	// be used instead of a rectangle. The quad carries its own texpage, which
+	// printString() will override again when drawing the next string.
+	ptr    = allocatePacket(chain, 9);
+	ptr[0] = gp0_quad(true, false);
+	ptr[1] = gp0_xy(x,        y);
+	ptr[2] = gp0_uv(u0, v0, 0);
+	ptr[3] = gp0_xy(x + size, y);
+	ptr[4] = gp0_uv(u1, v0, tex->page);
+	ptr[5] = gp0_xy(x,        y + size);
+	ptr[6] = gp0_uv(u0, v1, 0);
+	ptr[7] = gp0_xy(x + size, y + size);
+	ptr[8] = gp0_uv(u1, v1, 0);
+}
+
+void cover_prefetch(uint16_t index) {
+	CoverSlot *slot = _findSlot(index);
+
+	_want(index);
+
+	if (slot)
+		slot->lastUsed = _frame;
+}
+
+void cover_update(void) {
+	switch (_state) {
+		case COVER_SM_IDLE:
+			// Start loading the highest priority thumbnail that isn't cached
+			// yet, provided there is a slot that can be reused for it and the
+			// drive isn't busy streaming music.
+			if (!isCDROMReadDone())
+				return;
+
+			for (int i = 0; i < _numWanted; i++) {
+				if (_findSlot(_wanted[i]))
+					continue;
+
+				CoverSlot *slot = _evictSlot();
+
+				if (!slot)
+					return;
+
+				slot->index    = _wanted[i];
+				slot->state    = SLOT_LOADING;
+				slot->retries  = 0;
+				slot->lastUsed = _frame;
+				_loadingSlot   = slot;
+
+				_startRead(slot);
+				return;
+			}
+			break;
+
+		case COVER_SM_WAIT_FOR_DATA: {
+			// Once the sector is in, the music stream may start a read of its
+			// own before this runs. That one is not ours to time out or
+			// cancel, and its start means the cover read is over.
+			if ((cdromReadCount == _readCount) && !isCDROMReadDone()) {
+				// The read may still be writing to the sector buffer, so it
+				// has to be stopped before a new one is issued.
+				if ((_frame - _requestFrame) > COVER_TIMEOUT) {
+					cancelCDROMRead();
+
+					_requestFrame = _frame;
+					_state        = COVER_SM_RETRY;
+				}
+				return;
+			}
+
+			const CoverHeader *header = (const CoverHeader *) _sectorBuffer;
+
+			// The slot may have been flushed while the read was in progress.
+			if (!_loadingSlot->index) {
+				_finishLoad(SLOT_EMPTY);
+				return;
+			}
+
+			// If the Picostation hasn't finished preparing the cover yet the
+			// sector will still hold stale data, so ask again shortly.
+			if (
+				memcmp(header->magic, _coverMagic, sizeof(_coverMagic)) ||
+				(header->index != _loadingSlot->index)
+			) {
+				_requestFrame = _frame;
+				_state        = COVER_SM_RETRY;
+				return;
+			}
+
+			if (!(header->flags & COVER_FLAG_PRESENT)) {
+				_finishLoad(SLOT_MISSING);
+				return;
+			}
+
+			int x, y;
+
+			vram_getTextureOrigin(&_loadingSlot->texture, &x, &y);
+			sendVRAMData(&header[1], x, y, COVER_WIDTH, COVER_HEIGHT);
+			_state = COVER_SM_UPLOAD;
+			break;
+		}
+
+		case COVER_SM_RETRY:
+			if (!_loadingSlot->index) {
+				_finishLoad(SLOT_EMPTY);
+				return;
+			}
+			if (
+				((_frame - _requestFrame) < COVER_RETRY_DELAY) ||
+				!isCDROMReadDone()
+			)
+				return;
+			if (++_loadingSlot->retries > COVER_MAX_RETRIES) {
+				_finishLoad(SLOT_MISSING);
+				return;
+			}
+
+			_startRead(_loadingSlot);
+			break;
+
+		case COVER_SM_UPLOAD:
+			// The sector buffer can only be reused once the GPU has pulled
+			// the whole image out of it.
+			if (DMA_CHCR(DMA_GPU) & DMA_CHCR_ENABLE)
+				return;
+
+			_finishLoad(_loadingSlot->index ? SLOT_READY : SLOT_EMPTY);
+			break;
+	}
+}
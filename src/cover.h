@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpu.h"
+
+// Cover thumbnails are sent by the Picostation as a single 2048-byte sector: a
+// 128-byte header followed by a 32x30 16bpp image.
+#define COVER_WIDTH       32
+#define COVER_HEIGHT      30
+#define COVER_CACHE_SLOTS 32
+#define COVER_MAX_WANTED  48
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Allocate the VRAM slots used by the thumbnail cache. Must be called
+/// after vram_init() and after any fixed textures have been uploaded.
+/// @return Number of slots that could be allocated.
+int cover_init(void);
+
+/// @brief Forget all cached thumbnails, e.g. after changing directory, as
+/// Picostation indices are only valid within the current listing.
+void cover_flush(void);
+
+/// @brief Start a new frame. Must be called once per frame before any
+/// cover_draw() or cover_prefetch() call.
+void cover_beginFrame(void);
+
+/// @brief Draw the thumbnail for a game (1-based Picostation index) scaled to
+/// the given size, or a placeholder if it is not loaded yet. The thumbnail is
+/// queued for loading if it is not cached.
+void cover_draw(DMAChain *chain, uint16_t index, int x, int y, int size);
+
+/// @brief Queue a thumbnail for loading without drawing it. Prefetch requests
+/// are served after all thumbnails drawn this frame.
+void cover_prefetch(uint16_t index);
+
+/// @brief Advance the loader state machine. Never waits for a sector to
+/// arrive; at most one CD-ROM read is in flight at a time, and reads that time
+/// out are cancelled before being retried.
+void cover_update(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include "font.h"
+#include "gpu.h"
+#include "ps1/gpucmd.h"
+
+void font_init(Font *font, const FontMetrics *metrics, const TextureInfo *texture) {
+	// The atlas always fits within a single texture page, so adding its origin
+	// to the glyph coordinates can never carry from U into V or from V into
+	// the CLUT field.
+	uint32_t origin = gp0_uv(texture->u, texture->v, texture->clut);
+
+	font->texture = *texture;
+	font->metrics = metrics;
+
+	for (int i = 0; i < 256; i++)
+		font->uv[i] = metrics->glyphs[i].uv + origin;
+}
+
+int measureString(const Font *font, const char *str) {
+	const FontMetrics *metrics = font->metrics;
+	int               width    = 0, maxWidth = 0;
+
+	for (; *str; str++) {
+		uint8_t ch = (uint8_t) *str;
+
+		switch (ch) {
+			case '\t':
+				width += metrics->tabWidth - 1;
+				width -= width % metrics->tabWidth;
+				break;
+
+			case '\n':
+				if (width > maxWidth)
+					maxWidth = width;
+
+				width = 0;
+				break;
+
+			default:
+				width += metrics->glyphs[ch].advance;
+		}
+	}
+
+	return (width > maxWidth) ? width : maxWidth;
+}
+
+// Emit a single glyph, cropped horizontally to the [clipLeft, clipRight) range.
+// Cropping is done by adjusting the rectangle's position, size and U
+// coordinate, so that partially visible glyphs (as seen while scrolling) don't
+// spill outside the clipping range.
+static void _drawGlyph(
+	DMAChain *chain, const Font *font, uint8_t ch, int x, int y, int clipLeft,
+	int clipRight
+) {
+	const FontGlyph *glyph = &font->metrics->glyphs[ch];
+
+	if (!glyph->size)
+		return;
+
+	int      width = glyph->size & 0xffff;
+	uint32_t uv    = font->uv[ch];
+	uint32_t size  = glyph->size;
+
+	if (((x + width) <= clipLeft) || (x >= clipRight))
+		return;
+
+	if (x < clipLeft) {
+		int cut = clipLeft - x;
+
+		x     += cut;
+		uv    += cut;
+		size  -= cut;
+		width -= cut;
+	}
+	if ((x + width) > clipRight)
+		size -= (x + width) - clipRight;
+
+	uint32_t *ptr = allocatePacket(chain, 4);
+
+	ptr[0] = gp0_rectangle(true, true, true);
+	ptr[1] = gp0_xy(x, y);
+	ptr[2] = uv;
+	ptr[3] = size;
+}
+
+void printStringClipped(
+	DMAChain *chain, const Font *font, int x, int y, int clipLeft,
+	int clipRight, const char *str
+) {
+	const FontMetrics *metrics  = font->metrics;
+	int               currentX = x, currentY = y;
+
+	uint32_t *ptr;
+
+	// Start by sending a texpage command to tell the GPU to use the font's
+	// spritesheet. Note that the texpage command before a drawing command can
+	// be omitted when reusing the same texture, so sending it here just once is
+	// enough.
+	ptr    = allocatePacket(chain, 1);
+	ptr[0] = gp0_texpage(font->texture.page, false, false);
+
+	// Iterate over every character in the string.
+	for (; *str; str++) {
+		uint8_t ch = (uint8_t) *str;
+
+		// Tabs and newlines move the pen without drawing anything. Everything
+		// else (including invalid characters, which map to a fallback glyph)
+		// is looked up directly in the glyph table.
+		switch (ch) {
+			case '\t':
+				currentX += metrics->tabWidth - 1;
+				currentX -= currentX % metrics->tabWidth;
+				continue;
+
+			case '\n':
+				currentX  = x;
+				currentY += metrics->lineHeight;
+				continue;
+		}
+
+		// Once the pen has moved past the right edge nothing else on the
+		// current line can be visible, so skip straight to the next one (if
+		// any) without looking at the remaining glyphs.
+		if (currentX >= clipRight) {
+			while (str[1] && (str[1] != '\n'))
+				str++;
+
+			continue;
+		}
+
+		int advance = metrics->glyphs[ch].advance;
+
+		if ((currentX + advance) > clipLeft)
+			_drawGlyph(chain, font, ch, currentX, currentY, clipLeft, clipRight);
+
+		currentX += advance;
+	}
+}
+
+void printStringEllipsis(
+	DMAChain *chain, const Font *font, int x, int y, int maxWidth, int width,
+	const char *str
+) {
+	if (width < 0)
+		width = measureString(font, str);
+	if (width <= maxWidth) {
+		printStringClipped(chain, font, x, y, x, x + maxWidth, str);
+		return;
+	}
+
+	const FontMetrics *metrics = font->metrics;
+	int               dotWidth = metrics->glyphs['.'].advance;
+	int               limit    = x + maxWidth - dotWidth * 3;
+	int               currentX = x;
+
+	uint32_t *ptr;
+
+	ptr    = allocatePacket(chain, 1);
+	ptr[0] = gp0_texpage(font->texture.page, false, false);
+
+	// Draw as many whole glyphs as fit in front of the ellipsis. This is only
+	// meant for single line strings, so tabs and newlines are not handled.
+	for (; *str; str++) {
+		uint8_t ch      = (uint8_t) *str;
+		int     advance = metrics->glyphs[ch].advance;
+
+		if ((currentX + advance) > limit)
+			break;
+
+		_drawGlyph(chain, font, ch, currentX, y, x, limit);
+		currentX += advance;
+	}
+
+	for (int i = 0; i < 3; i++, currentX += dotWidth)
+		_drawGlyph(chain, font, '.', currentX, y, x, x + maxWidth);
+}
+
+int getMarqueeOffset(int width, int maxWidth, uint32_t time) {
+	int overflow = width - maxWidth;
+
+	if (overflow <= 0)
+		return 0;
+
+	// Hold at the start, scroll until the end of the string is visible, hold
+	// there, then jump back to the start.
+	int period = MARQUEE_HOLD_TIME * 2 + overflow * MARQUEE_SPEED;
+	int phase  = time % period;
+
+	if (phase < MARQUEE_HOLD_TIME)
+		return 0;
+
+	phase -= MARQUEE_HOLD_TIME;
+
+	if (phase >= (overflow * MARQUEE_SPEED))
+		return overflow;
+
+	return phase / MARQUEE_SPEED;
+}
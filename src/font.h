@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpu.h"
+
+// Glyph tables are generated at build time by convertFont.py. Each of the 256
+// entries holds the glyph's position within the atlas and its size, already
+// encoded as GP0 words, so drawing a character only takes a table lookup.
+// Characters not present in the font map to a fallback glyph rather than being
+// left out of the table.
+typedef struct {
+	uint16_t uv;      // gp0_uv() relative to the atlas, without CLUT
+	uint8_t  advance;
+	uint8_t  _reserved;
+	uint32_t size;    // gp0_xy() of the glyph's size, 0 for blank glyphs
+} FontGlyph;
+
+// Frames to hold a scrolling string at either end, and frames per pixel scrolled.
+#define MARQUEE_HOLD_TIME 60
+#define MARQUEE_SPEED     2
+
+#define FONT_CLIP_RIGHT 1024
+
+typedef struct {
+	const FontGlyph *glyphs;
+	uint16_t        width, height;
+	uint8_t         lineHeight, tabWidth;
+} FontMetrics;
+
+typedef struct {
+	TextureInfo       texture;
+	const FontMetrics *metrics;
+
+	// UV words of all glyphs with the atlas' position in VRAM and CLUT already
+	// added in, so they can be copied into packets as-is.
+	uint32_t uv[256];
+} Font;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Bind a generated glyph table to an atlas that has already been
+/// uploaded to VRAM.
+void font_init(Font *font, const FontMetrics *metrics, const TextureInfo *texture);
+
+/// @brief Return the width in pixels of the widest line in a string.
+int measureString(const Font *font, const char *str);
+
+/// @brief Draw the part of a string that falls between two X coordinates.
+/// Glyphs straddling either edge are cropped, glyphs outside the range are
+/// skipped without emitting any packet.
+void printStringClipped(
+	DMAChain *chain, const Font *font, int x, int y, int clipLeft,
+	int clipRight, const char *str
+);
+
+/// @brief Draw a single line string, truncating it with an ellipsis if it is
+/// wider than maxWidth. width is the string's width as returned by
+/// measureString(), or -1 to measure it on the fly.
+void printStringEllipsis(
+	DMAChain *chain, const Font *font, int x, int y, int maxWidth, int width,
+	const char *str
+);
+
+/// @brief Return how many pixels a string of the given width must be scrolled
+/// left by to show it in a box maxWidth pixels wide at the given time (in
+/// frames). Strings that fit are never scrolled.
+int getMarqueeOffset(int width, int maxWidth, uint32_t time);
+
+/// @brief Draw a string at the given position. Tabs and newlines are handled,
+/// any other character is drawn using its glyph from the font's table. Glyphs
+/// past the right edge of VRAM are skipped.
+static inline void printString(
+	DMAChain *chain, const Font *font, int x, int y, const char *str
+) {
+	printStringClipped(chain, font, x, y, 0, FONT_CLIP_RIGHT, str);
+}
+
+#ifdef __cplusplus
+}
+#endif
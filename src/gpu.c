@@ -25,8 +25,24 @@
 	 int x = 0x760;
 	 int y = (mode == GP1_MODE_PAL) ? 0xa3 : 0x88;
  
-	 GP1HorizontalRes horizontalRes = GP1_HRES_320;
-	 GP1VerticalRes   verticalRes   = GP1_VRES_256;
+	 // Pick the narrowest horizontal resolution the requested width fits in.
+	 // Anything taller than a single field requires interlaced output, in
+	 // which case the GPU alternates between even and odd lines every field.
+	 GP1HorizontalRes horizontalRes;
+ 
+	 if (width <= 256)
+		 horizontalRes = GP1_HRES_256;
+	 else if (width <= 320)
+		 horizontalRes = GP1_HRES_320;
+	 else if (width <= 368)
+		 horizontalRes = GP1_HRES_368;
+	 else if (width <= 512)
+		 horizontalRes = GP1_HRES_512;
+	 else
+		 horizontalRes = GP1_HRES_640;
+ 
+	 bool           interlace   = (height > 256);
+	 GP1VerticalRes verticalRes = interlace ? GP1_VRES_512 : GP1_VRES_256;
  
 	 int offsetX = (width  * gp1_clockMultiplierH(horizontalRes)) / 2;
 	 int offsetY = (height / gp1_clockDividerV(verticalRes))      / 2;
@@ -35,7 +51,7 @@
 	 GPU_GP1 = gp1_fbRangeH(x - offsetX, x + offsetX);
 	 GPU_GP1 = gp1_fbRangeV(y - offsetY, y + offsetY);
 	 GPU_GP1 = gp1_fbMode(
-		 horizontalRes, verticalRes, mode, false, GP1_COLOR_16BPP
+		 horizontalRes, verticalRes, mode, interlace, GP1_COLOR_16BPP
 	 );
  }
  
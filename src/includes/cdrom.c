@@ -7,7 +7,6 @@
 #include "ps1/registers.h"
 #include "filesystem.h"
 
-#include <stdio.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 #include "system.h"
@@ -30,6 +29,8 @@ uint8_t cdromStatus;
 
 uint8_t cdromLastReadPurpose;
 
+volatile uint32_t cdromReadCount;
+
 #define toBCD(i) (((i) / 10 * 16) | ((i) % 10))
 
 #define CDROM_BUSY (CDROM_HSTS & CDROM_HSTS_BUSYSTS)
@@ -62,6 +63,12 @@ void initCDROM(void) {
 }
 
 void issueCDROMCommand(uint8_t cmd, const uint8_t *arg, size_t argLength) {
+    // Picostation commands change what is served on the next read, so they
+    // must not be issued while a background read is still in progress. Test
+    // commands are never issued from the IRQ handler, so waiting is safe.
+    if (cmd == CDROM_CMD_TEST)
+        waitForCDROMRead();
+
     waitingForInt1 = true;
     waitingForInt2 = true;
     waitingForInt3 = true;
@@ -169,49 +176,193 @@ void waitForINT5(){
     printf("Finish read\n");
 }*/
 
-void startCDROMRead(uint32_t lba, void *ptr, size_t numSectors, size_t sectorSize, bool doubleSpeed, bool wait)
+bool isCDROMReadDone(void){
+    return !cdromReadDataNumSectors &&
+        !(DMA_CHCR(DMA_CDROM) & DMA_CHCR_ENABLE);
+}
+
+void waitForCDROMRead(void){
+    while(!isCDROMReadDone()){
+        __asm__ volatile("");
+    }
+}
+
+// Set by startCDROMStreamRead(). Sectors are written to a ring of slots rather
+// than one after another, and handed to the callback as soon as they arrive.
+static CDROMSectorCallback cdromSectorCallback;
+static void                *cdromSlotsStart, *cdromSlotsEnd;
+
+// Starting a read takes three commands (SETMODE, SETLOC, READ_N), each of
+// which must be acknowledged before the next one can be issued. Rather than
+// waiting for each acknowledge, the next command is issued from the INT3
+// handler, so that starting a read never blocks.
+typedef enum {
+    READ_STATE_IDLE    = 0, // No read in progress
+    READ_STATE_WAIT    = 1, // Waiting for an earlier command to be acknowledged
+    READ_STATE_SETMODE = 2, // Waiting for SETMODE to be acknowledged
+    READ_STATE_SETLOC  = 3, // Waiting for SETLOC to be acknowledged
+    READ_STATE_START   = 4, // Waiting for READ_N to be acknowledged
+    READ_STATE_DATA    = 5  // Sectors are being delivered through INT1
+} ReadState;
+
+#define READ_MAX_RETRIES 3
+
+static volatile ReadState cdromReadState;
+static uint8_t            cdromReadMode, cdromReadRetries;
+static CDROMMSF           cdromReadMSF;
+static uint32_t           cdromReadLBA; // Next sector to be delivered
+static volatile bool      cdromReadFailed;
+
+static void _issueSetmode(void){
+    cdromReadState = READ_STATE_SETMODE;
+    issueCDROMCommand(CDROM_CMD_SETMODE, &cdromReadMode, sizeof(cdromReadMode));
+}
+
+static void _failRead(void){
+    cdromReadState          = READ_STATE_IDLE;
+    cdromReadDataNumSectors = 0;
+    cdromReadFailed         = true;
+}
+
+bool isCDROMReadFailed(void){
+    return cdromReadFailed;
+}
+
+// Called from the IRQ handler once the last command has been acknowledged
+// (or has failed, if error is set).
+static void _advanceRead(bool error){
+    switch (cdromReadState){
+        case READ_STATE_WAIT:
+            _issueSetmode();
+            break;
+
+        case READ_STATE_SETMODE:
+        case READ_STATE_SETLOC:
+        case READ_STATE_START:
+            if (error){
+                if (cdromReadRetries++ < READ_MAX_RETRIES){
+                    _issueSetmode();
+                } else {
+                    _failRead();
+                }
+            } else if (cdromReadState == READ_STATE_SETMODE){
+                cdromReadState = READ_STATE_SETLOC;
+                issueCDROMCommand(CDROM_CMD_SETLOC, (const uint8_t *) &cdromReadMSF, sizeof(cdromReadMSF));
+            } else if (cdromReadState == READ_STATE_SETLOC){
+                cdromReadState = READ_STATE_START;
+                issueCDROMCommand(CDROM_CMD_READ_N, NULL, 0);
+            } else {
+                cdromReadState = READ_STATE_DATA;
+            }
+            break;
+
+        // The drive stops reading after an error, so resume from the first
+        // sector that hasn't been delivered yet.
+        case READ_STATE_DATA:
+            if (!error)
+                break;
+
+            if (cdromReadRetries++ < READ_MAX_RETRIES){
+                cdrom_convertLBAToMSF(&cdromReadMSF, cdromReadLBA);
+
+                cdromReadState = READ_STATE_SETLOC;
+                issueCDROMCommand(CDROM_CMD_SETLOC, (const uint8_t *) &cdromReadMSF, sizeof(cdromReadMSF));
+            } else {
+                _failRead();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void _startRead(uint32_t lba, void *ptr, size_t numSectors, size_t sectorSize, bool doubleSpeed, bool wait)
 {
     cdromReadDataPtr = ptr;
     cdromReadDataNumSectors = numSectors;
     cdromReadDataSectorSize = sectorSize;
+    cdromReadCount++;
 
-    uint8_t mode = 0;
-    CDROMMSF     msf;
+    cdromReadMode    = 0;
+    cdromReadRetries = 0;
+    cdromReadLBA     = lba;
+    cdromReadFailed  = false;
 
     if (sectorSize == 2340)
-        mode |= CDROM_MODE_SIZE_2340 ;
+        cdromReadMode |= CDROM_MODE_SIZE_2340 ;
     if (doubleSpeed)
-        mode |= CDROM_MODE_SPEED_2X;
+        cdromReadMode |= CDROM_MODE_SPEED_2X;
 
-    cdrom_convertLBAToMSF(&msf, lba);
-    printf("LBA Set: %d (%02x:%02x:%02x), issue setmode\n", lba, msf.minute, msf.second, msf.frame);
-    issueCDROMCommand(CDROM_CMD_SETMODE, &mode, sizeof(mode));
-    waitForINT3();
-    printf("Issue SETLOC\n");
-    issueCDROMCommand(CDROM_CMD_SETLOC, (const uint8_t *)&msf, sizeof(msf));
-    waitForINT3();
-    printf("Issue CDREAD\n");
-    issueCDROMCommand(CDROM_CMD_READ_N, NULL, 0);
-    waitForINT3();
-    if ( !waitingForInt1 ) printf(" what's going on!?\n");
+    cdrom_convertLBAToMSF(&cdromReadMSF, lba);
+
+    // Commands issued just before the read (e.g. Picostation test commands)
+    // may not have been acknowledged yet, in which case their acknowledge
+    // kicks off the read instead.
+    bool reenableInterrupts = disableInterrupts();
+
+    if (waitingForInt3 && waitingForInt5)
+        cdromReadState = READ_STATE_WAIT;
+    else
+        _issueSetmode();
+
+    if (reenableInterrupts)
+        enableInterrupts();
 
     if (wait)
-    {
-        while (waitingForInt1)
-        {
-            // busy wait
-            delayMicroseconds(200);
-        }
-    }
-    printf("Finish read\n");
+        waitForCDROMRead();
+}
+
+void startCDROMRead(uint32_t lba, void *ptr, size_t numSectors, size_t sectorSize, bool doubleSpeed, bool wait)
+{
+    // Don't pull the destination buffer from under a read started in the
+    // background.
+    waitForCDROMRead();
+
+    cdromSectorCallback = NULL;
+    cdromSlotsEnd       = NULL;
+    _startRead(lba, ptr, numSectors, sectorSize, doubleSpeed, wait);
+}
+
+void startCDROMStreamRead(uint32_t lba, void *slots, size_t numSlots, size_t numSectors, bool doubleSpeed, CDROMSectorCallback callback)
+{
+    waitForCDROMRead();
+
+    cdromSectorCallback = callback;
+    cdromSlotsStart     = slots;
+    cdromSlotsEnd       = (void *) ((uintptr_t) slots + numSlots * 2048);
+    _startRead(lba, slots, numSectors, 2048, doubleSpeed, false);
+}
+
+void cancelCDROMRead(void){
+    bool reenableInterrupts = disableInterrupts();
+    bool pending            = (cdromReadDataNumSectors > 0);
+
+    cdromReadDataNumSectors = 0;
+    cdromReadState          = READ_STATE_IDLE;
+    if (reenableInterrupts)
+        enableInterrupts();
+
+    // A sector may still be on its way to the buffer.
+    while (DMA_CHCR(DMA_CDROM) & DMA_CHCR_ENABLE)
+        __asm__ volatile("");
+
+    if (pending)
+        issueCDROMCommand(CDROM_CMD_PAUSE, NULL, 0);
 }
 
 // Data is ready to be read from the CDROM via DMA.
 // This will read the data into cdromReadDataPtr.
 // It will also pause the CDROM drive.
-
-#include <stdio.h>
 void cdromINT1(void){
+    void *sector = cdromReadDataPtr;
+
+    // Data sectors can also show up while XA audio is playing, or before the
+    // current read has been started, with no read to put them into. Leave them
+    // in the drive's buffer.
+    if (!cdromReadDataNumSectors || (cdromReadState != READ_STATE_DATA))
+        return;
+
     DMA_MADR(DMA_CDROM) = (uint32_t) cdromReadDataPtr;
     DMA_BCR(DMA_CDROM)  = cdromReadDataSectorSize / 4;
     DMA_CHCR(DMA_CDROM) = DMA_CHCR_ENABLE | DMA_CHCR_TRIGGER;
@@ -220,9 +371,22 @@ void cdromINT1(void){
     cdromReadDataPtr = (void *) (
         (uintptr_t) cdromReadDataPtr + cdromReadDataSectorSize
     );
+    if (cdromReadDataPtr == cdromSlotsEnd)
+        cdromReadDataPtr = cdromSlotsStart;
+    cdromReadLBA++;
     if ((--cdromReadDataNumSectors) <= 0){
+        cdromReadState = READ_STATE_IDLE;
         issueCDROMCommand(CDROM_CMD_PAUSE , NULL, 0);
     }
+
+    // The transfer only takes a few microseconds, so it is quicker to wait for
+    // it here than to defer the callback.
+    if (cdromSectorCallback){
+        while (DMA_CHCR(DMA_CDROM) & DMA_CHCR_ENABLE)
+            __asm__ volatile("");
+
+        cdromSectorCallback(sector);
+    }
         
     atomic_signal_fence(memory_order_release);
     waitingForInt1 = false;
@@ -240,7 +404,7 @@ void cdromINT2(void){
 void cdromINT3(void){
     cdromStatus = cdromResponse[0];
     waitingForInt3 = false;
-    
+    _advanceRead(false);
     return;
 }
 
@@ -253,6 +417,7 @@ void cdromINT4(void){
 // This is the "Error" interrupt.
 void cdromINT5(void){
     waitingForInt5 = false;
+    _advanceRead(true);
     return;
 }
 
@@ -261,14 +426,8 @@ size_t file_load(const char *name, void *sectorBuffer){
 	
 	
 	modelLba = getLbaToFile(name);
-	if(!modelLba){
-		printf("File not found\n");
-
+	if(!modelLba)
 		return 1;
-	} else {
-	printf("found file\n");
-	printf("LBA: %d", modelLba);
-	}
 
 	startCDROMRead(
 		modelLba,
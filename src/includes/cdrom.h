@@ -21,6 +21,10 @@ extern uint8_t cdromStatus;
 
 extern uint8_t cdromLastReadPurpose;
 
+// Incremented whenever a read is started, so that background users of the
+// drive (see xa.h) can tell whether it was taken over.
+extern volatile uint32_t cdromReadCount;
+
 
 #define toBCD(i) (((i) / 10 * 16) | ((i) % 10))
 #define CDROM_COMMAND_ADDRESS 0x1F801801
@@ -36,8 +40,38 @@ void waitForINT1();
 void waitForINT3();
 
 
+/// @brief Start reading sectors into a buffer. The commands needed to start the
+/// read are issued from the IRQ handler as the drive acknowledges them, so
+/// unless wait is set this returns immediately.
+/// @param wait Block until all sectors have been transferred
 void startCDROMRead(uint32_t lba, void *ptr, size_t numSectors, size_t sectorSize, bool doubleSpeed, bool wait);
 
+typedef void (*CDROMSectorCallback)(void *sector);
+
+/// @brief Start a background read of 2048-byte sectors into a ring of
+/// sector-sized slots. The callback is invoked from the IRQ handler as soon as
+/// each sector has been transferred, and must be done with the slot before
+/// numSlots more sectors have been read.
+void startCDROMStreamRead(uint32_t lba, void *slots, size_t numSlots, size_t numSectors, bool doubleSpeed, CDROMSectorCallback callback);
+
+/// @brief Return whether the last read has been fully transferred to RAM.
+/// Background users of the drive (covers, music) must only start a read once
+/// this returns true.
+bool isCDROMReadDone(void);
+
+/// @brief Return whether the last read was given up on after the drive kept
+/// reporting errors. The read is then done, but its buffer was only partially
+/// filled.
+bool isCDROMReadFailed(void);
+
+/// @brief Block until the last read has been fully transferred to RAM.
+void waitForCDROMRead(void);
+
+/// @brief Abandon the last read, pausing the drive and dropping any sectors
+/// not yet transferred. Once this returns the read's buffer is no longer
+/// written to and can be reused.
+void cancelCDROMRead(void);
+
 bool readDiscName(char *output);
 
 void cdromINT1(void);
@@ -4,8 +4,9 @@
 
 #include "ps1/cdrom.h"
 #include "cdrom.h"
-//#include "spu.h"
+#include "spu.h"
 #include "stream.h"
+#include "sio.h"
 
 #include "ps1/registers.h"
 #include "system.h"
@@ -75,8 +76,18 @@ void interruptHandlerFunction(void *arg){
     if(acknowledgeInterrupt(IRQ_CDROM)){
         handleCDROMIRQ();
     }
+    if(acknowledgeInterrupt(IRQ_DMA)){
+        handleSPUDMAInterrupt();
+    }
     if(acknowledgeInterrupt(IRQ_SPU)){
-        stream_handleInterrupt(&stream);
+        stream_handleSPUInterrupt();
+    }
+    // The SIO0 handler may cancel a pending timeout, so it must run first.
+    if(acknowledgeInterrupt(IRQ_SIO0)){
+        sio_handleInterrupt();
+    }
+    if(acknowledgeInterrupt(IRQ_TIMER2)){
+        sio_handleTimerInterrupt();
     }
 }
 
@@ -86,7 +97,8 @@ void initIRQ(void){
     // You can also pass an argument to this handler.
     setInterruptHandler(interruptHandlerFunction, NULL);
     // The IRQ mask specifies which interrupt sources are actually allowed to raise an interrupt.
-    IRQ_MASK = (1 << IRQ_VSYNC) | (1 << IRQ_CDROM) | (1 << IRQ_SPU);
+    IRQ_MASK = (1 << IRQ_VSYNC) | (1 << IRQ_CDROM) | (1 << IRQ_DMA) | (1 << IRQ_SPU)
+        | (1 << IRQ_SIO0) | (1 << IRQ_TIMER2);
     enableInterrupts();
 }
 
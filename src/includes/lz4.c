@@ -0,0 +1,74 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+// Read an LZ4 variable length field: 15 in the token means more length bytes
+// follow, each adding up to 255.
+static inline size_t _readLength(const uint8_t **input, size_t length) {
+	if (length != 15)
+		return length;
+
+	uint8_t value;
+
+	do {
+		value   = *((*input)++);
+		length += value;
+	} while (value == 255);
+
+	return length;
+}
+
+size_t lz4_decompress(void *output, const void *input) {
+	const uint8_t *src    = (const uint8_t *) input + LZ4_HEADER_SIZE;
+	uint8_t       *dst    = (uint8_t *) output;
+	uint8_t       *dstEnd = dst + lz4_getDecompressedSize(input);
+
+	// The block is terminated by a sequence that only contains literals, so the
+	// output length is the only bound needed.
+	for (;;) {
+		uint8_t token  = *(src++);
+		size_t  length = _readLength(&src, token >> 4);
+
+		// Literal runs are copied with memcpy(), which uses unaligned
+		// lwl/lwr/swl/swr sequences for anything longer than a few bytes.
+		memcpy(dst, src, length);
+		src += length;
+		dst += length;
+
+		if (dst >= dstEnd)
+			break;
+
+		size_t        offset = src[0] | (src[1] << 8);
+		const uint8_t *match = dst - offset;
+
+		src   += 2;
+		length = _readLength(&src, token & 15) + 4;
+
+		// Matches may overlap the bytes they produce (e.g. an offset of 1
+		// repeats the last byte), in which case they must be copied one byte
+		// at a time. Longer offsets can use memcpy() in offset-sized steps.
+		if (offset >= length) {
+			memcpy(dst, match, length);
+			dst += length;
+		} else if (offset >= 4) {
+			uint8_t *end = dst + length;
+
+			while (dst < end) {
+				size_t chunk = end - dst;
+
+				if (chunk > offset)
+					chunk = offset;
+
+				memcpy(dst, match, chunk);
+				dst   += chunk;
+				match += chunk;
+			}
+		} else {
+			for (; length; length--)
+				*(dst++) = *(match++);
+		}
+	}
+
+	return dst - (uint8_t *) output;
+}
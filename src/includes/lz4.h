@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ4 decompressor */
+
+// Compressed data as generated by compressData.py: a 32-bit uncompressed length
+// followed by a raw LZ4 block.
+#define LZ4_HEADER_SIZE 4
+
+/// @brief Return the uncompressed length of the given compressed data.
+static inline size_t lz4_getDecompressedSize(const void *input) {
+	const uint8_t *ptr = (const uint8_t *) input;
+
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (ptr[3] << 24);
+}
+
+/// @brief Unpack compressed data into the given buffer, which must be at least
+/// lz4_getDecompressedSize() bytes long.
+/// @return Number of bytes written to the output buffer.
+size_t lz4_decompress(void *output, const void *input);
@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mdec.h"
+#include "cdrom.h"
+#include "system.h"
+#include "../gpu.h"
+#include "ps1/registers.h"
+
+static const int _DMA_CHUNK_SIZE = 32;
+static const int _RESET_TIMEOUT  = 100000;
+
+// Default quantization table (MPEG-1 intra matrix, with a DC step of 2) in
+// zigzag order. The same table is used for luma and chroma.
+static const uint8_t _quantTable[64] __attribute__((aligned(4))) = {
+	 2, 16, 16, 19, 16, 19, 22, 22,
+	22, 22, 22, 22, 26, 24, 26, 27,
+	27, 27, 26, 26, 26, 26, 27, 27,
+	27, 29, 29, 29, 34, 34, 34, 29,
+	29, 29, 27, 27, 29, 29, 32, 32,
+	34, 34, 37, 38, 37, 35, 35, 34,
+	35, 38, 38, 40, 40, 40, 48, 48,
+	46, 46, 56, 56, 58, 69, 69, 83
+};
+
+// Scaled DCT basis, row u = c(u) * cos((2x + 1) * u * pi / 16) * 0x8000.
+static const int16_t _idctTable[64] = {
+	 23170,  23170,  23170,  23170,  23170,  23170,  23170,  23170,
+	 32138,  27245,  18204,   6392,  -6392, -18204, -27245, -32138,
+	 30273,  12539, -12539, -30273, -30273, -12539,  12539,  30273,
+	 27245,  -6392, -32138, -18204,  18204,  32138,   6392, -27245,
+	 23170, -23170, -23170,  23170,  23170, -23170, -23170,  23170,
+	 18204, -32138,   6392,  27245, -27245,  -6392,  32138, -18204,
+	 12539, -30273,  30273, -12539, -12539,  30273, -30273,  12539,
+	  6392, -18204,  27245, -32138,  32138, -27245,  18204,  -6392
+};
+
+// Image whose read is currently being counted by _sectorCallback().
+static MDECImage *_readImage;
+
+// Two column buffers, so that one can be uploaded to VRAM while the MDEC is
+// writing the next column into the other.
+static uint32_t _columnBuffers[2][MDEC_COLUMN_WIDTH * MDEC_MAX_IMAGE_HEIGHT / 2];
+
+static void _sendWords(const void *data, size_t length) {
+	const uint32_t *ptr = (const uint32_t *) data;
+
+	for (length /= 4; length; length--) {
+		while (MDEC1 & MDEC_STAT_DATA_FULL)
+			__asm__ volatile("");
+
+		MDEC0 = *(ptr++);
+	}
+}
+
+void initMDEC(void) {
+	DMA_DPCR |= 0
+		| (DMA_DPCR_ENABLE << (DMA_MDEC_IN  * 4))
+		| (DMA_DPCR_ENABLE << (DMA_MDEC_OUT * 4));
+
+	MDEC1 = MDEC_CTRL_RESET;
+	MDEC1 = MDEC_CTRL_DMA_OUT | MDEC_CTRL_DMA_IN;
+
+	// The quantization table command takes 64 bytes of luma coefficients,
+	// followed by 64 bytes of chroma coefficients if the chroma flag is set.
+	MDEC0 = MDEC_CMD_OP_SET_QUANT_TABLE | MDEC_CMD_USE_CHROMA;
+	_sendWords(_quantTable, sizeof(_quantTable));
+	_sendWords(_quantTable, sizeof(_quantTable));
+
+	MDEC0 = MDEC_CMD_OP_SET_IDCT_TABLE;
+	_sendWords(_idctTable, sizeof(_idctTable));
+
+	for (int timeout = _RESET_TIMEOUT; timeout > 0; timeout -= 10) {
+		if (!(MDEC1 & MDEC_STAT_BUSY))
+			break;
+
+		delayMicroseconds(10);
+	}
+}
+
+static const MDECImageHeader *_getHeader(const MDECImage *image) {
+	return (const MDECImageHeader *) image->data;
+}
+
+// Called from the CD-ROM IRQ handler for each sector of the image's read.
+// Sectors are counted per image rather than derived from the drive's global
+// read state, which belongs to whichever read was started last.
+static void _sectorCallback(void *sector) {
+	(void) sector;
+
+	_readImage->readSectors++;
+}
+
+static bool _isReadOwned(const MDECImage *image) {
+	return (cdromReadCount == image->readCount);
+}
+
+// Return how many bytes of the image have been read from the CD so far.
+static size_t _getAvailableLength(const MDECImage *image) {
+	if (!image->numSectors)
+		return (size_t) -1;
+
+	return image->readSectors * 2048;
+}
+
+// Give up on the image. The read is stopped if it is still running, and any
+// column being decoded is let through, so that the buffer can be freed as soon
+// as this returns.
+static void _fail(MDECImage *image) {
+	if (
+		image->numSectors &&
+		(image->readSectors < image->numSectors) &&
+		_isReadOwned(image)
+	)
+		cancelCDROMRead();
+
+	while (DMA_CHCR(DMA_MDEC_OUT) & DMA_CHCR_ENABLE)
+		__asm__ volatile("");
+
+	image->decodeBusy = false;
+	image->state      = MDEC_IMAGE_ERROR;
+}
+
+static void _startDecode(MDECImage *image, int column) {
+	const MDECImageHeader *header = _getHeader(image);
+
+	uint32_t offset    = header->columnOffsets[column];
+	size_t   inLength  = header->columnOffsets[column + 1] - offset;
+	size_t   outLength = (MDEC_COLUMN_WIDTH * header->height) / 2;
+
+	MDEC0 = 0
+		| MDEC_CMD_OP_DECODE
+		| MDEC_CMD_FORMAT_16BPP
+		| (inLength & MDEC_CMD_LENGTH_BITMASK);
+
+	DMA_MADR(DMA_MDEC_IN) =
+		(uint32_t) &image->data[MDEC_IMAGE_DATA_OFFSET + offset * 4];
+	DMA_BCR (DMA_MDEC_IN) =
+		_DMA_CHUNK_SIZE | ((inLength / _DMA_CHUNK_SIZE) << 16);
+	DMA_CHCR(DMA_MDEC_IN) = DMA_CHCR_WRITE | DMA_CHCR_MODE_SLICE | DMA_CHCR_ENABLE;
+
+	DMA_MADR(DMA_MDEC_OUT) = (uint32_t) _columnBuffers[column % 2];
+	DMA_BCR (DMA_MDEC_OUT) =
+		_DMA_CHUNK_SIZE | ((outLength / _DMA_CHUNK_SIZE) << 16);
+	DMA_CHCR(DMA_MDEC_OUT) = DMA_CHCR_READ | DMA_CHCR_MODE_SLICE | DMA_CHCR_ENABLE;
+
+	image->decodeBusy = true;
+}
+
+static bool _validateHeader(MDECImage *image) {
+	const MDECImageHeader *header = _getHeader(image);
+
+	if (
+		(header->magic != MDEC_IMAGE_MAGIC) ||
+		(header->height > MDEC_MAX_IMAGE_HEIGHT) ||
+		(header->height % 16) ||
+		(header->numColumns != (header->width / MDEC_COLUMN_WIDTH)) ||
+		(header->width > image->maxWidth) ||
+		(header->height > image->maxHeight)
+	) {
+		_fail(image);
+		return false;
+	}
+
+	return true;
+}
+
+bool mdec_startImage(
+	MDECImage *image, const void *data, int x, int y, int maxWidth,
+	int maxHeight
+) {
+	image->data          = (const uint8_t *) data;
+	image->numSectors    = 0;
+	image->x             = x;
+	image->y             = y;
+	image->maxWidth      = maxWidth;
+	image->maxHeight     = maxHeight;
+	image->readSectors   = 0;
+	image->decodeColumn  = 0;
+	image->uploadColumn  = 0;
+	image->pendingUpload = -1;
+	image->decodeBusy    = false;
+	image->state         = MDEC_IMAGE_BUSY;
+
+	return _validateHeader(image);
+}
+
+bool mdec_startImageFromCD(
+	MDECImage *image, uint32_t lba, size_t numSectors, void *buffer, int x,
+	int y, int maxWidth, int maxHeight
+) {
+	image->data          = (const uint8_t *) buffer;
+	image->numSectors    = numSectors;
+	image->x             = x;
+	image->y             = y;
+	image->maxWidth      = maxWidth;
+	image->maxHeight     = maxHeight;
+	image->readSectors   = 0;
+	image->decodeColumn  = 0;
+	image->uploadColumn  = 0;
+	image->pendingUpload = -1;
+	image->decodeBusy    = false;
+	image->state         = MDEC_IMAGE_BUSY;
+
+	// The header is validated by mdec_update() once the first sector is in.
+	// The buffer is passed as a ring with one slot per sector, so that it is
+	// filled in order without ever wrapping around.
+	waitForCDROMRead();
+
+	_readImage = image;
+	startCDROMStreamRead(
+		lba, buffer, numSectors, numSectors, true, &_sectorCallback
+	);
+	image->readCount = cdromReadCount;
+	return true;
+}
+
+MDECImageState mdec_update(MDECImage *image) {
+	if (image->state != MDEC_IMAGE_BUSY)
+		return image->state;
+
+	size_t available = _getAvailableLength(image);
+
+	// If the drive is done (or has moved on to another read) without
+	// delivering every sector, the read failed or was cancelled and the rest
+	// of the image is never going to arrive.
+	if (
+		image->numSectors &&
+		(image->readSectors < image->numSectors) &&
+		(!_isReadOwned(image) || isCDROMReadDone())
+	) {
+		_fail(image);
+		return image->state;
+	}
+	if (available < MDEC_IMAGE_DATA_OFFSET)
+		return image->state;
+	if (!image->decodeColumn && !image->decodeBusy && image->numSectors) {
+		if (!_validateHeader(image))
+			return image->state;
+	}
+
+	const MDECImageHeader *header = _getHeader(image);
+	bool                  gpuIdle = !(DMA_CHCR(DMA_GPU) & DMA_CHCR_ENABLE);
+
+	// Stage 1: once the MDEC has written out a whole column, it can be queued
+	// for upload.
+	if (image->decodeBusy && !(DMA_CHCR(DMA_MDEC_OUT) & DMA_CHCR_ENABLE)) {
+		image->decodeBusy = false;
+		image->decodeColumn++;
+	}
+
+	// Stage 2: upload the oldest decoded column while the MDEC works on the
+	// next one.
+	if (gpuIdle)
+		image->pendingUpload = -1;
+
+	if (
+		gpuIdle &&
+		(image->uploadColumn < image->decodeColumn)
+	) {
+		int column = image->uploadColumn++;
+
+		sendVRAMData(
+			_columnBuffers[column % 2],
+			image->x + column * MDEC_COLUMN_WIDTH, image->y,
+			MDEC_COLUMN_WIDTH, header->height
+		);
+		image->pendingUpload = column;
+	}
+
+	// Stage 3: start decoding the next column as soon as its data has been
+	// read and its buffer is no longer being uploaded.
+	int column = image->decodeColumn;
+
+	if (
+		!image->decodeBusy &&
+		(column < header->numColumns) &&
+		(column < (image->uploadColumn + 2)) &&
+		(image->pendingUpload != (column - 2)) &&
+		(available >= (
+			MDEC_IMAGE_DATA_OFFSET + header->columnOffsets[column + 1] * 4
+		))
+	)
+		_startDecode(image, column);
+
+	if (image->uploadColumn >= header->numColumns)
+		image->state = MDEC_IMAGE_DONE;
+
+	return image->state;
+}
+
+bool mdec_loadImage(
+	uint32_t lba, size_t numSectors, void *buffer, int x, int y, int maxWidth,
+	int maxHeight
+) {
+	MDECImage image;
+
+	mdec_startImageFromCD(
+		&image, lba, numSectors, buffer, x, y, maxWidth, maxHeight
+	);
+
+	while (mdec_update(&image) == MDEC_IMAGE_BUSY)
+		__asm__ volatile("");
+
+	waitForDMADone();
+	return (image.state == MDEC_IMAGE_DONE);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* MDEC image format */
+
+// Images are stored as a 2048-byte header sector followed by the run-length
+// coded macroblock stream the MDEC consumes directly (no CPU-side Huffman
+// decoding). Macroblocks are grouped into 16-pixel wide columns, each one
+// padded to a multiple of 32 words so it can be fed to the MDEC with a single
+// DMA transfer. See ps1-bare-metal/tools/convertMDEC.py.
+#define MDEC_IMAGE_MAGIC       0x3149444d // "MDI1"
+#define MDEC_IMAGE_DATA_OFFSET 2048
+#define MDEC_MAX_IMAGE_HEIGHT  256
+#define MDEC_COLUMN_WIDTH      16
+
+typedef struct {
+	uint32_t magic;
+	uint16_t width, height;
+	uint16_t numColumns, _reserved;
+
+	// numColumns + 1 offsets, in 32-bit words from MDEC_IMAGE_DATA_OFFSET.
+	uint32_t columnOffsets[];
+} MDECImageHeader;
+
+typedef enum {
+	MDEC_IMAGE_IDLE  = 0,
+	MDEC_IMAGE_BUSY  = 1,
+	MDEC_IMAGE_DONE  = 2,
+	MDEC_IMAGE_ERROR = 3
+} MDECImageState;
+
+/* MDEC Image Class */
+
+typedef struct {
+	const uint8_t *data;
+	size_t        numSectors; // Zero if the whole image is already in RAM
+	int           x, y, maxWidth, maxHeight;
+
+	// Sectors of this image's own read delivered so far, and the value of
+	// cdromReadCount the read was started with.
+	volatile size_t readSectors;
+	uint32_t        readCount;
+
+	int16_t  decodeColumn, uploadColumn, pendingUpload;
+	bool     decodeBusy;
+	uint8_t  state;
+} MDECImage;
+
+/// @brief Reset the MDEC, enable its DMA channels and load the default
+/// quantization and IDCT tables.
+void initMDEC(void);
+
+/// @brief Prepare an image that is already in RAM for decoding into VRAM at
+/// the given coordinates. Images larger than maxWidth x maxHeight are rejected
+/// rather than written past the area set aside for them.
+bool mdec_startImage(
+	MDECImage *image, const void *data, int x, int y, int maxWidth,
+	int maxHeight
+);
+
+/// @brief Start an asynchronous CD-ROM read of an image into the given
+/// buffer. Columns are decoded as soon as the sectors holding them arrive. If
+/// the read fails or is cancelled before the whole image is in, mdec_update()
+/// returns MDEC_IMAGE_ERROR. The buffer must be kept until mdec_update() no
+/// longer returns MDEC_IMAGE_BUSY.
+bool mdec_startImageFromCD(
+	MDECImage *image, uint32_t lba, size_t numSectors, void *buffer, int x,
+	int y, int maxWidth, int maxHeight
+);
+
+/// @brief Move the image through the read, decode and upload stages without
+/// waiting on any of them. Call repeatedly until it no longer returns
+/// MDEC_IMAGE_BUSY.
+MDECImageState mdec_update(MDECImage *image);
+
+/// @brief Blocking wrapper around mdec_startImageFromCD() and mdec_update().
+/// The three stages still overlap, the caller just doesn't get control back
+/// until the whole image is in VRAM.
+bool mdec_loadImage(
+	uint32_t lba, size_t numSectors, void *buffer, int x, int y, int maxWidth,
+	int maxHeight
+);
@@ -5,15 +5,22 @@
 #include "spu.h"
 #include "ps1/registers.h"
 #include "system.h"
-#include "cdrom.c"
+#include "cdrom.h"
 
 /* Basic API */
 
 static const int _DMA_CHUNK_SIZE = 4;
-static const int _DMA_TIMEOUT    = 100000;
 static const int _STATUS_TIMEOUT = 10000;
 
-uint32_t spuAllocPtr = 0x1010; // Pointer to the next free space in SPU ram
+// Voices handed out by allocChannel() are assumed busy until a scan finds
+// their envelope has gone silent, which is only done once no voice is known to
+// be free. (NUM_CHANNELS can't be used as an array size in C.)
+#define _NUM_CHANNELS 24
+
+static ChannelMask _busyChannels, _reservedChannels;
+static uint8_t     _channelPriority[_NUM_CHANNELS];
+static uint32_t    _channelAge[_NUM_CHANNELS];
+static uint32_t    _allocCounter;
 
 static bool _waitForStatus(uint16_t mask, uint16_t value){
     for(int timeout = _STATUS_TIMEOUT; timeout > 0; timeout -= 10) {
@@ -71,47 +78,119 @@ void initSPU(void){
     delayMicroseconds(100);
 
     SPU_CTRL = SPU_CTRL_UNMUTE | SPU_CTRL_ENABLE;
-    stopChannel(ALL_CHANNELS);
+    _reservedChannels = 0;
+    stopChannels(ALL_CHANNELS);
 
-    // Enable the SPU's DMA channel
+    // Enable the SPU's DMA channel and its completion IRQ, which drives the
+    // transfer queue.
     DMA_DPCR |= DMA_DPCR_ENABLE << (DMA_SPU * 4);
+    DMA_DICR  = (DMA_DICR & (DMA_DICR_CH_MODE_BITMASK | DMA_DICR_CH_ENABLE_BITMASK | DMA_DICR_IRQ_ENABLE))
+        | DMA_DICR_CH_ENABLE(DMA_SPU);
 
     setMasterVolume(MAX_VOLUME, 0);
+
+    initSPURAM();
 }
 
-Channel getFreeChannel(void) {
-    bool reenableInterrupts = disableInterrupts();
+/* Voice Allocator */
+
+static Channel _findFreeChannel(void){
+    ChannelMask free = ALL_CHANNELS & ~(_busyChannels | _reservedChannels);
+
+    if(!free){
+        ChannelMask busy = _busyChannels & ~_reservedChannels;
+
+        for(Channel ch = 0; busy; ch++, busy >>= 1){
+            if((busy & 1) && !SPU_CH_ADSR_VOL(ch)){
+                _busyChannels &= ~(1 << ch);
+            }
+        }
+
+        free = ALL_CHANNELS & ~(_busyChannels | _reservedChannels);
+    }
+    if(!free){
+        return -1;
+    }
+
+    return __builtin_ctz(free);
+}
+
+static Channel _findVictimChannel(SoundPriority priority){
+    Channel  victim = -1;
+    uint16_t victimVolume = 0;
 
     for(Channel ch = 0; ch < NUM_CHANNELS; ch++){
-        if(!SPU_CH_ADSR_VOL(ch)){
-            if(reenableInterrupts){
-                enableInterrupts();
+        if((_reservedChannels & (1 << ch)) || (_channelPriority[ch] > priority)){
+            continue;
+        }
+
+        uint16_t volume = SPU_CH_ADSR_VOL(ch);
+
+        if(victim >= 0){
+            if(_channelPriority[ch] > _channelPriority[victim]){
+                continue;
+            }
+            if(_channelPriority[ch] == _channelPriority[victim]){
+                if(volume > victimVolume){
+                    continue;
+                }
+                if(
+                    (volume == victimVolume) &&
+                    ((_allocCounter - _channelAge[ch]) <= (_allocCounter - _channelAge[victim]))
+                ){
+                    continue;
+                }
             }
-            return ch;
         }
+
+        victim       = ch;
+        victimVolume = volume;
+    }
+
+    return victim;
+}
+
+Channel allocChannel(SoundPriority priority){
+    bool reenableInterrupts = disableInterrupts();
+
+    Channel ch = _findFreeChannel();
+
+    if(ch < 0){
+        ch = _findVictimChannel(priority);
+    }
+    if(ch >= 0){
+        _busyChannels         |= 1 << ch;
+        _channelPriority[ch]   = priority;
+        _channelAge[ch]        = _allocCounter++;
     }
+
     if(reenableInterrupts){
         enableInterrupts();
     }
-    return -1;
+    return ch;
 }
 
-ChannelMask getFreeChannels(int count){
+ChannelMask reserveChannels(int count){
     bool reenableInterrupts = disableInterrupts();
 
     ChannelMask mask = 0;
 
-    for(Channel ch = 0; ch < NUM_CHANNELS; ch++){
-        if(SPU_CH_ADSR_VOL(ch)){
-            continue;
-        }
-
-        mask |= 1 << ch;
-        count--;
+    for(; count > 0; count--){
+        Channel ch = _findFreeChannel();
 
-        if(!count){
+        if(ch < 0){
+            ch = _findVictimChannel(SOUND_PRIORITY_HIGH);
+        }
+        if(ch < 0){
+            // Give back whatever was taken so far.
+            _reservedChannels &= ~mask;
+            mask = 0;
             break;
         }
+
+        mask              |= 1 << ch;
+        _reservedChannels |= 1 << ch;
+        _busyChannels     &= ~(1 << ch);
     }
 
     if(reenableInterrupts){
@@ -120,9 +199,23 @@ ChannelMask getFreeChannels(int count){
     return mask;
 }
 
+void releaseChannels(ChannelMask mask){
+    bool reenableInterrupts = disableInterrupts();
+
+    _reservedChannels &= ~mask;
+
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
+}
+
 void stopChannels(ChannelMask mask){
     mask &= ALL_CHANNELS;
 
+    // Stopped voices keep looping the dummy block, so their envelope never
+    // goes silent and they have to be marked free here.
+    _busyChannels &= ~mask;
+
     SPU_FLAG_OFF1 = mask & 0xffff;
     SPU_FLAG_OFF2 = mask >> 16;
 
@@ -141,93 +234,342 @@ void stopChannels(ChannelMask mask){
     SPU_FLAG_ON2 = mask >> 16;
 }
 
-size_t upload(uint32_t offset, const void *data, size_t length, bool wait){
-    length /= 4;
-    
-    // (Assert data is aligned uint32_t)
-
-    length = (length + _DMA_CHUNK_SIZE - 1) / _DMA_CHUNK_SIZE;
-
-    if(!waitForDMATransfer(DMA_SPU, _DMA_TIMEOUT)){
-        return 0;
-    }
-
+/* Transfer Queue */
+
+// Transfers are started one after another by the DMA completion IRQ. The queue
+// is also advanced by polling whenever a caller has to wait on it, so it keeps
+// moving when interrupts are disabled (e.g. when a stream is fed from the
+// CD-ROM IRQ handler).
+typedef struct SPUTransfer{
+    uint32_t      offset;
+    void          *data;
+    size_t        length; // In DMA chunks
+    bool          write;
+    volatile bool *done;
+} SPUTransfer;
+
+static SPUTransfer _queue[SPU_QUEUE_LENGTH];
+static int         _queueHead, _queueCount;
+static bool        _transferRunning;
+
+static void _startTransfer(const SPUTransfer *transfer){
     uint16_t ctrlReg = SPU_CTRL & ~SPU_CTRL_XFER_BITMASK;
+    uint16_t mode    = transfer->write ? SPU_CTRL_XFER_DMA_WRITE : SPU_CTRL_XFER_DMA_READ;
 
     SPU_CTRL = ctrlReg;
     _waitForStatus(SPU_CTRL_XFER_BITMASK, 0);
 
     SPU_DMA_CTRL = 4;
-    SPU_ADDR     = offset / 8;
-    SPU_CTRL     = ctrlReg | SPU_CTRL_XFER_DMA_WRITE;
-    _waitForStatus(SPU_CTRL_XFER_BITMASK, SPU_CTRL_XFER_DMA_WRITE);
+    SPU_ADDR     = transfer->offset / 8;
+    SPU_CTRL     = ctrlReg | mode;
+    _waitForStatus(SPU_CTRL_XFER_BITMASK, mode);
 
-    DMA_MADR(DMA_SPU) = (uint32_t)(data);
-    DMA_BCR (DMA_SPU) = concat4_16(_DMA_CHUNK_SIZE, length);
+    DMA_MADR(DMA_SPU) = (uint32_t)(transfer->data);
+    DMA_BCR (DMA_SPU) = concat4_16(_DMA_CHUNK_SIZE, transfer->length);
     DMA_CHCR(DMA_SPU) = 0
-        | DMA_CHCR_WRITE
+        | (transfer->write ? DMA_CHCR_WRITE : DMA_CHCR_READ)
         | DMA_CHCR_MODE_SLICE
         | DMA_CHCR_ENABLE;
-    
-    if(wait){
-        waitForDMATransfer(DMA_SPU, _DMA_TIMEOUT);
+}
+
+// Retire the running transfer if it has finished and start the next one. Must
+// be called with interrupts disabled.
+static void _advanceQueue(void){
+    if(_transferRunning){
+        if(DMA_CHCR(DMA_SPU) & DMA_CHCR_ENABLE){
+            return;
+        }
+
+        SPUTransfer *transfer = &_queue[_queueHead];
+
+        if(transfer->done){
+            *(transfer->done) = true;
+        }
+
+        _queueHead       = (_queueHead + 1) % SPU_QUEUE_LENGTH;
+        _queueCount--;
+        _transferRunning = false;
     }
 
-    return length * _DMA_CHUNK_SIZE * 4;
+    if(_queueCount){
+        _startTransfer(&_queue[_queueHead]);
+        _transferRunning = true;
+    }
 }
 
-size_t download(uint32_t offset, void * data, size_t length, bool wait){
-     length /= 4;
-    
+static size_t _queueTransfer(uint32_t offset, void *data, size_t length, bool write, volatile bool *done){
     // (Assert data is aligned uint32_t)
 
-    length = (length + _DMA_CHUNK_SIZE - 1) / _DMA_CHUNK_SIZE;
+    length = (length / 4 + _DMA_CHUNK_SIZE - 1) / _DMA_CHUNK_SIZE;
 
-    if(!waitForDMATransfer(DMA_SPU, _DMA_TIMEOUT)){
-        return 0;
+    if(done){
+        *done = false;
     }
 
-    uint16_t ctrlReg = SPU_CTRL & ~SPU_CTRL_XFER_BITMASK;
+    bool reenableInterrupts = disableInterrupts();
 
-    SPU_CTRL = ctrlReg;
-    _waitForStatus(SPU_CTRL_XFER_BITMASK, 0);
+    while(_queueCount == SPU_QUEUE_LENGTH){
+        _advanceQueue();
+    }
 
-    SPU_DMA_CTRL = 4;
-    SPU_ADDR     = offset / 8;
-    SPU_CTRL     = ctrlReg | SPU_CTRL_XFER_DMA_READ;
-    _waitForStatus(SPU_CTRL_XFER_BITMASK, SPU_CTRL_XFER_DMA_READ);
+    SPUTransfer *transfer = &_queue[(_queueHead + _queueCount) % SPU_QUEUE_LENGTH];
+
+    transfer->offset = offset;
+    transfer->data   = data;
+    transfer->length = length;
+    transfer->write  = write;
+    transfer->done   = done;
+    _queueCount++;
+
+    _advanceQueue();
+
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
+    return length * _DMA_CHUNK_SIZE * 4;
+}
+
+size_t queueUpload(uint32_t offset, const void *data, size_t length, volatile bool *done){
+    return _queueTransfer(offset, (void *) data, length, true, done);
+}
+
+size_t queueDownload(uint32_t offset, void *data, size_t length, volatile bool *done){
+    return _queueTransfer(offset, data, length, false, done);
+}
+
+void waitForSPUTransfer(volatile bool *done){
+    while(!*done){
+        bool reenableInterrupts = disableInterrupts();
+
+        _advanceQueue();
+
+        if(reenableInterrupts){
+            enableInterrupts();
+        }
+    }
+}
+
+void waitForSPUQueue(void){
+    for(;;){
+        bool reenableInterrupts = disableInterrupts();
+
+        _advanceQueue();
+        bool idle = !_queueCount;
+
+        if(reenableInterrupts){
+            enableInterrupts();
+        }
+        if(idle){
+            return;
+        }
+    }
+}
+
+void handleSPUDMAInterrupt(void){
+    // Acknowledge the SPU channel's flag without clearing any other.
+    DMA_DICR = (DMA_DICR & (DMA_DICR_CH_MODE_BITMASK | DMA_DICR_CH_ENABLE_BITMASK | DMA_DICR_IRQ_ENABLE))
+        | DMA_DICR_CH_STAT(DMA_SPU);
+
+    _advanceQueue();
+}
+
+size_t upload(uint32_t offset, const void *data, size_t length, bool wait){
+    volatile bool done;
+
+    length = queueUpload(offset, data, length, wait ? &done : NULL);
 
-    DMA_MADR(DMA_SPU) = (uint32_t)(data);
-    DMA_BCR (DMA_SPU) = concat4_16(_DMA_CHUNK_SIZE, length);
-    DMA_CHCR(DMA_SPU) = 0
-        | DMA_CHCR_READ
-        | DMA_CHCR_MODE_SLICE
-        | DMA_CHCR_ENABLE;
-    
     if(wait){
-        waitForDMATransfer(DMA_SPU, _DMA_TIMEOUT);
+        waitForSPUTransfer(&done);
     }
+    return length;
+}
 
-    return length * _DMA_CHUNK_SIZE * 4;
+size_t download(uint32_t offset, void *data, size_t length, bool wait){
+    volatile bool done;
+
+    length = queueDownload(offset, data, length, wait ? &done : NULL);
+
+    if(wait){
+        waitForSPUTransfer(&done);
+    }
+    return length;
+}
+
+/* SPU RAM Allocator */
+
+// Everything between the dummy block and the reverb work area can be
+// allocated. Allocations are kept in a fixed table indexed by handle; the table
+// is small enough for linear scans to be cheaper than keeping it sorted.
+static const uint32_t _ALLOC_START = DUMMY_BLOCK_END;
+static const uint32_t _ALLOC_END   = SPU_RAM_END;
+
+typedef struct SPUAllocation{
+    uint32_t offset, length;
+    bool     used, pinned;
+} SPUAllocation;
+
+static SPUAllocation _allocations[SPU_MAX_ALLOCATIONS];
+
+void initSPURAM(void){
+    for(int i = 0; i < SPU_MAX_ALLOCATIONS; i++){
+        _allocations[i].used = false;
+    }
+}
+
+// Return the used allocation with the lowest offset at or above the given one,
+// or SPU_NO_BLOCK if there is none.
+static SPUBlock _findNext(uint32_t offset){
+    SPUBlock next = SPU_NO_BLOCK;
+
+    for(SPUBlock i = 0; i < SPU_MAX_ALLOCATIONS; i++){
+        if(!_allocations[i].used || (_allocations[i].offset < offset)){
+            continue;
+        }
+        if((next == SPU_NO_BLOCK) || (_allocations[i].offset < _allocations[next].offset)){
+            next = i;
+        }
+    }
+
+    return next;
+}
+
+SPUBlock allocSPURAM(size_t length, bool pinned){
+    length = roundup(length, SPU_RAM_ALIGN);
+
+    SPUBlock block = SPU_NO_BLOCK;
+
+    for(SPUBlock i = 0; i < SPU_MAX_ALLOCATIONS; i++){
+        if(!_allocations[i].used){
+            block = i;
+            break;
+        }
+    }
+    if((block == SPU_NO_BLOCK) || !length){
+        return SPU_NO_BLOCK;
+    }
+
+    // Walk the allocations in address order and take the first gap that fits.
+    uint32_t offset = _ALLOC_START;
+
+    for(;;){
+        SPUBlock next = _findNext(offset);
+        uint32_t end  = (next == SPU_NO_BLOCK) ? _ALLOC_END : _allocations[next].offset;
+
+        if((end - offset) >= length){
+            break;
+        }
+        if(next == SPU_NO_BLOCK){
+            return SPU_NO_BLOCK;
+        }
+
+        offset = _allocations[next].offset + _allocations[next].length;
+    }
+
+    _allocations[block].offset = offset;
+    _allocations[block].length = length;
+    _allocations[block].used   = true;
+    _allocations[block].pinned = pinned;
+    return block;
+}
+
+void freeSPURAM(SPUBlock block){
+    if((block < 0) || (block >= SPU_MAX_ALLOCATIONS)){
+        return;
+    }
+
+    _allocations[block].used = false;
+}
+
+uint32_t getSPURAMOffset(SPUBlock block){
+    if((block < 0) || (block >= SPU_MAX_ALLOCATIONS) || !_allocations[block].used){
+        return 0;
+    }
+
+    return _allocations[block].offset;
+}
+
+void getSPURAMStats(SPURAMStats *stats){
+    stats->totalBytes       = _ALLOC_END - _ALLOC_START;
+    stats->usedBytes        = 0;
+    stats->largestFreeBytes = 0;
+    stats->numBlocks        = 0;
+
+    uint32_t offset = _ALLOC_START;
+
+    for(;;){
+        SPUBlock next = _findNext(offset);
+        uint32_t end  = (next == SPU_NO_BLOCK) ? _ALLOC_END : _allocations[next].offset;
+
+        stats->largestFreeBytes = max(stats->largestFreeBytes, end - offset);
+
+        if(next == SPU_NO_BLOCK){
+            break;
+        }
+
+        stats->usedBytes += _allocations[next].length;
+        stats->numBlocks++;
+        offset = _allocations[next].offset + _allocations[next].length;
+    }
+
+    stats->freeBytes = stats->totalBytes - stats->usedBytes;
+}
+
+size_t compactSPURAM(void){
+    uint32_t buffer[2048 / 4];
+
+    uint32_t offset = _ALLOC_START;
+    size_t   largestFree = 0;
+
+    for(;;){
+        SPUBlock next = _findNext(offset);
+
+        if(next == SPU_NO_BLOCK){
+            break;
+        }
+
+        SPUAllocation *alloc = &_allocations[next];
+
+        if(alloc->pinned){
+            largestFree = max(largestFree, alloc->offset - offset);
+        } else if(alloc->offset > offset){
+            // The destination is always below the source, so copying from the
+            // start onwards never overwrites data yet to be moved.
+            for(uint32_t moved = 0; moved < alloc->length; moved += sizeof(buffer)){
+                size_t length = min(alloc->length - moved, sizeof(buffer));
+
+                download(alloc->offset + moved, buffer, length, true);
+                upload(offset + moved, buffer, length, true);
+            }
+
+            alloc->offset = offset;
+        }
+
+        offset = alloc->offset + alloc->length;
+    }
+
+    return max(largestFree, _ALLOC_END - offset);
 }
 
 /* Sound Class */
 void sound_create(Sound *sound){
+    sound->block      = SPU_NO_BLOCK;
     sound->offset     = 0;
     sound->sampleRate = 0;
     sound->length     = 0;
 }
-bool sound_initFromVAGHeader(Sound *sound, const VAGHeader *vagHeader, uint32_t _offset){
+bool sound_initFromVAGHeader(Sound *sound, const VAGHeader *vagHeader){
     if(!vagHeader_validateMagic(vagHeader)){
         return false;
     }
-    sound->offset     = _offset;
     sound->sampleRate = vagHeader_getSPUSampleRate(vagHeader);
     sound->length     = vagHeader_getSPULength(vagHeader);
-    return true;
+    sound->block      = allocSPURAM(sound->length, false);
+    return (sound->block != SPU_NO_BLOCK);
+}
+void sound_free(Sound *sound){
+    freeSPURAM(sound->block);
+    sound->block = SPU_NO_BLOCK;
 }
-
-#include <stdio.h>
 
 /// @brief Play a sound on a given channel.
 /// @param sound Pointer to the sound to play.
@@ -241,18 +583,17 @@ Channel sound_playOnChannel(Sound *sound, uint16_t left, uint16_t right, Channel
     if((ch<0) || (ch >= NUM_CHANNELS)){
         return -1;
     }
-    if(!sound->offset){
-        printf("Length:     %d\n", sound->length);
-        printf("Offset:     %d\n", sound->offset);
-        printf("SampleRate: %d\n", sound->sampleRate);
-        printf("INVALID SOUND OFFSET: %d\n", sound->offset);
+    uint32_t offset = getSPURAMOffset(sound->block);
+
+    if(!offset){
         return -2;
     }
+    offset += sound->offset;
 
     SPU_CH_VOL_L(ch) = left;
 	SPU_CH_VOL_R(ch) = right;
 	SPU_CH_FREQ (ch) = sound->sampleRate;
-	SPU_CH_ADDR (ch) = sound->offset / 8;
+	SPU_CH_ADDR (ch) = offset / 8;
 	SPU_CH_ADSR1(ch) = 0x00ff;
 	SPU_CH_ADSR2(ch) = 0x0000;
 
@@ -269,7 +610,10 @@ int sound_loadSound(const char *name, Sound *sound){
     int remainingLength;
     int uploadedData;
     uint32_t _vagLba;
-    uint8_t _sectorBuffer[2048];
+    uint32_t _offset;
+    uint8_t _sectorBuffers[2][2048];
+    volatile bool _uploaded[2];
+    int _current = 0;
     
     
     // Find the file on the filesystem
@@ -277,91 +621,188 @@ int sound_loadSound(const char *name, Sound *sound){
     assert(_vagLba); // File not found
 
     // Load the data into the sector
-    startCDROMRead(_vagLba, &_sectorBuffer, 1, 2048, true, true);
+    startCDROMRead(_vagLba, _sectorBuffers[0], 1, 2048, true, true);
     // Set the header data
-    const VAGHeader *_vagHeader = (const VAGHeader*) _sectorBuffer;
-    
-    printf("Sound: %s\n", name);
-    printf("%d\n",   _vagHeader->channels);
-    printf("%d\n",   _vagHeader->interleave);
-    printf("%d\n",   _vagHeader->length);
-    printf("%d\n",   _vagHeader->magic);
-    printf("%d\n\n", _vagHeader->version);
-    printf("%d\n\n", _vagHeader->sampleRate);
+    const VAGHeader *_vagHeader = (const VAGHeader*) _sectorBuffers[0];
 
     // Initialise the sound
     sound_create(sound);
-    if(!sound_initFromVAGHeader(sound, _vagHeader, spuAllocPtr)){
-        // Failed to validate magic header
+    if(!sound_initFromVAGHeader(sound, _vagHeader)){
+        // Failed to validate magic header or out of SPU RAM
         return 2;
     }
 
     remainingLength = sound->length;
+    _offset         = getSPURAMOffset(sound->block);
 
     // Upload first sector of audio data.
     // Whether the data goes on further than this, we need to exclude the header data.
-    uploadedData = upload(
-        spuAllocPtr,
+    // Sectors are read into two buffers in turn, so that each sector is read
+    // while the previous one is still being uploaded.
+    _uploaded[1] = true;
+    uploadedData = queueUpload(
+        _offset,
         vagHeader_getData(_vagHeader),
         min(remainingLength, (2048 - sizeof(VAGHeader))),
-        true
+        &_uploaded[0]
     );
-    spuAllocPtr += uploadedData;
+    _offset += uploadedData;
     remainingLength -= uploadedData;
 
-    while(remainingLength){
+    while(remainingLength > 0){
+        _current ^= 1;
+
         // If not all the data is uploaded, load the next sector of data
+        // once the buffer's previous upload is done.
+        waitForSPUTransfer(&_uploaded[_current]);
         startCDROMRead(
             ++_vagLba,
-            &_sectorBuffer,
+            _sectorBuffers[_current],
             1,
             2048,
             true,
             true
         );
 
-        uploadedData = upload(
-            spuAllocPtr,
-            _sectorBuffer,
+        uploadedData = queueUpload(
+            _offset,
+            _sectorBuffers[_current],
             min(remainingLength, 2048),
-            true
+            &_uploaded[_current]
         );
-        spuAllocPtr += uploadedData;
+        _offset += uploadedData;
         remainingLength -= uploadedData;
 
     }
 
+    // The buffers are on the stack, so they must not be released early.
+    waitForSPUTransfer(&_uploaded[0]);
+    waitForSPUTransfer(&_uploaded[1]);
+
     return 0;
 }
 
 
 int sound_loadSoundFromBinary(const uint8_t *data, Sound *sound){
-    int remainingLength;
-    
-    VAGHeader *_vagHeader = (const VAGHeader*) data;
-    
-    printf("%d\n",   _vagHeader->channels);
-    printf("%d\n",   _vagHeader->interleave);
-    printf("%d\n",   _vagHeader->length);
-    printf("%d\n",   _vagHeader->magic);
-    printf("%d\n\n", _vagHeader->version);
-    printf("%d\n\n", _vagHeader->sampleRate);
+    // The data may live in read-only memory, so the sample rate is adjusted
+    // on a copy of the header.
+    VAGHeader _vagHeader;
 
-    _vagHeader->sampleRate = (_vagHeader->sampleRate * 2) / 3;
+    __builtin_memcpy(&_vagHeader, data, sizeof(VAGHeader));
+    _vagHeader.sampleRate = (_vagHeader.sampleRate * 2) / 3;
 
     // Initialise the sound
     sound_create(sound);
-    if(!sound_initFromVAGHeader(sound, _vagHeader, spuAllocPtr)){
-        // Failed to validate magic header
+    if(!sound_initFromVAGHeader(sound, &_vagHeader)){
+        // Failed to validate magic header or out of SPU RAM
         return 2;
     }
 
     upload(
-        spuAllocPtr,
-        vagHeader_getData(_vagHeader),
+        getSPURAMOffset(sound->block),
+        vagHeader_getData((const VAGHeader*) data),
         sound->length,
         true
     );
     
     return 0;
-}
\ No newline at end of file
+}
+
+/* SoundBank Class */
+
+void soundBank_create(SoundBank *bank){
+    bank->block     = SPU_NO_BLOCK;
+    bank->numSounds = 0;
+}
+
+int soundBank_load(const char *name, SoundBank *bank){
+    DirectoryEntry _entry;
+
+    soundBank_create(bank);
+
+    if(!getFileInfo(name, &_entry)){
+        // File not found
+        return 1;
+    }
+
+    // Read the whole file in one go, then upload all of the sounds at once.
+    size_t   _numSectors = (_entry.length + 2047) / 2048;
+    uint8_t *_buffer     = malloc(_numSectors * 2048);
+
+    if(!_buffer){
+        return 3;
+    }
+
+    // The buffer must not be touched (or freed) until the drive is done
+    // writing to it.
+    startCDROMRead(_entry.lba, _buffer, _numSectors, 2048, true, false);
+    waitForCDROMRead();
+
+    const SoundBankHeader *_header  = (const SoundBankHeader*) _buffer;
+    const SoundBankEntry  *_entries = (const SoundBankEntry*) (_header + 1);
+
+    if(
+        (_header->magic != SOUND_BANK_MAGIC) ||
+        (_header->numSounds > SOUND_BANK_MAX_SOUNDS) ||
+        ((_header->dataLength + 2048) > (_numSectors * 2048))
+    ){
+        // Failed to validate bank header
+        free(_buffer);
+        return 2;
+    }
+
+    // Sounds must start on an ADPCM block boundary and lie entirely within
+    // the bank's data, as they are played straight from SPU RAM.
+    for(int i = 0; i < _header->numSounds; i++){
+        if(
+            (_entries[i].offset % 16) ||
+            (_entries[i].offset > _header->dataLength) ||
+            (_entries[i].length > (_header->dataLength - _entries[i].offset))
+        ){
+            // Failed to validate bank entry
+            free(_buffer);
+            return 2;
+        }
+    }
+
+    bank->block = allocSPURAM(_header->dataLength, false);
+    if(bank->block == SPU_NO_BLOCK){
+        // Out of SPU RAM
+        free(_buffer);
+        return 3;
+    }
+
+    upload(getSPURAMOffset(bank->block), &_buffer[2048], _header->dataLength, true);
+
+    bank->numSounds = _header->numSounds;
+
+    for(int i = 0; i < bank->numSounds; i++){
+        Sound *sound = &bank->sounds[i];
+
+        sound->block      = bank->block;
+        sound->offset     = _entries[i].offset;
+        sound->length     = _entries[i].length;
+        sound->sampleRate = (uint16_t)((_entries[i].sampleRate << 12) / 44100);
+
+        __builtin_memcpy(bank->names[i], _entries[i].name, SOUND_BANK_NAME_LENGTH);
+        bank->names[i][SOUND_BANK_NAME_LENGTH - 1] = 0;
+    }
+
+    free(_buffer);
+    return 0;
+}
+
+int soundBank_find(const SoundBank *bank, const char *name){
+    for(int i = 0; i < bank->numSounds; i++){
+        if(!__builtin_strcmp(bank->names[i], name)){
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void soundBank_free(SoundBank *bank){
+    freeSPURAM(bank->block);
+    soundBank_create(bank);
+}
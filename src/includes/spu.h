@@ -28,7 +28,22 @@ static const uint16_t MAX_VOLUME   = 0x3fff;
 
 static const ChannelMask ALL_CHANNELS = (1 << NUM_CHANNELS) - 1;
 
-extern uint32_t spuAllocPtr;
+/* SPU RAM Allocator */
+
+// SPU RAM past the dummy block is handed out in 16-byte ADPCM blocks. Each
+// allocation is referred to by a handle rather than its address, so that
+// compactSPURAM() can move it around. Pinned allocations (e.g. stream ring
+// buffers, which are in constant use) are never moved.
+#define SPU_RAM_ALIGN       16
+#define SPU_MAX_ALLOCATIONS 64
+#define SPU_NO_BLOCK        -1
+
+typedef int SPUBlock;
+
+typedef struct SPURAMStats{
+    uint32_t totalBytes, usedBytes, freeBytes, largestFreeBytes;
+    int      numBlocks;
+} SPURAMStats;
 
 /* Utilities */
 
@@ -53,9 +68,32 @@ static inline size_t roundup(size_t a, size_t b) {
 
 /* Basic SPU API */
 
+// Voices are handed out by a simple allocator, which remembers which voices it
+// gave out instead of scanning all of them every time. When none is free, the
+// lowest priority (then quietest, then oldest) voice playing a sound of the
+// same or a lower priority is stolen. Reserved voices, such as those used by
+// streams, are never stolen.
+typedef enum{
+    SOUND_PRIORITY_LOW    = 0,
+    SOUND_PRIORITY_NORMAL = 1,
+    SOUND_PRIORITY_HIGH   = 2
+} SoundPriority;
+
 void initSPU(void);
-Channel getFreeChannel(void);
-ChannelMask getFreeChannels(int count);
+
+/// @brief Forget all SPU RAM allocations. Called by initSPU().
+void initSPURAM(void);
+/// @brief Allocate a voice for a sound, stealing one if necessary.
+/// @return Channel number, or -1 if all voices are reserved or playing sounds
+/// of a higher priority.
+Channel allocChannel(SoundPriority priority);
+
+/// @brief Reserve voices until releaseChannels() is called. Voices playing
+/// sounds are stolen if there are not enough free ones.
+/// @return Mask of the reserved voices, or 0 if not enough are left.
+ChannelMask reserveChannels(int count);
+void releaseChannels(ChannelMask mask);
+
 void stopChannels(ChannelMask mask);
 
 static inline void setMasterVolume(uint16_t master, uint16_t reverb){
@@ -74,9 +112,44 @@ static inline void stopChannel(Channel ch){
     stopChannels(1 << ch);
 }
 
+// Maximum number of SPU DMA transfers waiting to be started.
+#define SPU_QUEUE_LENGTH 16
+
+/// @brief Queue a DMA transfer from main RAM to SPU RAM. Transfers are carried
+/// out in order in the background; the data must be left untouched until done.
+/// @param done Optional flag, cleared now and set once the transfer is done.
+/// @return Length of the transfer, rounded up to a whole number of DMA chunks.
+size_t queueUpload(uint32_t offset, const void *data, size_t length, volatile bool *done);
+size_t queueDownload(uint32_t offset, void *data, size_t length, volatile bool *done);
+
+void waitForSPUTransfer(volatile bool *done);
+void waitForSPUQueue(void);
+
+/// @brief Start the next queued transfer. Called from the DMA IRQ handler.
+void handleSPUDMAInterrupt(void);
+
+/// @brief Queue a transfer and optionally wait for it to finish.
 size_t upload(uint32_t offset, const void *data, size_t length, bool wait);
 size_t download(uint32_t offset, void *data, size_t length, bool wait);
 
+/// @brief Allocate an area of SPU RAM, first fit.
+/// @return Handle to the area, or SPU_NO_BLOCK if there is no free area large
+/// enough (compactSPURAM() may help) or no handles are left.
+SPUBlock allocSPURAM(size_t length, bool pinned);
+void freeSPURAM(SPUBlock block);
+
+/// @brief Return the current address of an allocation. Addresses of unpinned
+/// allocations change when compactSPURAM() is called.
+uint32_t getSPURAMOffset(SPUBlock block);
+
+void getSPURAMStats(SPURAMStats *stats);
+
+/// @brief Move all unpinned allocations down to close the gaps between them,
+/// using DMA to copy the data through main RAM. Must not be called while any
+/// unpinned allocation is being played.
+/// @return Size of the largest free area afterwards.
+size_t compactSPURAM(void);
+
 
 /* VAGHeader Class */
 
@@ -118,17 +191,27 @@ static inline const void *vagHeader_getData(const VAGHeader *vagHeader){
 /* Sound Class */
 
 typedef struct Sound {
-    uint32_t offset;
-    uint16_t sampleRate, length;
+    SPUBlock block;
+    uint32_t offset, length; // Offset is relative to the start of the block
+    uint16_t sampleRate;
 } Sound;
 
 void sound_create(Sound *sound);
 
-bool sound_initFromVAGHeader(Sound *sound, const VAGHeader *vagHeader, uint32_t _offset);
+/// @brief Allocate SPU RAM for a sound based on its VAG header. The data must
+/// then be uploaded to getSPURAMOffset(sound->block).
+bool sound_initFromVAGHeader(Sound *sound, const VAGHeader *vagHeader);
+
+/// @brief Release the SPU RAM held by a sound. It must not be playing. Sounds
+/// belonging to a bank are released by soundBank_free() instead.
+void sound_free(Sound *sound);
 Channel sound_playOnChannel(Sound *sound, uint16_t left, uint16_t right, Channel ch);
 
+static inline Channel sound_playWithPriority(Sound *sound, uint16_t left, uint16_t right, SoundPriority priority){
+    return sound_playOnChannel(sound, left, right, allocChannel(priority));
+}
 static inline Channel sound_play(Sound *sound, uint16_t left, uint16_t right){
-    return sound_playOnChannel(sound, left, right, getFreeChannel());
+    return sound_playWithPriority(sound, left, right, SOUND_PRIORITY_NORMAL);
 }
 
 /// @brief Load a sound from disk.
@@ -138,3 +221,44 @@ static inline Channel sound_play(Sound *sound, uint16_t left, uint16_t right){
 int sound_loadSound(const char *name, Sound *sound);
 
 int sound_loadSoundFromBinary(const uint8_t *data, Sound *sound);
+
+/* SoundBank Class */
+
+// A sound bank packs several sounds into a single file (see buildSoundBank.py),
+// which is loaded with one CD-ROM read and uploaded with one SPU DMA transfer.
+// The first sector holds a header and a table of contents; the ADPCM data
+// follows from the second sector onwards.
+#define SOUND_BANK_MAGIC       concat4_8('S', 'B', 'N', 'K')
+#define SOUND_BANK_MAX_SOUNDS  63
+#define SOUND_BANK_NAME_LENGTH 16
+
+typedef struct SoundBankHeader{
+    uint32_t magic;
+    uint16_t numSounds, _reserved;
+    uint32_t dataLength, _reserved2;
+} SoundBankHeader;
+
+typedef struct SoundBankEntry{
+    char     name[SOUND_BANK_NAME_LENGTH];
+    uint32_t offset, length, sampleRate, _reserved;
+} SoundBankEntry;
+
+typedef struct SoundBank{
+    SPUBlock block;
+    int      numSounds;
+    Sound    sounds[SOUND_BANK_MAX_SOUNDS];
+    char     names[SOUND_BANK_MAX_SOUNDS][SOUND_BANK_NAME_LENGTH];
+} SoundBank;
+
+void soundBank_create(SoundBank *bank);
+
+/// @brief Load a sound bank from disk into SPU RAM. The sounds can then be
+/// played through bank->sounds.
+/// @return Zero or Error code.
+int soundBank_load(const char *name, SoundBank *bank);
+
+/// @brief Return the index of a sound in the bank by name, or -1.
+int soundBank_find(const SoundBank *bank, const char *name);
+
+/// @brief Release the SPU RAM held by a bank. None of its sounds must be playing.
+void soundBank_free(SoundBank *bank);
@@ -1,5 +1,6 @@
 #include "stream.h"
 
+#include <stdio.h>
 #include "filesystem.h"
 #include "spu.h"
 #include "system.h"
@@ -32,28 +33,34 @@
  * blocks.
  * - SpicyJpeg
  */
-void stream_configureIRQ(Stream *stream){
-    uint16_t ctrlReg = SPU_CTRL;
 
-    // Disable the IRQ if an underrun occurs.
-    // TODO: handle this in a slightly better way
-    if(!stream->_bufferedChunks){
-        SPU_CTRL = ctrlReg & ~SPU_CTRL_IRQ_ENABLE;
-        return;
-    }
+/*
+ * The SPU only has one IRQ address, so with several streams playing it can
+ * only watch one chunk boundary at a time. It is always armed for the boundary
+ * expected to come first, going by each stream's chunk length as measured on
+ * timer 1 (which counts horizontal blanking periods). If a boundary passes
+ * while the IRQ is armed for another stream, the stream is advanced once it
+ * is safely past its expected time instead. This only has to happen within a
+ * chunk's length of the actual boundary to be inaudible.
+ */
+#define STREAM_HBLANK_RATE 15700 // Close enough for both NTSC and PAL
 
-    // Exit if the IRQ has been set up before and not yet acknowledged by
-    // handleInterrupt().
-    if(ctrlReg & SPU_CTRL_IRQ_ENABLE){
-        return;
-    }
+static Stream *streamPlaying[STREAM_MAX_PLAYING];
+static Stream *streamArmed;
+
+static inline uint16_t stream_getTime(void){
+    return TIMER_VALUE(1);
+}
 
+// Return whether the given time has passed, allowing for timer wraparound.
+static inline bool stream_isPast(uint16_t time, uint16_t now){
+    return (int16_t)(now - time) >= 0;
+}
+
+static void stream_setLoopAddress(Stream *stream){
     ChannelMask tempMask = stream->_channelMask;
     uint32_t chunkOffset = stream_getChunkOffset(stream, stream->_head);
 
-    SPU_IRQ_ADDR = chunkOffset / 8;
-    SPU_CTRL     = ctrlReg | SPU_CTRL_IRQ_ENABLE;
-
     for(Channel ch = 0; tempMask; ch++, tempMask >>= 1){
         if(!(tempMask & 1)){
             continue;
@@ -64,8 +71,112 @@ void stream_configureIRQ(Stream *stream){
     }
 }
 
+// Arm the IRQ for the playing stream whose next chunk boundary comes first.
+static void stream_armIRQ(void){
+    uint16_t now  = stream_getTime();
+    Stream   *next = 0;
+
+    // Disabling the IRQ is always required in order to acknowledge it.
+    SPU_CTRL &= ~SPU_CTRL_IRQ_ENABLE;
+
+    for(int i = 0; i < STREAM_MAX_PLAYING; i++){
+        Stream *stream = streamPlaying[i];
+
+        if(!stream || stream->_stalled){
+            continue;
+        }
+        if(
+            !next ||
+            ((int16_t)(stream->_boundaryTime - now) <
+                (int16_t)(next->_boundaryTime - now))
+        ){
+            next = stream;
+        }
+    }
+
+    streamArmed = next;
+    if(!next){
+        return;
+    }
+
+    SPU_IRQ_ADDR = stream_getChunkOffset(next, next->_head) / 8;
+    SPU_CTRL    |= SPU_CTRL_IRQ_ENABLE;
+}
+
+// Point all channels' loop addresses at the silent dummy block, so that they
+// fall silent once the current chunk has been played instead of looping over
+// stale data. Playback is resumed from the same chunk by stream_feed() once
+// enough data has been buffered again.
+static void stream_stall(Stream *_stream){
+    ChannelMask tempMask = _stream->_channelMask;
+
+    for(Channel ch = 0; tempMask; ch++, tempMask >>= 1){
+        if(tempMask & 1){
+            SPU_CH_LOOP_ADDR(ch) = DUMMY_BLOCK_OFFSET / 8;
+        }
+    }
+
+    _stream->_stalled = true;
+    _stream->underruns++;
+}
+
+// Called once playback has reached the head chunk, at the given time.
+static void stream_advance(Stream *_stream, uint16_t time){
+    _stream->_head = (_stream->_head + 1) % _stream->numChunks;
+    _stream->_bufferedChunks--;
+    _stream->_playedChunks++;
+    _stream->_boundaryTime = time + _stream->_chunkTicks;
+
+    if(!_stream->_bufferedChunks){
+        stream_stall(_stream);
+        return;
+    }
+    if(_stream->_bufferedChunks < STREAM_NEAR_UNDERRUN_CHUNKS){
+        _stream->nearUnderruns++;
+    }
+
+    stream_setLoopAddress(_stream);
+}
+
+// Advance any stream that went past its boundary without the IRQ being armed
+// for it. A quarter of a chunk is allowed for timing error, so that the loop
+// address is never moved on before the channels have actually used it.
+static void stream_catchUp(void){
+    uint16_t now = stream_getTime();
+
+    for(int i = 0; i < STREAM_MAX_PLAYING; i++){
+        Stream *stream = streamPlaying[i];
+
+        if(!stream){
+            continue;
+        }
+
+        while(
+            !stream->_stalled &&
+            stream_isPast(stream->_boundaryTime + stream->_chunkTicks / 4, now)
+        ){
+            stream_advance(stream, stream->_boundaryTime);
+        }
+    }
+}
+
+void stream_handleSPUInterrupt(void){
+    // The IRQ may have been re-armed for another stream after firing, in which
+    // case the flag was cleared and the stream it fired for has already been
+    // caught up with.
+    if(streamArmed && (SPU_STAT & SPU_STAT_IRQ)){
+        stream_advance(streamArmed, stream_getTime());
+    }
+
+    stream_catchUp();
+    stream_armIRQ();
+}
+
 void stream_create(Stream *stream){
-    stream->_channelMask = 0;
+    stream->_channelMask   = 0;
+    stream->_playedChunks  = 0;
+    stream->underruns      = 0;
+    stream->nearUnderruns  = 0;
     stream->offset       = 0;
     stream->interleave   = 0;
     stream->numChunks    = 0;
@@ -90,25 +201,72 @@ bool stream_initFromVAGHeader(Stream *_stream, const VAGHeader *vagHeader, uint3
     _stream->numChunks  = _numChunks;
     _stream->sampleRate = vagHeader_getSPUSampleRate(vagHeader);
     _stream->channels   = vagHeader_getNumChannels(vagHeader);
+
+    // Each 16-byte ADPCM block holds 28 samples. The SPU sample rate is a
+    // 4.12 fixed point multiple of 44100 Hz.
+    uint32_t samples     = (_stream->interleave / 16) * 28;
+    _stream->_chunkTicks =
+        ((samples * STREAM_HBLANK_RATE) / 44100) * 4096 / _stream->sampleRate;
     return true;
 }
- 
-ChannelMask stream_startWithChannelMask(uint16_t left, uint16_t right, ChannelMask mask) {
-    if(stream_isPlaying(&stream) || !stream._bufferedChunks){
+
+// Key the channels on at the head chunk and register the stream with the IRQ
+// dispatcher.
+static void stream_keyOn(Stream *_stream){
+    ChannelMask mask     = _stream->_channelMask;
+    ChannelMask tempMask = mask;
+    uint32_t chunkOffset = stream_getChunkOffset(_stream, _stream->_head);
+
+    for(Channel ch = 0; tempMask; ch++, tempMask >>= 1){
+        if(!(tempMask & 1)){
+            continue;
+        }
+
+        SPU_CH_ADDR(ch) = chunkOffset / 8;
+        chunkOffset    += _stream->interleave;
+    }
+
+    _stream->_stalled = false;
+    SPU_FLAG_ON1 = mask & 0xffff;
+    SPU_FLAG_ON2 = mask >> 16;
+
+    stream_advance(_stream, stream_getTime());
+    stream_armIRQ();
+}
+
+ChannelMask stream_startWithChannelMask(Stream *_stream, uint16_t left, uint16_t right, ChannelMask mask) {
+    if(stream_isPlaying(_stream) || !_stream->_bufferedChunks){
         return 0;
     }
 
     mask &= ALL_CHANNELS;
+    if(!mask){
+        return 0;
+    }
+
+    bool reenableInterrupts = disableInterrupts();
+    int  slot;
+
+    for(slot = 0; slot < STREAM_MAX_PLAYING; slot++){
+        if(!streamPlaying[slot]){
+            break;
+        }
+    }
+    if(slot == STREAM_MAX_PLAYING){
+        if(reenableInterrupts){
+            enableInterrupts();
+        }
+        return 0;
+    }
 
     ChannelMask tempMask = mask;
-    uint32_t chunkOffset = stream_getChunkOffset(&stream, stream._head);
     int isRightCh        = 0;
 
     for(Channel ch = 0; tempMask; ch++, tempMask >>= 1){
         if(!(tempMask & 1)){
             continue;
         }
-    
+
         // Assume each pair of channels is a stero pair. If the channel count is odd,
         // assume the last channel is mono.
 
@@ -123,20 +281,35 @@ ChannelMask stream_startWithChannelMask(uint16_t left, uint16_t right, ChannelMa
             SPU_CH_VOL_R(ch) = right;
         }
 
-        SPU_CH_FREQ(ch)  = stream.sampleRate;
-        SPU_CH_ADDR(ch)  = chunkOffset / 8;
+        SPU_CH_FREQ(ch)  = _stream->sampleRate;
         SPU_CH_ADSR1(ch) = 0x00ff;
         SPU_CH_ADSR2(ch) = 0x0000;
 
-        chunkOffset += stream.interleave;
-        isRightCh   ^= 1;
+        isRightCh ^= 1;
     }
 
-    stream._channelMask = mask;
-    SPU_FLAG_ON1 = mask & 0xffff;
-    SPU_FLAG_ON2 = mask >> 16;
+    _stream->_channelMask = mask;
+    streamPlaying[slot]   = _stream;
+    stream_keyOn(_stream);
+
+    flushWriteQueue();
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
+    return mask;
+}
+
+ChannelMask stream_start(Stream *stream, uint16_t left, uint16_t right){
+    ChannelMask mask = reserveChannels(stream->channels);
+
+    if(!mask){
+        return 0;
+    }
+    if(!stream_startWithChannelMask(stream, left, right, mask)){
+        releaseChannels(mask);
+        return 0;
+    }
 
-    stream_handleInterrupt(&stream);
     return mask;
 }
 
@@ -145,51 +318,86 @@ void stream_stop(Stream *stream){
         return;
     }
 
-    SPU_CTRL &= ~SPU_CTRL_IRQ_ENABLE;
+    bool reenableInterrupts = disableInterrupts();
+
+    for(int i = 0; i < STREAM_MAX_PLAYING; i++){
+        if(streamPlaying[i] == stream){
+            streamPlaying[i] = 0;
+        }
+    }
 
     stopChannels(stream->_channelMask);
+    releaseChannels(stream->_channelMask);
     stream->_channelMask = 0;
+    stream->_stalled     = false;
+    stream_armIRQ();
+
     flushWriteQueue();
-    
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
 }
 
-void stream_handleInterrupt(Stream *_stream){
-    if(!stream_isPlaying(_stream)){
-        return;
-    }
-    // Disabling the IRQ is always required in order to acknowledge it.
-    SPU_CTRL &= ~SPU_CTRL_IRQ_ENABLE;
 
-    _stream->_head = (_stream->_head + 1) % _stream->numChunks;
-    _stream->_bufferedChunks--;
-    stream_configureIRQ(_stream);
-}
+// Upload data to the ring buffer, carrying on from where the last call left
+// off, which may be in the middle of a chunk. Chunks are only handed over to
+// playback once complete. The done flag is set once all uploads are done and
+// the data can be overwritten. Must be called with interrupts disabled or from
+// the IRQ handler.
+static size_t stream_write(Stream *_stream, const uint8_t *data, size_t length, volatile bool *done){
+    size_t chunkLength = stream_getChunkLength(_stream);
+    size_t written     = 0;
 
+    *done = true;
 
-size_t stream_feed(Stream *_stream, const void *data, size_t length){
-    bool reenableInterrupts = disableInterrupts();
+    while(length && stream_getFreeChunkCount(_stream)){
+        size_t part = min(length, chunkLength - _stream->_tailFill);
 
-    uintptr_t ptr = (uintptr_t)(data);
-    size_t chunkLength = stream_getChunkLength(_stream);
-    length = min(length, stream_getFreeChunkCount(_stream) * chunkLength);
-    
-    for(int i = length; i >= (int)(chunkLength); i -= chunkLength){
-        upload(
-            stream_getChunkOffset(_stream, _stream->_tail),
-            (const void *)(ptr),
-            chunkLength,
-            true
+        // Transfers are carried out in order, so only the last one has to
+        // set the flag. This part is the last if it uses up the data, or if
+        // it fills the last free chunk.
+        bool last = (part == length) || (stream_getFreeChunkCount(_stream) == 1);
+
+        queueUpload(
+            stream_getChunkOffset(_stream, _stream->_tail) + _stream->_tailFill,
+            data,
+            part,
+            last ? done : 0
         );
 
-        ptr += chunkLength;
-        _stream->_tail = (_stream->_tail + 1) % _stream->numChunks;
-        _stream->_bufferedChunks++;
+        data               += part;
+        length             -= part;
+        written            += part;
+        _stream->_tailFill += part;
+
+        if(_stream->_tailFill < chunkLength){
+            break;
+        }
 
+        _stream->_tailFill = 0;
+        _stream->_tail     = (_stream->_tail + 1) % _stream->numChunks;
+        _stream->_bufferedChunks++;
     }
-    if(stream_isPlaying(_stream)){
-        stream_configureIRQ(_stream);
+
+    // After an underrun, wait for the buffer to be half full again before
+    // resuming, so that playback doesn't keep cutting in and out.
+    if(
+        stream_isPlaying(_stream) && _stream->_stalled &&
+        (_stream->_bufferedChunks >= _stream->numChunks / 2)
+    ){
+        stream_keyOn(_stream);
     }
 
+    return written;
+}
+
+size_t stream_feed(Stream *_stream, const void *data, size_t length){
+    bool reenableInterrupts = disableInterrupts();
+    volatile bool done;
+
+    length = stream_write(_stream, (const uint8_t *) data, length, &done);
+    waitForSPUTransfer(&done);
+
     flushWriteQueue();
     if(reenableInterrupts){
         enableInterrupts();
@@ -197,125 +405,382 @@ size_t stream_feed(Stream *_stream, const void *data, size_t length){
     return length;
 }
 
+size_t stream_feedFromIRQ(Stream *_stream, const void *data, size_t length, volatile bool *done){
+    return stream_write(_stream, (const uint8_t *) data, length, done);
+}
+
 void stream_resetBuffer(Stream *_stream){
+    _stream->_stalled         = false;
+    _stream->_tailFill        = 0;
     _stream->_head            = 0;
     _stream->_tail            = 0;
     _stream->_bufferedChunks  = 0;
 }
 
 /* Stream State Machine*/
-// Public Variables
-Stream stream;
 
-// Private Variables
-uint8_t streamBuffer[16 * 2048]; // 32 mono chunks or 16 stereo chunks
-size_t streamLength;
-size_t streamOffset;
-uint32_t songLba;
-int chunkLength;
-int streamFreeChunks;
-int feedLength;
+// Sectors are uploaded to SPU RAM straight from these slots as they are read,
+// so only a few of them are needed. Only one read is in flight at a time, so
+// all contexts share them. Headers are also read into them.
+#define STREAM_SLOTS 4
+
+// Buffering policy. Read latency is measured as the number of chunks played
+// between a context needing a read and the read completing, which is directly
+// the amount of data that has to be buffered to ride out the next one. Reads
+// are started early enough to keep twice the worst recent latency buffered,
+// plus a margin that grows whenever any stream nearly runs dry while they are
+// in progress. Reads are never made smaller to compensate: every read costs a
+// seek, so small reads only leave the drive less time to keep all streams fed.
+// Instead, the refill threshold never drops below a fraction of the ring
+// buffer, so that each seek is amortised over enough data.
+#define STREAM_MIN_REFILL_CHUNKS 2
+#define STREAM_MAX_REFILL_CHUNKS 16
+#define STREAM_MIN_REFILL_RATIO  3
+#define STREAM_LATENCY_MARGIN    2
+
+static uint8_t streamSlots[STREAM_SLOTS * 2048] __attribute__((aligned(4)));
+
+// Set once each slot's upload is done and the drive can write to it again.
+// Uploads go through the shared SPU DMA queue and may be held up behind other
+// transfers, so this can't be assumed.
+static volatile bool streamSlotDone[STREAM_SLOTS];
+static StreamContext *streamContexts;
+static StreamContext *streamReading;
+
+static uint16_t stream_getWarnings(void){
+    uint16_t warnings = 0;
+
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+    for(StreamContext *ctx = streamContexts; ctx; ctx = ctx->next){
+        warnings += ctx->stream.underruns + ctx->stream.nearUnderruns;
+    }
+
+    return warnings;
+}
+
+// Small ring buffers must be refilled once half empty at the latest, or the
+// refill threshold might never be reached.
+static int stream_getMaxRefillChunks(StreamContext *ctx){
+    return min(STREAM_MAX_REFILL_CHUNKS, ctx->numChunks / 2);
+}
+
+static int stream_getMinRefillChunks(StreamContext *ctx){
+    return max(STREAM_MIN_REFILL_CHUNKS, ctx->numChunks / STREAM_MIN_REFILL_RATIO);
+}
 
+static void stream_adjustPolicy(StreamContext *ctx){
+    Stream *stream = &ctx->stream;
 
-StreamStateMachineState streamSMState = STREAM_SM_IDLE;
+    // Only reads that ran entirely during playback tell anything about the
+    // latency.
+    if(stream_isPlaying(stream) && !stream->_stalled){
+        int latency = stream->_playedChunks - ctx->readStartChunk;
 
-// TODO:
-// Is this function necessary?
-void stream_init(void){
-    stream_create(&stream);
+        ctx->latency = max(latency, (ctx->latency * 15) / 16);
+    }
+
+    if(stream_getWarnings() != ctx->readWarnings){
+        ctx->margin = min(ctx->numChunks, ctx->margin + STREAM_LATENCY_MARGIN);
+    } else if(ctx->margin > STREAM_LATENCY_MARGIN){
+        ctx->margin--;
+    }
+
+    ctx->refillChunks = ctx->numChunks - 1 - (ctx->latency * 2 + ctx->margin);
+    ctx->refillChunks = max(stream_getMinRefillChunks(ctx), min(stream_getMaxRefillChunks(ctx), ctx->refillChunks));
 }
 
-size_t stream_loadSong(const char *name){
-    char _songVagHeaderSector[2048];
-    VAGHeader _songVagHeader;
-    
-    songLba = getLbaToFile(name);
-    if(!songLba){
+void streamContext_create(StreamContext *ctx){
+    if(!streamContexts){
+        for(int i = 0; i < STREAM_SLOTS; i++){
+            streamSlotDone[i] = true;
+        }
+
+        // Timer 1 is left free running, counting horizontal blanking periods.
+        // Writing to its control register resets it, which would throw off
+        // the boundary times of any stream already playing, so it is only
+        // set up once.
+        TIMER_CTRL(1) = TIMER_CTRL_EXT_CLOCK;
+    }
+
+    stream_create(&ctx->stream);
+
+    ctx->state         = STREAM_SM_STOPPED;
+    ctx->playRequested = false;
+    ctx->readWanted    = false;
+    ctx->ringBlock     = SPU_NO_BLOCK;
+
+    ctx->next      = streamContexts;
+    streamContexts = ctx;
+}
+
+size_t streamContext_loadSong(StreamContext *ctx, const char *name, int numChunks){
+    if(ctx->state != STREAM_SM_STOPPED){
+        // A song is already loaded.
+        return 2;
+    }
+
+    ctx->lba = getLbaToFile(name);
+    if(!ctx->lba){
         // File not found error.
         return 1;
     }
 
-    // Read the VAG header sector
-    startCDROMRead(
-        songLba,
-        _songVagHeaderSector,
-        sizeof(_songVagHeaderSector) / 2048,
-        2048,
-        true,
-        true
-    );
+    // The header is read by the state machine, so that loading never has to
+    // wait for the drive.
+    ctx->numChunks = numChunks;
+    ctx->state     = STREAM_SM_LOAD_HEADER;
+    return 0;
+}
 
-    
-    // The first sector of music data immediately follows the header's sector.
-    // Load it into the stream buffer
-    // TODO: Consider turning this into some kind of state machine?
-    // Maybe rewrite this entire section once coroutines are added.
-    startCDROMRead(
-        ++songLba,
-        streamBuffer,
-        sizeof(streamBuffer) / 2048,
-        2048,
-        true,
-        true
+void streamContext_play(StreamContext *ctx, uint16_t volume){
+    ctx->volume        = volume;
+    ctx->playRequested = true;
+}
+
+void streamContext_stop(StreamContext *ctx){
+    // A read that is already in flight can't be cancelled, so wait for it.
+    if(streamReading == ctx){
+        waitForCDROMRead();
+        streamReading = 0;
+    }
+
+    stream_stop(&ctx->stream);
+    ctx->state         = STREAM_SM_STOPPED;
+    ctx->playRequested = false;
+
+    freeSPURAM(ctx->ringBlock);
+    ctx->ringBlock = SPU_NO_BLOCK;
+}
+
+void stream_stopAll(void){
+    for(StreamContext *ctx = streamContexts; ctx; ctx = ctx->next){
+        streamContext_stop(ctx);
+    }
+}
+
+// Called from the CD-ROM IRQ handler for each sector of a read. The sector is
+// uploaded from its slot straight to the ring buffer. The SPU DMA runs in the
+// background and is normally long done by the time the slot is reused; if it
+// isn't, the handler stalls until it is, rather than letting the drive
+// overwrite data that hasn't been uploaded yet.
+static void stream_handleSector(void *sector){
+    StreamContext *ctx    = streamReading;
+    int            slot   = ((uint8_t *) sector - streamSlots) / 2048;
+    int            length = min(2048 - ctx->readSkip, ctx->readRemaining);
+
+    stream_feedFromIRQ(
+        &ctx->stream, (const uint8_t *) sector + ctx->readSkip, length,
+        &streamSlotDone[slot]
     );
-    
+    ctx->readSkip       = 0;
+    ctx->readRemaining -= length;
+
+    waitForSPUTransfer(&streamSlotDone[(slot + 1) % STREAM_SLOTS]);
+}
+
+// Reads always start at the first slot, while the last read's uploads may
+// still be pending.
+static void stream_waitForSlots(void){
+    for(int i = 0; i < STREAM_SLOTS; i++){
+        waitForSPUTransfer(&streamSlotDone[i]);
+    }
+}
+
+static void stream_parseHeader(StreamContext *ctx){
+    VAGHeader _songVagHeader;
+    Stream    *stream = &ctx->stream;
+
     // Directly copy all the data from the VAG header sector to the VAG header struct.
     // The struct is laid out exactly how the header is stored, so this works perfectly.
-    __builtin_memcpy(&_songVagHeader, _songVagHeaderSector, sizeof(VAGHeader));
+    __builtin_memcpy(&_songVagHeader, streamSlots, sizeof(VAGHeader));
+
+    // Allocate the ring buffer, which stays pinned until the song is stopped
+    // as the SPU keeps playing from it.
+    if(!vagHeader_validateInterleavedMagic(&_songVagHeader)){
+        printf("Invalid song header\n");
+        ctx->state = STREAM_SM_STOPPED;
+        return;
+    }
+
+    size_t ringLength = _songVagHeader.interleave *
+        vagHeader_getNumChannels(&_songVagHeader) * ctx->numChunks;
 
-    // Initialise the stream and increment the spuAllocPtr.
-    stream_initFromVAGHeader(&stream, &_songVagHeader, spuAllocPtr, 32);
-    spuAllocPtr += stream_getChunkLength(&stream) * stream.numChunks;
-    chunkLength = stream_getChunkLength(&stream);
+    ctx->ringBlock = allocSPURAM(ringLength, true);
+    if(ctx->ringBlock == SPU_NO_BLOCK){
+        printf("Out of SPU RAM for stream\n");
+        ctx->state = STREAM_SM_STOPPED;
+        return;
+    }
+
+    stream_initFromVAGHeader(stream, &_songVagHeader, getSPURAMOffset(ctx->ringBlock), ctx->numChunks);
+    ctx->chunkLength = stream_getChunkLength(stream);
 
     // Set up these variables for the stream state machine to use when streaming more data.
-    streamLength = vagHeader_getSPULength(&_songVagHeader) * stream.channels;
-    streamOffset = 0;
+    // The first sector of music data immediately follows the header's sector.
+    ctx->lba++;
+    ctx->length = vagHeader_getSPULength(&_songVagHeader) * stream->channels;
+    ctx->offset = 0;
 
-    // Feed the first buffer-worth of data into the ring buffer, ready for playback.
-    streamOffset = stream_feed(&stream, streamBuffer, sizeof(streamBuffer));
+    ctx->refillChunks = stream_getMaxRefillChunks(ctx);
+    ctx->margin       = STREAM_LATENCY_MARGIN;
+    ctx->latency      = 0;
 
-    // Ready to play the stream!
-    return 0;
+    ctx->state = STREAM_SM_IDLE;
 }
 
+// Return whether a context needs data, and how urgently: contexts that are
+// playing come first, ordered by how much they have left to play.
+static bool stream_getUrgency(StreamContext *ctx, uint32_t *urgency){
+    Stream *stream = &ctx->stream;
 
-void stream_update(void){
-    
-    // Idle:
-    // The stream is playing audio. The CDROM isn't reading. There is no data to read.
-    // If there are enough free chunks, instruct the CDROM to read more and change
-    // state to wait for the data to be ready.
-    if(streamSMState == STREAM_SM_IDLE){
-        streamFreeChunks = stream_getFreeChunkCount(&stream);
-        if(streamFreeChunks >= 8){
-            feedLength = min(
-                (streamLength) - streamOffset,
-                min(streamFreeChunks * chunkLength, sizeof(streamBuffer))
-            );
-            startCDROMRead(songLba + (streamOffset / 2048), streamBuffer, feedLength / 2048, 2048, true, false);
-            streamSMState = STREAM_SM_WAIT_FOR_DATA;
+    if(ctx->state == STREAM_SM_LOAD_HEADER){
+        *urgency = 0;
+        return true;
+    }
+    if(ctx->state != STREAM_SM_IDLE){
+        return false;
+    }
+
+    // Never wait for the refill threshold after an underrun, as nothing
+    // is playing until the buffer has been refilled.
+    int freeChunks = stream_getFreeChunkCount(stream);
+
+    if((freeChunks < ctx->refillChunks) && !stream->_stalled){
+        ctx->readWanted = false;
+        return false;
+    }
+
+    // Latency is counted from the moment a read is first needed, so that time
+    // spent waiting for other contexts' reads is included.
+    if(!ctx->readWanted){
+        ctx->readWanted     = true;
+        ctx->readStartChunk = stream->_playedChunks;
+        ctx->readWarnings   = stream_getWarnings();
+    }
+
+    *urgency = stream->_bufferedChunks * stream->_chunkTicks;
+    if(!stream_isPlaying(stream) || stream->_stalled){
+        *urgency |= (uint32_t) 1 << 31;
+    }
+    return true;
+}
+
+static void stream_startRead(StreamContext *ctx){
+    Stream *stream = &ctx->stream;
+
+    stream_waitForSlots();
+
+    if(ctx->state == STREAM_SM_LOAD_HEADER){
+        startCDROMRead(ctx->lba, streamSlots, 1, 2048, true, false);
+        ctx->state = STREAM_SM_WAIT_FOR_HEADER;
+        return;
+    }
+
+    // Leave out the part of the tail chunk that has already been filled by
+    // the previous read.
+    int freeChunks = stream_getFreeChunkCount(stream);
+
+    ctx->feedLength = min(
+        (ctx->length) - ctx->offset,
+        freeChunks * ctx->chunkLength -
+            stream->_tailFill
+    );
+    ctx->readSkip      = ctx->offset % 2048;
+    ctx->readRemaining = ctx->feedLength;
+    ctx->readWanted    = false;
+
+    startCDROMStreamRead(
+        ctx->lba + (ctx->offset / 2048),
+        streamSlots,
+        STREAM_SLOTS,
+        (ctx->readSkip + ctx->feedLength + 2047) / 2048,
+        true,
+        stream_handleSector
+    );
+    ctx->state = STREAM_SM_WAIT_FOR_DATA;
+}
+
+static void stream_finishRead(StreamContext *ctx){
+    // Wait For Header:
+    // Set up the ring buffer once the header has arrived.
+    if(ctx->state == STREAM_SM_WAIT_FOR_HEADER){
+        // Ask for the header again if the drive gave up on it.
+        if(isCDROMReadFailed()){
+            ctx->state = STREAM_SM_LOAD_HEADER;
+            return;
         }
+        stream_parseHeader(ctx);
+        return;
+    }
+
+    // Data Ready:
+    // The CDROM has finished reading data, which has already been uploaded
+    // to the ring buffer sector by sector. Move on to the next read.
+    stream_adjustPolicy(ctx);
+
+    // If the drive gave up partway through, only the sectors it delivered
+    // have been fed and the next read picks up from there.
+    ctx->offset += ctx->feedLength - ctx->readRemaining;
+    // If we reached the end of the stream, loop back to the start
+    if(ctx->offset >= ctx->length){
+        ctx->offset -= ctx->length;
+    }
+    ctx->state = STREAM_SM_IDLE;
+}
+
+void stream_update(void){
+    // Catch up on any chunk boundary the IRQ could not be armed for.
+    bool reenableInterrupts = disableInterrupts();
+
+    stream_catchUp();
+    stream_armIRQ();
+    if(reenableInterrupts){
+        enableInterrupts();
     }
 
     // Wait For Data:
-    // Check if the data is ready. If it is, change state to Data Ready
-    if(streamSMState == STREAM_SM_WAIT_FOR_DATA){
-        if(cdromDataReady){
-            streamSMState = STREAM_SM_DATA_READY;
+    // Check if all the data has been transferred. Only one context can be
+    // reading at a time.
+    if(streamReading){
+        if(!isCDROMReadDone()){
+            return;
         }
+
+        stream_finishRead(streamReading);
+        streamReading = 0;
     }
-    
-    // Data Ready:
-    // The CDROM has finished reading data and the Data Ready flag was raised.
-    // Feed this data into the stream ring buffer.
-    if(streamSMState == STREAM_SM_DATA_READY){
-        // Stream length - stream offset = remaining length
-        streamOffset += stream_feed(&stream, streamBuffer, feedLength);
-        // If we reached the end of the stream, loop back to the start
-        if(streamOffset >= streamLength){
-            streamOffset -= streamLength;
+
+    // Idle:
+    // Start playback of any context that has buffered enough, then give the
+    // drive to the context that is closest to running out of data, provided
+    // nothing else is using it.
+    StreamContext *next = 0;
+    uint32_t nextUrgency = 0;
+
+    for(StreamContext *ctx = streamContexts; ctx; ctx = ctx->next){
+        Stream   *stream = &ctx->stream;
+        uint32_t urgency;
+
+        // Start playing once the ring buffer is half full, so that reads for
+        // the menu have some time to complete before the music runs out.
+        if(
+            (ctx->state == STREAM_SM_IDLE) && ctx->playRequested &&
+            !stream_isPlaying(stream) &&
+            (stream->_bufferedChunks >= stream->numChunks / 2)
+        ){
+            stream_start(stream, ctx->volume, ctx->volume);
+            ctx->playRequested = false;
+        }
+
+        if(stream_getUrgency(ctx, &urgency) && (!next || (urgency < nextUrgency))){
+            next        = ctx;
+            nextUrgency = urgency;
         }
-        streamSMState = STREAM_SM_IDLE;
     }
-}
\ No newline at end of file
+
+    if(next && isCDROMReadDone()){
+        streamReading = next;
+        stream_startRead(next);
+    }
+}
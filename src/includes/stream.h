@@ -6,13 +6,30 @@
 // TODO:
 // Do most of these stream_ functions really need to be public?
 
+// A warning is counted whenever playback moves on to a new chunk with fewer
+// than this many chunks left in the buffer.
+#define STREAM_NEAR_UNDERRUN_CHUNKS 2
+
+// Maximum number of streams playing at the same time.
+#define STREAM_MAX_PLAYING 4
+
 /* Stream Class */
 typedef struct Stream{
     uint32_t _channelMask;
     uint16_t _head, _tail, _bufferedChunks;
+    bool     _stalled;
+    uint32_t _tailFill, _playedChunks;
+
+    // Chunk length and time at which playback is expected to reach the head
+    // chunk, in horizontal blanking periods (see stream_handleSPUInterrupt()).
+    uint16_t _chunkTicks, _boundaryTime;
 
     uint32_t offset;
     uint16_t interleave, numChunks, sampleRate, channels;
+
+    // Number of times the buffer ran dry, or nearly did. Never reset, only
+    // meant for diagnostics and for the buffering policy to react to.
+    uint16_t underruns, nearUnderruns;
 } Stream;
 
 static inline size_t stream_getChunkLength(Stream *_stream) {
@@ -30,14 +47,13 @@ static inline size_t stream_getFreeChunkCount(Stream *stream){
 static inline uint32_t stream_getChunkOffset(Stream *stream, size_t chunk) {
     return stream->offset + stream_getChunkLength(stream) * chunk;
 }
-void stream_configureIRQ(Stream *stream);
 
 
-ChannelMask stream_startWithChannelMask(uint16_t left, uint16_t right, ChannelMask mask);
+ChannelMask stream_startWithChannelMask(Stream *stream, uint16_t left, uint16_t right, ChannelMask mask);
 
-static inline ChannelMask stream_start(Stream *stream, uint16_t left, uint16_t right){
-    return stream_startWithChannelMask(left, right, getFreeChannels(NUM_CHANNELS));
-}
+/// @brief Start playback on voices reserved from the voice allocator, which
+/// are released when the stream is stopped.
+ChannelMask stream_start(Stream *stream, uint16_t left, uint16_t right);
 static inline bool stream_isPlaying(Stream *stream){
     __atomic_signal_fence(__ATOMIC_ACQUIRE);
 
@@ -46,7 +62,7 @@ static inline bool stream_isPlaying(Stream *stream){
 static inline bool stream_isUnderrun(Stream *stream){
     __atomic_signal_fence(__ATOMIC_ACQUIRE);
 
-    return !stream->_bufferedChunks;
+    return stream->_stalled || !stream->_bufferedChunks;
 }
 
 
@@ -54,35 +70,79 @@ void stream_create(Stream *stream);
 bool stream_initFromVAGHeader(Stream *stream, const VAGHeader *vagHeader, uint32_t _offset, size_t _numChunks);
 
 void stream_stop(Stream *stream);
-void stream_handleInterrupt(Stream *stream);
+
+/// @brief Handle the SPU IRQ on behalf of all playing streams. The IRQ is
+/// armed for the chunk boundary expected to come first; the stream it fired
+/// for is told apart from the others by the address it was armed for.
+void stream_handleSPUInterrupt(void);
 
 size_t stream_feed(Stream *stream, const void *data, size_t length);
+
+/// @brief Same as stream_feed(), but without waiting for the upload to finish.
+/// Only meant to be called from an IRQ handler.
+/// @param done Set once the data has been uploaded and may be overwritten.
+size_t stream_feedFromIRQ(Stream *stream, const void *data, size_t length, volatile bool *done);
 void stream_resetBuffer(Stream *stream);
 
 /* Stream State Machine*/
 
-// This needs to be accessible by things like IRQ for now.
-// Users can also access it if needed, but there shouldn't be many reasons to.
-extern Stream stream;
-
-
 typedef enum{
-	STREAM_SM_IDLE          = 0,
-	STREAM_SM_WAIT_FOR_DATA = 1,
-    STREAM_SM_DATA_READY    = 2
+	STREAM_SM_IDLE            = 0,
+	STREAM_SM_WAIT_FOR_DATA   = 1,
+    STREAM_SM_DATA_READY      = 2,
+    STREAM_SM_STOPPED         = 3,
+    STREAM_SM_LOAD_HEADER     = 4,
+    STREAM_SM_WAIT_FOR_HEADER = 5
 } StreamStateMachineState;
 
-// TODO:
-// Is this function necessary?
-void stream_init(void);
+// A stream context pairs a ring buffer with the state needed to keep it fed
+// from a file on the disc. Any number of contexts can be created (e.g. music
+// plus an ambient loop); stream_update() shares the drive between them.
+typedef struct StreamContext{
+    Stream stream;
+
+    StreamStateMachineState state;
+    SPUBlock ringBlock;
+    uint32_t lba;
+    size_t   length, offset;
+    int      numChunks, chunkLength, feedLength;
+
+    volatile int readSkip, readRemaining;
+
+    bool     playRequested;
+    uint16_t volume;
+
+    // Buffering policy, see stream_update().
+    int      refillChunks, margin, latency;
+    bool     readWanted;
+    uint32_t readStartChunk;
+    uint16_t readWarnings;
 
-/// @brief Load the VAG header and prepare for song streaming
+    struct StreamContext *next;
+} StreamContext;
+
+/// @brief Initialise a context and register it with stream_update(). Must be
+/// called once before any other streamContext_ function.
+void streamContext_create(StreamContext *ctx);
+
+/// @brief Start loading a song in the background. Nothing is read until
+/// stream_update() is called and the drive is free.
 /// @param name File path of the song.
+/// @param numChunks Size of the SPU ring buffer, in chunks.
 /// @return Zero or Error code.
-size_t stream_loadSong(const char *name);
+size_t streamContext_loadSong(StreamContext *ctx, const char *name, int numChunks);
+
+/// @brief Start playback at the given volume as soon as enough of the song
+/// has been buffered.
+void streamContext_play(StreamContext *ctx, uint16_t volume);
+
+/// @brief Stop playback and any further reads, and free the SPU RAM used by
+/// the ring buffer.
+void streamContext_stop(StreamContext *ctx);
 
-/// @brief UNUSED
-void stream_play(void);
+/// @brief Stop all contexts, e.g. before booting a game.
+void stream_stopAll(void);
 
-/// @brief Update the stream state machine. Will feed more data to the ring buffer if required.
+/// @brief Update the state machines of all contexts. Will feed more data to the ring buffers if required.
+/// Never waits for the drive; reads are only started when no other read is in progress.
 void stream_update(void);
@@ -23,6 +23,10 @@ static inline int min(int a, int b){
 	return (a < b) ? a : b;
 }
 
+static inline int max(int a, int b){
+	return (a > b) ? a : b;
+}
+
 /**
  * @brief Read-only pointer to the currently running thread.
  */
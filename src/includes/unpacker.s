@@ -0,0 +1,135 @@
+.set noreorder
+.set noat
+
+## Self-extracting executable stub
+
+# This stub is prepended to the LZ4 compressed image of the loader by
+# packExecutable.py. It is position independent, as the packer places it (along
+# with the compressed data) right after the area the image is unpacked into,
+# wherever that happens to be. Once the image has been unpacked the instruction
+# cache is flushed and control is passed to the loader's entry point.
+
+.set params, $s0
+.set src,    $a0
+.set dst,    $a1
+.set dstEnd, $a2
+.set token,  $t0
+.set length, $t1
+.set value,  $t2
+.set match,  $t3
+.set temp,   $t4
+.set max15,  $t5
+.set max255, $t6
+
+.set BIOS_A_TABLE,   0xa0
+.set BIOS_FLUSH_CACHE, 0x44
+
+.section .text._start, "ax", @progbits
+.global _start
+.type _start, @function
+
+_start:
+	# Find out where the parameter block is by taking the address of a label
+	# through a branch-and-link, as absolute addresses can't be used here.
+	bal   .Lbase
+	nop
+.Lbase:
+	addiu params, $ra, _unpackerParams - .Lbase
+
+	lw    dst, 4(params)
+	addiu src, params, 12
+	lw    length, 0(src) # Uncompressed length
+	addiu src, 4
+	li    max15, 15
+	li    max255, 255
+	addu  dstEnd, dst, length
+
+.Lsequence:
+	# Each sequence starts with a token holding the number of literals in its
+	# upper nibble and the match length (minus 4) in the lower one. A nibble
+	# value of 15 means additional length bytes follow.
+	lbu   token, 0(src)
+	addiu src, 1
+	srl   length, token, 4
+
+	bne   length, max15, .LcopyLiterals
+	nop
+
+.LliteralLength:
+	lbu   value, 0(src)
+	addiu src, 1
+	beq   value, max255, .LliteralLength
+	addu  length, value
+
+.LcopyLiterals:
+	beqz  length, .LcheckEnd
+	nop
+
+.LliteralLoop:
+	lbu   value, 0(src)
+	addiu src, 1
+	addiu length, -1
+	sb    value, 0(dst)
+	bnez  length, .LliteralLoop
+	addiu dst, 1
+
+.LcheckEnd:
+	# The last sequence only contains literals, so the image is done once the
+	# output pointer has reached the end.
+	sltu  temp, dst, dstEnd
+	beqz  temp, .Ldone
+	nop
+
+	lbu   value, 0(src)
+	lbu   temp, 1(src)
+	addiu src, 2
+	sll   temp, 8
+	or    value, temp
+	subu  match, dst, value
+
+	andi  length, token, 15
+	bne   length, max15, .LcopyMatch
+	nop
+
+.LmatchLength:
+	lbu   value, 0(src)
+	addiu src, 1
+	beq   value, max255, .LmatchLength
+	addu  length, value
+
+.LcopyMatch:
+	# Matches may overlap the bytes they produce, so they are always copied
+	# one byte at a time.
+	addiu length, 4
+
+.LmatchLoop:
+	lbu   value, 0(match)
+	addiu match, 1
+	addiu length, -1
+	sb    value, 0(dst)
+	bnez  length, .LmatchLoop
+	addiu dst, 1
+
+	b     .Lsequence
+	nop
+
+.Ldone:
+	# Flush the instruction cache through the BIOS (the same function grabbed
+	# by installExceptionHandler()), as it may still hold code from before the
+	# image was unpacked. $s0 is preserved across the call.
+	li    temp, BIOS_A_TABLE
+	jalr  temp
+	li    $t1, BIOS_FLUSH_CACHE
+
+	lw    temp, 8(params)
+	move  $a0, $0
+	jr    temp
+	move  $a1, $0
+
+.balign 4
+_unpackerParams:
+	# Filled in by packExecutable.py, immediately followed by the compressed
+	# image in the format generated by compressData.py.
+	.word 0x4b43504c # Magic ("LPCK")
+	.word 0          # Load address
+	.word 0          # Entry point
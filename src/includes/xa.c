@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include "ps1/cdrom.h"
+#include "ps1/registers.h"
+#include "cdrom.h"
+#include "filesystem.h"
+#include "system.h"
+#include "xa.h"
+
+typedef struct XAState{
+    bool     playing;
+    uint8_t  channel;
+    uint32_t start, end, position;
+
+    // Value of cdromReadCount when playback was last (re)started. Any other
+    // read started since then has taken the drive over.
+    uint32_t readCount;
+    int      pollCounter, idleCounter;
+} XAState;
+
+static XAState xa;
+
+static void xa_startAt(uint32_t lba){
+    CDROMMSF msf;
+    uint8_t  filter[] = {XA_FILE_NUMBER, xa.channel};
+    uint8_t  mode     = 0
+        | CDROM_MODE_XA_FILTER
+        | CDROM_MODE_SIZE_2340
+        | CDROM_MODE_XA_ADPCM
+        | CDROM_MODE_SPEED_2X;
+
+    waitForCDROMRead();
+
+    issueCDROMCommand(CDROM_CMD_SETFILTER, filter, sizeof(filter));
+    waitForINT3();
+    issueCDROMCommand(CDROM_CMD_SETMODE, &mode, sizeof(mode));
+    waitForINT3();
+
+    cdrom_convertLBAToMSF(&msf, lba);
+    issueCDROMCommand(CDROM_CMD_SETLOC, (const uint8_t *) &msf, sizeof(msf));
+    waitForINT3();
+
+    // Audio sectors can't be re-read in time anyway, so use the real-time read
+    // command, which doesn't retry on errors.
+    issueCDROMCommand(CDROM_CMD_READ_S, NULL, 0);
+    waitForINT3();
+
+    xa.position    = lba;
+    xa.readCount   = cdromReadCount;
+    xa.pollCounter = 0;
+    xa.idleCounter = 0;
+}
+
+int xa_play(const char *name, uint8_t channel, uint16_t volume){
+    DirectoryEntry entry;
+
+    if(!getFileInfo(name, &entry)){
+        // File not found error.
+        return 1;
+    }
+
+    xa.playing = true;
+    xa.channel = channel;
+    xa.start   = entry.lba;
+    xa.end     = entry.lba + (entry.length + 2047) / 2048;
+
+    // SPU_CTRL is also written when SPU DMA transfers are started from the
+    // DMA IRQ handler.
+    bool reenableInterrupts = disableInterrupts();
+
+    SPU_CDDA_VOL_L = volume;
+    SPU_CDDA_VOL_R = volume;
+    SPU_CTRL      |= SPU_CTRL_CDDA;
+
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
+
+    waitForCDROMRead();
+    issueCDROMCommand(CDROM_CMD_DEMUTE, NULL, 0);
+    waitForINT3();
+
+    xa_startAt(xa.start);
+    return 0;
+}
+
+void xa_stop(void){
+    if(!xa.playing){
+        return;
+    }
+
+    xa.playing = false;
+
+    // Only pause the drive if no other read has taken it over in the meantime.
+    if(xa.readCount == cdromReadCount){
+        issueCDROMCommand(CDROM_CMD_PAUSE, NULL, 0);
+        waitForINT3();
+    }
+
+    bool reenableInterrupts = disableInterrupts();
+
+    SPU_CTRL      &= ~SPU_CTRL_CDDA;
+    SPU_CDDA_VOL_L = 0;
+    SPU_CDDA_VOL_R = 0;
+
+    if(reenableInterrupts){
+        enableInterrupts();
+    }
+}
+
+bool xa_isPlaying(void){
+    return xa.playing;
+}
+
+void xa_update(void){
+    if(!xa.playing){
+        return;
+    }
+
+    if(xa.readCount != cdromReadCount){
+        if(!isCDROMReadDone()){
+            xa.idleCounter = 0;
+            return;
+        }
+        if(++xa.idleCounter < XA_RESUME_DELAY){
+            return;
+        }
+
+        // Pick up from the last known position, which repeats at most a few
+        // frames' worth of audio.
+        xa_startAt(xa.position);
+        return;
+    }
+
+    if(++xa.pollCounter < XA_POLL_INTERVAL){
+        return;
+    }
+    xa.pollCounter = 0;
+
+    issueCDROMCommand(CDROM_CMD_GETLOC_P, NULL, 0);
+    waitForINT3();
+
+    if(!waitingForInt5){
+        // GetlocP fails while the drive is still seeking.
+        return;
+    }
+
+    const CDROMGetlocPResult *result = (const CDROMGetlocPResult *) cdromResponse;
+    uint32_t lba = cdrom_convertMSFToLBA(&result->absoluteMSF);
+
+    if((lba + XA_LOOP_MARGIN) >= xa.end){
+        xa_startAt(xa.start);
+    } else if(lba >= xa.start){
+        xa.position = lba;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// XA-ADPCM audio is decoded by the CD-ROM drive itself and mixed into the SPU
+// through its CD audio input, so playing it takes no CPU time, SPU RAM or
+// voices. An XA file holds several channels interleaved sector by sector (see
+// interleaveXA.py), only one of which is played at a time.
+//
+// The drive is shared with everything else: any read started while XA audio is
+// playing takes the drive over, and xa_update() resumes playback from about
+// where it was once the drive has been idle for a few frames.
+
+// File number written into the sector headers by interleaveXA.py.
+#define XA_FILE_NUMBER 1
+
+// The playback position is polled every XA_POLL_INTERVAL calls to
+// xa_update(), and the file is looped once it gets within XA_LOOP_MARGIN
+// sectors of its end (playback runs at 150 sectors per second).
+#define XA_POLL_INTERVAL 8
+#define XA_LOOP_MARGIN   32
+
+// Number of xa_update() calls the drive must be left idle for before playback
+// is resumed, so that back-to-back reads don't cause it to restart each time.
+#define XA_RESUME_DELAY 4
+
+/// @brief Start playing a channel of an XA file, looping it forever.
+/// @param name File path of the XA file.
+/// @param channel Channel to play, 0-31.
+/// @param volume CD audio volume in the SPU mixer, up to 0x7fff.
+/// @return Zero or Error code.
+int xa_play(const char *name, uint8_t channel, uint16_t volume);
+
+/// @brief Stop playback and mute the SPU's CD audio input.
+void xa_stop(void);
+
+bool xa_isPlaying(void);
+
+/// @brief Loop playback at the end of the file, and resume it after other reads.
+/// Must be called once per frame.
+void xa_update(void);
@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "controller.h"
+#include "input.h"
+#include "sio.h"
+
+static const InputRepeatConfig _defaultRepeat = {
+	.mask         = 0
+		| BUTTON_MASK_UP
+		| BUTTON_MASK_DOWN
+		| BUTTON_MASK_LEFT
+		| BUTTON_MASK_RIGHT,
+	.delay        = 20,
+	.interval     = 6,
+	.minInterval  = 1,
+	.accelRepeats = 8,
+	.maxStep      = 16
+};
+
+static InputRepeatConfig _repeat;
+static InputState        _pads[INPUT_NUM_PADS];
+
+// Poll packets are sent in the background. Each frame collects the response
+// to the previous frame's poll and immediately queues the next one, so input
+// lags behind by at most a frame but the main loop never waits on the bus.
+static SIOTransfer _transfers[INPUT_NUM_PORTS];
+static uint8_t     _requests[INPUT_NUM_PORTS][POLL_REQUEST_LENGTH];
+static uint8_t     _responses[INPUT_NUM_PORTS][POLL_RESPONSE_LENGTH];
+
+static void _resetRepeat(InputState *state) {
+	state->step        = 1;
+	state->timer       = 0;
+	state->interval    = _repeat.interval;
+	state->repeatCount = 0;
+}
+
+void input_init(void) {
+	memset(_pads, 0, sizeof(_pads));
+	input_setRepeat(&_defaultRepeat);
+
+	for (int i = 0; i < INPUT_NUM_PORTS; i++) {
+		setupPollRequest(_requests[i]);
+		sio_setupTransfer(
+			&_transfers[i], i, ADDR_CONTROLLER, _requests[i], _responses[i],
+			POLL_REQUEST_LENGTH, POLL_RESPONSE_LENGTH
+		);
+		sio_submit(&_transfers[i]);
+	}
+}
+
+void input_setRepeat(const InputRepeatConfig *config) {
+	_repeat = *config;
+
+	for (int i = 0; i < INPUT_NUM_PADS; i++)
+		_resetRepeat(&_pads[i]);
+}
+
+static void _updateRepeat(InputState *state) {
+	uint16_t held = state->current & _repeat.mask;
+
+	state->repeated = state->pressed;
+
+	// Any change to the set of held buttons (including releasing all of them)
+	// restarts the delay, so that e.g. switching from down to up doesn't carry
+	// the acceleration over.
+	if (!held || (held != (state->previous & _repeat.mask))) {
+		_resetRepeat(state);
+		return;
+	}
+
+	uint8_t wait = state->repeatCount ? state->interval : _repeat.delay;
+
+	if (++state->timer < wait)
+		return;
+
+	state->timer     = 0;
+	state->repeated |= held;
+
+	state->repeatCount++;
+
+	if (!_repeat.accelRepeats || (state->repeatCount % _repeat.accelRepeats))
+		return;
+
+	if (state->interval > _repeat.minInterval) {
+		state->interval /= 2;
+
+		if (state->interval < _repeat.minInterval)
+			state->interval = _repeat.minInterval;
+	} else if (state->step < _repeat.maxStep) {
+		state->step *= 2;
+	}
+}
+
+static void _updatePad(InputState *state, const ControllerData *data) {
+	state->connected = data->connected;
+	state->type      = data->type;
+	state->leftX     = data->leftX;
+	state->leftY     = data->leftY;
+	state->rightX    = data->rightX;
+	state->rightY    = data->rightY;
+	state->current   = data->buttons;
+}
+
+void input_update(void) {
+	for (int i = 0; i < INPUT_NUM_PORTS; i++) {
+		InputState  *pads     = &_pads[i * INPUT_SLOTS_PER_PORT];
+		SIOTransfer *transfer = &_transfers[i];
+
+		for (int j = 0; j < INPUT_SLOTS_PER_PORT; j++)
+			pads[j].previous = pads[j].current;
+
+		// If the last poll hasn't completed yet (which should only happen if
+		// the bus is busy with e.g. a memory card transfer), the pads are
+		// assumed not to have changed.
+		if (sio_isDone(transfer)) {
+			ControllerData slots[MULTITAP_SLOTS];
+
+			parsePollResponse(slots, _responses[i], transfer->respLength);
+
+			for (int j = 0; j < INPUT_SLOTS_PER_PORT; j++)
+				_updatePad(&pads[j], &slots[j]);
+
+			sio_submit(transfer);
+		}
+
+		for (int j = 0; j < INPUT_SLOTS_PER_PORT; j++) {
+			InputState *state = &pads[j];
+
+			state->pressed  = state->current & ~state->previous;
+			state->released = state->previous & ~state->current;
+
+			_updateRepeat(state);
+		}
+	}
+}
+
+const InputState *input_getState(int pad) {
+	return &_pads[pad];
+}
+
+int input_getAxisSpeed(int8_t axis, int maxSpeed) {
+	int value = axis;
+	int sign  = 1;
+
+	if (value < 0) {
+		value = -value;
+		sign  = -1;
+	}
+	if (value <= INPUT_AXIS_DEADZONE)
+		return 0;
+
+	// Rescale the deflection outside of the dead zone to 0-127, then square
+	// it.
+	int range = 128 - INPUT_AXIS_DEADZONE;
+
+	value = ((value - INPUT_AXIS_DEADZONE) * 127) / range;
+
+	return (sign * maxSpeed * value * value) / (127 * 127);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Each port may have a multitap plugged in, so up to 4 pads are tracked per
+// port. Pad N is connected to port (N / 4), slot (N % 4); without a multitap
+// only slot 0 is ever connected.
+#define INPUT_NUM_PORTS      2
+#define INPUT_SLOTS_PER_PORT 4
+#define INPUT_NUM_PADS       (INPUT_NUM_PORTS * INPUT_SLOTS_PER_PORT)
+
+// Stick deflection (out of 128) below which an axis is considered centered.
+#define INPUT_AXIS_DEADZONE 24
+
+// Auto-repeat settings. Held buttons in the mask repeat after an initial
+// delay; every accelRepeats repeats the interval between them is halved until
+// it reaches minInterval, after which the step (the number of items a single
+// repeat should move by) is doubled instead until it reaches maxStep. All
+// times are in frames.
+typedef struct {
+	uint16_t mask;
+	uint8_t  delay, interval, minInterval;
+	uint8_t  accelRepeats, maxStep;
+} InputRepeatConfig;
+
+typedef struct {
+	bool     connected;
+	uint8_t  type; // ControllerType
+	int8_t   leftX, leftY, rightX, rightY;
+
+	uint16_t current, previous;
+	uint16_t pressed, released;
+
+	// Buttons that were either pressed or auto-repeated this frame, and how
+	// many items they should move a selection by.
+	uint16_t repeated;
+	uint8_t  step;
+
+	// Auto-repeat state, only meaningful while a button in the mask is held.
+	uint8_t  timer, interval;
+	uint16_t repeatCount;
+} InputState;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Reset the state of all pads and restore the default auto-repeat
+/// settings. Must be called after initControllerBus().
+void input_init(void);
+
+/// @brief Replace the auto-repeat settings for all pads.
+void input_setRepeat(const InputRepeatConfig *config);
+
+/// @brief Poll each port once and update the state of all pads. Must be
+/// called exactly once per frame, before any input_getState() call.
+void input_update(void);
+
+/// @brief Return the state of a pad as of the last input_update() call.
+const InputState *input_getState(int pad);
+
+/// @brief Map an analog axis to a signed speed, with a dead zone around the
+/// center and a quadratic curve for finer control at small deflections.
+/// @return Speed in the range [-maxSpeed, maxSpeed].
+int input_getAxisSpeed(int8_t axis, int maxSpeed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -45,215 +45,161 @@
 #include "includes/cdrom.h"
 #include "includes/filesystem.h"
 #include "includes/irq.h"
+#include "includes/lz4.h"
+#include "includes/mdec.h"
+#include "includes/stream.h"
+#include "includes/xa.h"
 #include "gpu.h"
+#include "vram.h"
+#include "cover.h"
+#include "font.h"
+#include "fontSmall.h"
+#include "fontLarge.h"
 #include "controller.h"
+#include "input.h"
+#include "settings.h"
+#include "quicklist.h"
+#include "picostation.h"
 #include "includes/system.h"
 #include <ctype.h>
 
 
-// In order to pick sprites (characters) out of our spritesheet, we need a table
-// listing all of them (in ASCII order in this case) with their UV coordinates
-// within the sheet as well as their dimensions. In this example we're going to
-// hardcode the table, however in an actual game you may want to store this data
-// in the same file as the image and palette data.
-typedef struct {
-	uint8_t x, y, width, height;
-} SpriteInfo;
-
-static const SpriteInfo fontSprites[] = {
-	{ .x =  6, .y =  0, .width = 2, .height = 9 }, // !
-	{ .x = 12, .y =  0, .width = 4, .height = 9 }, // "
-	{ .x = 18, .y =  0, .width = 6, .height = 9 }, // #
-	{ .x = 24, .y =  0, .width = 6, .height = 9 }, // $
-	{ .x = 30, .y =  0, .width = 6, .height = 9 }, // %
-	{ .x = 36, .y =  0, .width = 6, .height = 9 }, // &
-	{ .x = 42, .y =  0, .width = 2, .height = 9 }, // '
-	{ .x = 48, .y =  0, .width = 3, .height = 9 }, // (
-	{ .x = 54, .y =  0, .width = 3, .height = 9 }, // )
-	{ .x = 60, .y =  0, .width = 4, .height = 9 }, // *
-	{ .x = 66, .y =  0, .width = 6, .height = 9 }, // +
-	{ .x = 72, .y =  0, .width = 3, .height = 9 }, // ,
-	{ .x = 78, .y =  0, .width = 6, .height = 9 }, // -
-	{ .x = 84, .y =  0, .width = 2, .height = 9 }, // .
-	{ .x = 90, .y =  0, .width = 6, .height = 9 }, // /
-	{ .x =  0, .y =  9, .width = 6, .height = 9 }, // 0
-	{ .x =  6, .y =  9, .width = 6, .height = 9 }, // 1
-	{ .x = 12, .y =  9, .width = 6, .height = 9 }, // 2
-	{ .x = 18, .y =  9, .width = 6, .height = 9 }, // 3
-	{ .x = 24, .y =  9, .width = 6, .height = 9 }, // 4
-	{ .x = 30, .y =  9, .width = 6, .height = 9 }, // 5
-	{ .x = 36, .y =  9, .width = 6, .height = 9 }, // 6
-	{ .x = 42, .y =  9, .width = 6, .height = 9 }, // 7
-	{ .x = 48, .y =  9, .width = 6, .height = 9 }, // 8
-	{ .x = 54, .y =  9, .width = 6, .height = 9 }, // 9
-	{ .x = 60, .y =  9, .width = 2, .height = 9 }, // :
-	{ .x = 66, .y =  9, .width = 3, .height = 9 }, // ;
-	{ .x = 72, .y =  9, .width = 6, .height = 9 }, // <
-	{ .x = 78, .y =  9, .width = 6, .height = 9 }, // =
-	{ .x = 84, .y =  9, .width = 6, .height = 9 }, // >
-	{ .x = 90, .y =  9, .width = 6, .height = 9 }, // ?
-	{ .x =  0, .y = 18, .width = 6, .height = 9 }, // @
-	{ .x =  6, .y = 18, .width = 6, .height = 9 }, // A
-	{ .x = 12, .y = 18, .width = 6, .height = 9 }, // B
-	{ .x = 18, .y = 18, .width = 6, .height = 9 }, // C
-	{ .x = 24, .y = 18, .width = 6, .height = 9 }, // D
-	{ .x = 30, .y = 18, .width = 6, .height = 9 }, // E
-	{ .x = 36, .y = 18, .width = 6, .height = 9 }, // F
-	{ .x = 42, .y = 18, .width = 6, .height = 9 }, // G
-	{ .x = 48, .y = 18, .width = 6, .height = 9 }, // H
-	{ .x = 54, .y = 18, .width = 4, .height = 9 }, // I
-	{ .x = 60, .y = 18, .width = 5, .height = 9 }, // J
-	{ .x = 66, .y = 18, .width = 6, .height = 9 }, // K
-	{ .x = 72, .y = 18, .width = 6, .height = 9 }, // L
-	{ .x = 78, .y = 18, .width = 6, .height = 9 }, // M
-	{ .x = 84, .y = 18, .width = 6, .height = 9 }, // N
-	{ .x = 90, .y = 18, .width = 6, .height = 9 }, // O
-	{ .x =  0, .y = 27, .width = 6, .height = 9 }, // P
-	{ .x =  6, .y = 27, .width = 6, .height = 9 }, // Q
-	{ .x = 12, .y = 27, .width = 6, .height = 9 }, // R
-	{ .x = 18, .y = 27, .width = 6, .height = 9 }, // S
-	{ .x = 24, .y = 27, .width = 6, .height = 9 }, // T
-	{ .x = 30, .y = 27, .width = 6, .height = 9 }, // U
-	{ .x = 36, .y = 27, .width = 6, .height = 9 }, // V
-	{ .x = 42, .y = 27, .width = 6, .height = 9 }, // W
-	{ .x = 48, .y = 27, .width = 6, .height = 9 }, // X
-	{ .x = 54, .y = 27, .width = 6, .height = 9 }, // Y
-	{ .x = 60, .y = 27, .width = 6, .height = 9 }, // Z
-	{ .x = 66, .y = 27, .width = 3, .height = 9 }, // [
-	{ .x = 72, .y = 27, .width = 6, .height = 9 }, // Backslash
-	{ .x = 78, .y = 27, .width = 3, .height = 9 }, // ]
-	{ .x = 84, .y = 27, .width = 4, .height = 9 }, // ^
-	{ .x = 90, .y = 27, .width = 6, .height = 9 }, // _
-	{ .x =  0, .y = 36, .width = 3, .height = 9 }, // `
-	{ .x =  6, .y = 36, .width = 6, .height = 9 }, // a
-	{ .x = 12, .y = 36, .width = 6, .height = 9 }, // b
-	{ .x = 18, .y = 36, .width = 6, .height = 9 }, // c
-	{ .x = 24, .y = 36, .width = 6, .height = 9 }, // d
-	{ .x = 30, .y = 36, .width = 6, .height = 9 }, // e
-	{ .x = 36, .y = 36, .width = 5, .height = 9 }, // f
-	{ .x = 42, .y = 36, .width = 6, .height = 9 }, // g
-	{ .x = 48, .y = 36, .width = 5, .height = 9 }, // h
-	{ .x = 54, .y = 36, .width = 2, .height = 9 }, // i
-	{ .x = 60, .y = 36, .width = 4, .height = 9 }, // j
-	{ .x = 66, .y = 36, .width = 5, .height = 9 }, // k
-	{ .x = 72, .y = 36, .width = 2, .height = 9 }, // l
-	{ .x = 78, .y = 36, .width = 6, .height = 9 }, // m
-	{ .x = 84, .y = 36, .width = 5, .height = 9 }, // n
-	{ .x = 90, .y = 36, .width = 6, .height = 9 }, // o
-	{ .x =  0, .y = 45, .width = 6, .height = 9 }, // p
-	{ .x =  6, .y = 45, .width = 6, .height = 9 }, // q
-	{ .x = 12, .y = 45, .width = 6, .height = 9 }, // r
-	{ .x = 18, .y = 45, .width = 6, .height = 9 }, // s
-	{ .x = 24, .y = 45, .width = 5, .height = 9 }, // t
-	{ .x = 30, .y = 45, .width = 5, .height = 9 }, // u
-	{ .x = 36, .y = 45, .width = 6, .height = 9 }, // v
-	{ .x = 42, .y = 45, .width = 6, .height = 9 }, // w
-	{ .x = 48, .y = 45, .width = 6, .height = 9 }, // x
-	{ .x = 54, .y = 45, .width = 6, .height = 9 }, // y
-	{ .x = 60, .y = 45, .width = 5, .height = 9 }, // z
-	{ .x = 66, .y = 45, .width = 4, .height = 9 }, // {
-	{ .x = 72, .y = 45, .width = 2, .height = 9 }, // |
-	{ .x = 78, .y = 45, .width = 4, .height = 9 }, // }
-	{ .x = 84, .y = 45, .width = 6, .height = 9 }, // ~
-	{ .x = 90, .y = 45, .width = 6, .height = 9 },  // Invalid character
-	{ .x =  0, .y = 54, .width =  6, .height = 9 }, // 
-    { .x =  6, .y = 54, .width =  6, .height = 9 }, // 
-    { .x = 12, .y = 54, .width =  4, .height = 9 }, // 
-    { .x = 18, .y = 54, .width =  4, .height = 9 }, // 
-    { .x = 24, .y = 54, .width =  6, .height = 9 }, // 
-    { .x = 30, .y = 54, .width =  6, .height = 9 }, // 
-    { .x = 36, .y = 54, .width =  6, .height = 9 }, // 
-    { .x = 42, .y = 54, .width =  6, .height = 9 }, // 
-    { .x =  0, .y = 63, .width =  7, .height =  9 }, // 
-    { .x = 12, .y = 63, .width =  7, .height =  9 }, // 
-    { .x = 24, .y = 63, .width =  9, .height =  9 }, // 
-    { .x = 36, .y = 63, .width =  8, .height = 10 }, // 
-    { .x = 48, .y = 63, .width = 11, .height = 10 }, // 
-    { .x = 60, .y = 63, .width = 12, .height = 10 }, // 
-    { .x = 72, .y = 63, .width = 14, .height =  9 }, // 
-    { .x =  0, .y = 73, .width = 10, .height = 10 }, //
-    { .x = 12, .y = 73, .width = 10, .height = 10 }, // 
-    { .x = 24, .y = 73, .width = 10, .height = 10 }, // 
-    { .x = 36, .y = 73, .width = 10, .height =  9}, // 
-    { .x = 48, .y = 73, .width = 10, .height =  9}, // 
-    { .x = 60, .y = 73, .width = 10, .height = 10},  //
-	{ .x = 72, .y = 73, .width = 10, .height = 10},  //
-	{ .x = 85, .y = 73, .width = 8, .height = 8}  //
-};
-
-#define FONT_FIRST_TABLE_CHAR '!'
-#define FONT_SPACE_WIDTH      4
-#define FONT_TAB_WIDTH        32
-#define FONT_LINE_HEIGHT      10
-
-static void printString(
-	DMAChain *chain, const TextureInfo *font, int x, int y, const char *str
-) {
-	int currentX = x, currentY = y;
-
-	uint32_t *ptr;
-
-	// Start by sending a texpage command to tell the GPU to use the font's
-	// spritesheet. Note that the texpage command before a drawing command can
-	// be omitted when reusing the same texture, so sending it here just once is
-	// enough.
-	ptr    = allocatePacket(chain, 1);
-	ptr[0] = gp0_texpage(font->page, false, false);
-
-	// Iterate over every character in the string.
-	for (; *str; str++) {
-		uint8_t ch = (uint8_t) *str;
-
-		// Check if the character is "special" and shall be handled without
-		// drawing any sprite, or if it's invalid and should be rendered as a
-		// box with a question mark (character code 127).
-		switch (ch) {
-			case '\t':
-				currentX += FONT_TAB_WIDTH - 1;
-				currentX -= currentX % FONT_TAB_WIDTH;
-				continue;
-
-			case '\n':
-				currentX  = x;
-				currentY += FONT_LINE_HEIGHT;
-				continue;
-
-			case ' ':
-				currentX += FONT_SPACE_WIDTH;
-				continue;
-		}
-		if (ch >= 0x99 && ch <= 0xFF) {
-        	ch = '\x7f'; 
-    	}
+// The menu can optionally be built to run at 640x480 (see MENU_HIRES in
+// CMakeLists.txt). There is not enough VRAM for two interlaced framebuffers
+// alongside the textures, so in that mode a single framebuffer is used and the
+// GPU is relied upon to only draw the field that is not being displayed.
+#ifdef MENU_HIRES
+#define SCREEN_WIDTH      640
+#define SCREEN_HEIGHT     480
+#define FRAMEBUFFER_COUNT 1
+#else
+#define SCREEN_WIDTH      320
+#define SCREEN_HEIGHT     240
+#define FRAMEBUFFER_COUNT 2
+#endif
+#define COVER_ROW_SIZE   9
+
+// Rows per second scrolled with the analog stick fully deflected.
+#define SCROLL_MAX_SPEED 240
+
+// Background music is played from the loader's own disc image, if present:
+// preferably as XA audio decoded by the drive, otherwise streamed through SPU
+// RAM.
+#define MUSIC_XA_FILE    "MENU.XA;1"
+#define MUSIC_XA_CHANNEL 0
+#define MUSIC_FILE   "MENU.VAG;1"
+#define MUSIC_VOLUME 0x2000
+#define MUSIC_CHUNKS 32
+
+static StreamContext music;
+
+// Menu sound effects are loaded from a single bank on the same disc image, if
+// present. Sounds missing from the bank are simply not played.
+#define SOUND_BANK_FILE "SOUNDS.BNK;1"
+#define SOUND_VOLUME    0x2000
+
+static SoundBank uiSounds;
+static int       moveSound = -1, confirmSound = -1, backSound = -1;
+
+// The menu background is decoded by the MDEC from an image on the same disc
+// image, if present, while the menu is already running. It is kept right below
+// the framebuffers and copied over each frame instead of clearing it. There is
+// no room for it next to the single 640x480 framebuffer.
+#ifndef MENU_HIRES
+#define BACKGROUND_FILE "MENUBG.MDI;1"
+#define BACKGROUND_Y    SCREEN_HEIGHT
+
+static MDECImage backgroundImage;
+static void      *backgroundBuffer;
+static bool      backgroundReady;
+
+// Must be called before any textures are placed in VRAM, as the background's
+// area is reserved here.
+static void startBackground(void) {
+	DirectoryEntry entry;
+
+	if (!getFileInfo(BACKGROUND_FILE, &entry))
+		return;
+
+	size_t numSectors = (entry.length + 2047) / 2048;
+
+	backgroundBuffer = malloc(numSectors * 2048);
+	if (!backgroundBuffer)
+		return;
+
+	vram_reserve(0, BACKGROUND_Y, SCREEN_WIDTH, SCREEN_HEIGHT);
+	mdec_startImageFromCD(
+		&backgroundImage, entry.lba, numSectors, backgroundBuffer, 0,
+		BACKGROUND_Y, SCREEN_WIDTH, SCREEN_HEIGHT
+	);
+}
 
-		// If the character was not a tab, newline or space, fetch its
-		// respective entry from the sprite coordinate table.
-		const SpriteInfo *sprite = &fontSprites[ch - FONT_FIRST_TABLE_CHAR];
+static void updateBackground(void) {
+	if (!backgroundBuffer)
+		return;
 
-		// Draw the character, summing the UV coordinates of the spritesheet in
-		// VRAM to those of the sprite itself within the sheet. Enable blending
-		// to make sure any semitransparent pixels in the font get rendered
-		// correctly.
-		ptr    = allocatePacket(chain, 4);
-		ptr[0] = gp0_rectangle(true, true, true);
-		ptr[1] = gp0_xy(currentX, currentY);
-		ptr[2] = gp0_uv(font->u + sprite->x, font->v + sprite->y, font->clut);
-		ptr[3] = gp0_xy(sprite->width, sprite->height);
+	MDECImageState state = mdec_update(&backgroundImage);
 
-		// Move onto the next character.
-		currentX += sprite->width;
-	}
-}
+	if (state == MDEC_IMAGE_BUSY)
+		return;
+
+	// Smaller images would leave part of the screen uncleared.
+	const MDECImageHeader *header =
+		(const MDECImageHeader *) backgroundBuffer;
+
+	backgroundReady = (state == MDEC_IMAGE_DONE) &&
+		(header->width == SCREEN_WIDTH) && (header->height == SCREEN_HEIGHT);
 
+	free(backgroundBuffer);
+	backgroundBuffer = NULL;
+}
+#endif
 
+static void playUISound(int index) {
+	if (index >= 0)
+		sound_play(&uiSounds.sounds[index], SOUND_VOLUME, SOUND_VOLUME);
+}
 
-#define SCREEN_WIDTH     320
-#define SCREEN_HEIGHT    240
-#define FONT_WIDTH       96
-#define FONT_HEIGHT      84
-#define FONT_COLOR_DEPTH GP0_COLOR_4BPP
+// Menu layout. Everything is derived from the screen size and line height, so
+// that the high resolution mode fits about twice as many rows and columns.
+#define ROW_HEIGHT  FONT_SMALL_LINE_HEIGHT
+#define LIST_LEFT   5
+#define LIST_TOP    30
+#define HEADER_Y    (LIST_TOP - ROW_HEIGHT)
+#define FOOTER_Y    (SCREEN_HEIGHT - 28)
+#define LIST_ROWS   ((FOOTER_Y - LIST_TOP) / ROW_HEIGHT)
+#define TEXT_LEFT   (SCREEN_WIDTH / 20)
+#define MESSAGE_X   (SCREEN_WIDTH / 8)
+#define MESSAGE_Y   (SCREEN_HEIGHT / 3)
 
 extern const uint8_t fontTexture[], fontPalette[], logoTexture[], logoPalette[];
+extern const uint8_t fontLargeTexture[], fontLargePalette[];
+
+// Embedded images are LZ4 compressed to keep the executable small. They are
+// unpacked into these buffers, which then serve directly as the DMA source for
+// the VRAM upload. The large font is the largest image.
+static uint32_t assetImageBuffer[(FONT_LARGE_WIDTH * FONT_LARGE_HEIGHT) / 8];
+static uint32_t assetPaletteBuffer[256 / 2];
+
+bool uploadCompressedTexture(
+	TextureInfo *info, const uint8_t *image, const uint8_t *palette, int width,
+	int height, GP0ColorDepth colorDepth
+) {
+	if (
+		(lz4_getDecompressedSize(image) > sizeof(assetImageBuffer)) ||
+		(lz4_getDecompressedSize(palette) > sizeof(assetPaletteBuffer))
+	) {
+		printf("Embedded texture too large\n");
+		return false;
+	}
+
+	lz4_decompress(assetImageBuffer, image);
+	lz4_decompress(assetPaletteBuffer, palette);
+
+	return vram_uploadIndexedTexture(
+		info, assetImageBuffer, assetPaletteBuffer, width, height, colorDepth
+	);
+}
 
 #define MAX_LINES 4096   // Maksimum satır sayısı
 #define MAX_LENGTH 60
@@ -356,13 +302,18 @@ void quickSort(char lines[][MAX_LENGTH], uint16_t indexes[], int low, int high)
 }
 
 
-void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH], int *lineCount, int *firstboot, uint16_t indexes[MAX_LINES]) {
+// Lines are truncated to MAX_LENGTH - 1 characters, so each entry's ID is
+// hashed from its full name as it is received and stored in ids[], indexed by
+// the entry's original (unsorted) position like the Picostation indices.
+void list_and_parse(int LBA, int listingMode, uint32_t parentID, char lines[MAX_LINES][MAX_LENGTH], int *lineCount, int *firstboot, uint16_t indexes[MAX_LINES], uint32_t ids[MAX_LINES]) {
     *lineCount = 0;
     *firstboot = 0;
     int retryAttempt = 0;
 
     char currentLine[MAX_LENGTH];
     int currentPos = 0;
+    uint32_t rootID = picostation_getID(parentID, "");
+    uint32_t currentID = rootID;
     memset(currentLine, 0, sizeof(currentLine));
 
 	const char* startTag = "<starttransfer>";
@@ -372,6 +323,9 @@ void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH],
 
 
     for (int s = 0; s < 450; s++) {
+        // Keep the music fed, as the listing can take a while to transfer.
+        stream_update();
+
         uint16_t sendData = s;
         uint8_t high = (sendData >> 8) & 0xFF;
         uint8_t low  = sendData & 0xFF;
@@ -381,7 +335,6 @@ void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH],
         uint8_t sector[2048];
         memset(sector, 0, sizeof(sector));
         startCDROMRead(LBA, sector, 1, 2048, false, true);
-        printf("sector get,%i,sectordata:\n%s", LBA, sector);
 
 
         if (memcmp(sector, startTag, startTagLen) == 0) {
@@ -391,7 +344,6 @@ void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH],
             s--; // retry
             retryAttempt++;
             if (retryAttempt > 1000) break;
-			printf("No data, retry\n");
         //    delayMicrosecondsBusy(10000);
             continue;
         }
@@ -421,15 +373,18 @@ void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH],
                         strncpy(lines[*lineCount], currentLine, MAX_LENGTH);
                         lines[*lineCount][MAX_LENGTH - 1] = '\0';
                         indexes[*lineCount] = *lineCount;
+                        ids[*lineCount] = currentID;
                         (*lineCount)++;
                     }
 
                     currentPos = 0;
+                    currentID = rootID;
                 }
             } else if (c != '\r') {
                 if (currentPos < MAX_LENGTH - 1) {
                     currentLine[currentPos++] = c;
                 }
+                currentID = picostation_appendID(currentID, c);
             }
         }
 
@@ -447,6 +402,7 @@ void list_and_parse(int LBA, int listingMode, char lines[MAX_LINES][MAX_LENGTH],
             strncpy(lines[*lineCount], currentLine, MAX_LENGTH);
             lines[*lineCount][MAX_LENGTH - 1] = '\0';
             indexes[*lineCount] = *lineCount;
+            ids[*lineCount] = currentID;
             (*lineCount)++;
         }
     }
@@ -506,6 +462,199 @@ void parseLines(char *dataBuffer, char lines[MAX_LINES][MAX_LENGTH], int *lineCo
 
 char games[MAX_LINES][MAX_LENGTH];
 char dirs[MAX_LINES][MAX_LENGTH];
+
+// Pixel widths of the rows in the current listing, measured the first time each
+// row is drawn. -1 means not measured yet.
+#define LIST_RIGHT_MARGIN 5
+
+static int16_t gameWidths[MAX_LINES];
+static int16_t dirWidths[MAX_LINES];
+
+static void flushRowWidths(void) {
+	memset(gameWidths, 0xff, sizeof(gameWidths));
+	memset(dirWidths,  0xff, sizeof(dirWidths));
+}
+
+// Draw a list row, truncating it with an ellipsis if it doesn't fit or
+// scrolling it if it is the selected one.
+static void printListRow(
+	DMAChain *chain, const Font *font, int x, int y, const char *str,
+	int16_t *width, bool selected, uint32_t time
+) {
+	int maxWidth = SCREEN_WIDTH - LIST_RIGHT_MARGIN - x;
+
+	if (*width < 0)
+		*width = measureString(font, str);
+
+	if (selected && (*width > maxWidth)) {
+		int offset = getMarqueeOffset(*width, maxWidth, time);
+
+		printStringClipped(chain, font, x - offset, y, x, x + maxWidth, str);
+	} else {
+		printStringEllipsis(chain, font, x, y, maxWidth, *width, str);
+	}
+}
+// Read the boot executable's name of the game currently selected on the
+// Picostation from SYSTEM.CNF, pass it on to the game ID receiver and reboot
+// into it. Never returns.
+static void bootSelectedGame(int slowboot) {
+	DirectoryEntry file;
+
+	stream_stopAll();
+	xa_stop();
+
+	char gameID[2048];
+	memset(gameID, 0, 2048);
+
+	if (!getFileInfo("SYSTEM.CNF;1", &file))
+		strcpy(gameID, "cdrom:\\PS.EXE;1\0");
+
+	// need one more character for the null terminator
+	size_t stringLength = file.length + 1;
+
+	// round up to the nearest multiple of 2048 bytes
+	size_t numSectors = (stringLength + 2047) / 2048;
+
+
+	startCDROMRead(file.lba, gameID, numSectors, 2048, true, true);
+
+	// insert the null terminator at the end
+	gameID[file.length] = 0;
+	printf("File contents:\n%s\n", gameID);
+
+
+
+	char firstLine[500];
+	memset(firstLine, 0, 500);
+
+	int i = 0;
+	int j = 0;
+	while (gameID[i] != '\0' && gameID[i] != '\n' && i < sizeof(firstLine) - 1) {
+		if (gameID[i] != ' ' && gameID[i] != '\t') { // Boşluk karakterini kontrol et
+			firstLine[j] = gameID[i]; // j, firstLine dizisinin indeksidir
+			j++; // j'yi artır
+		}
+		i++; // i'yi artır
+	}
+	firstLine[j] = '\0';
+	 if (strncmp(firstLine, "BOOT=", 5) == 0) {
+		memmove(firstLine, firstLine + 5, strlen(firstLine) - 4);
+	}
+	printf("got the string: %s\n",firstLine);
+
+	// Pending settings must be saved before the game ID is sent, as memory
+	// card emulators may switch to the game's own card as soon as they
+	// receive it.
+	settings_flush();
+	if (sendGameID(firstLine)) {
+		printf("game ID acknowledged\n");
+	} else {
+		printf("game ID not acknowledged\n");
+	}
+	//issueCDROMCommand(CDROM_CMD_TEST ,test,sizeof(test));
+	initFilesystem();
+	if(slowboot == 0)
+
+		softFastReboot();
+	else
+	 	softReset();
+}
+
+// Select a game by its 1-based Picostation index within the current directory
+// and boot it. Never returns.
+static void launchGame(uint16_t sendData, int slowboot) {
+	uint8_t high = (sendData >> 8) & 0xFF; // üst 8 bit
+	uint8_t low  = sendData & 0xFF;
+	printf("High: %x, low: %x \n", high,low);
+	uint8_t test[] = {CDROM_TEST_DSP_CMD, 0xF2, high, low} ;
+	issueCDROMCommand(CDROM_CMD_TEST ,test,sizeof(test));
+	delayMicroseconds(200);
+	bootSelectedGame(slowboot);
+}
+
+// Fetch a listing (1 = games, 2 = directories) of the current directory and
+// look an entry up by its ID. Returns the entry's 1-based Picostation index, or
+// 0 if it is not in the listing.
+static uint16_t findListingEntry(
+	int listingMode, uint32_t parentID, uint32_t id,
+	char lines[MAX_LINES][MAX_LENGTH], uint16_t lineIndexes[MAX_LINES],
+	uint32_t lineIDs[MAX_LINES]
+) {
+	int lineCount, unused;
+
+	list_and_parse(
+		100, listingMode, parentID, lines, &lineCount, &unused, lineIndexes,
+		lineIDs
+	);
+
+	for (int i = 0; i < lineCount; i++) {
+		if (lineIDs[lineIndexes[i]] == id)
+			return lineIndexes[i] + 1;
+	}
+
+	return 0;
+}
+
+// Launch a quick list entry by its ID in a single round trip, without fetching
+// any listing. Firmware that doesn't support selecting by ID gets the
+// directories leading to the game looked up and entered one at a time
+// instead, using the provided buffers for the listings. Only returns if the
+// game is no longer on the card, after going back to the root.
+#define QUICK_COMMAND_DELAY 20000
+
+static void launchQuickEntry(
+	const QuickEntry *entry, int slowboot, char lines[MAX_LINES][MAX_LENGTH],
+	uint16_t lineIndexes[MAX_LINES], uint32_t lineIDs[MAX_LINES]
+) {
+	PicostationSelectResult result = picostation_selectByID(entry->id);
+
+	if (result == PICOSTATION_SELECT_NOT_FOUND)
+		return;
+
+	if (result == PICOSTATION_SELECT_OK) {
+		quick_recordLaunch(entry);
+		bootSelectedGame(slowboot);
+	}
+
+	uint32_t parentID = PICOSTATION_ROOT_ID;
+	uint16_t game     = 0;
+	int      depth    = 0;
+
+	for (; depth < entry->depth; depth++) {
+		uint16_t index = findListingEntry(
+			2, parentID, entry->path[depth], lines, lineIndexes, lineIDs
+		);
+
+		if (!index)
+			break;
+
+		uint8_t high   = (index >> 8) & 0xFF;
+		uint8_t low    = index & 0xFF;
+		uint8_t test[] = {CDROM_TEST_DSP_CMD, 0xF0, high, low};
+
+		issueCDROMCommand(CDROM_CMD_TEST, test, sizeof(test));
+		delayMicroseconds(QUICK_COMMAND_DELAY);
+		parentID = entry->path[depth];
+	}
+
+	if (depth == entry->depth)
+		game = findListingEntry(
+			1, parentID, entry->id, lines, lineIndexes, lineIDs
+		);
+
+	if (game) {
+		quick_recordLaunch(entry);
+		launchGame(game, slowboot);
+	}
+
+	for (; depth > 0; depth--) {
+		uint8_t test[] = {CDROM_TEST_DSP_CMD, 0xF4};
+
+		issueCDROMCommand(CDROM_CMD_TEST, test, sizeof(test));
+		delayMicroseconds(QUICK_COMMAND_DELAY);
+	}
+}
+
 int gameLineCount = 0;
 int dirLineCount = 0;
 //uint8_t test[] = {0x50, 0xfa, 0xf0,0xf1} ;
@@ -514,15 +663,35 @@ int main(int argc, const char **argv) {
 	initIRQ();
 	initSerialIO(115200);
 	initControllerBus();
+	input_init();
+	settings_init();
 	initFilesystem(); 
 	initCDROM();
+	initSPU();
+	initMDEC();
+	streamContext_create(&music);
+
+	if (!soundBank_load(SOUND_BANK_FILE, &uiSounds)) {
+		moveSound    = soundBank_find(&uiSounds, "MOVE");
+		confirmSound = soundBank_find(&uiSounds, "CONFIRM");
+		backSound    = soundBank_find(&uiSounds, "BACK");
+	}
+	if (
+		xa_play(MUSIC_XA_FILE, MUSIC_XA_CHANNEL, MUSIC_VOLUME) &&
+		!streamContext_loadSong(&music, MUSIC_FILE, MUSIC_CHUNKS)
+	)
+		streamContext_play(&music, MUSIC_VOLUME);
+
+	int refreshRate;
 
 	if ((GPU_GP1 & GP1_STAT_FB_MODE_BITMASK) == GP1_STAT_FB_MODE_PAL) {
 		puts("Using PAL mode");
 		setupGPU(GP1_MODE_PAL, SCREEN_WIDTH, SCREEN_HEIGHT);
+		refreshRate = 50;
 	} else {
 		puts("Using NTSC mode");
 		setupGPU(GP1_MODE_NTSC, SCREEN_WIDTH, SCREEN_HEIGHT);
+		refreshRate = 60;
 	}
 
 	DMA_DPCR |= DMA_DPCR_ENABLE << (DMA_GPU * 4);
@@ -530,23 +699,50 @@ int main(int argc, const char **argv) {
 	GPU_GP1 = gp1_dmaRequestMode(GP1_DREQ_GP0_WRITE);
 	GPU_GP1 = gp1_dispBlank(false);
 
-	TextureInfo font;
+	Font        font, fontLarge;
+	TextureInfo atlas;
 	TextureInfo logo;
 
-	uploadIndexedTexture(
-		&font, fontTexture, fontPalette, SCREEN_WIDTH * 2, 0, SCREEN_WIDTH * 2,
-		FONT_HEIGHT, FONT_WIDTH, FONT_HEIGHT, FONT_COLOR_DEPTH
-	);
+	// Keep the framebuffers out of the allocator's reach, then let it place
+	// the font and logo (and their palettes) in the remaining space.
+	vram_init();
+	vram_reserve(0, 0, SCREEN_WIDTH * FRAMEBUFFER_COUNT, SCREEN_HEIGHT);
+#ifndef MENU_HIRES
+	startBackground();
+#endif
+
 	#define TEXTURE_WIDTH       128
 	#define TEXTURE_HEIGHT      20
 	#define TEXTURE_COLOR_DEPTH GP0_COLOR_4BPP
-	
 
-	uploadIndexedTexture(
-		&logo, logoTexture, logoPalette, SCREEN_WIDTH * 2, FONT_WIDTH,
-		SCREEN_WIDTH * 2, TEXTURE_HEIGHT + (FONT_WIDTH*2), TEXTURE_WIDTH, TEXTURE_HEIGHT,
+	// Nothing can be shown without the fonts, so there is no point in going
+	// on if they don't fit. The logo is simply left out.
+	if (!uploadCompressedTexture(
+		&atlas, fontTexture, fontPalette, FONT_SMALL_WIDTH, FONT_SMALL_HEIGHT,
+		GP0_COLOR_4BPP
+	)) {
+		puts("Failed to upload small font");
+		for (;;)
+			__asm__ volatile("");
+	}
+	font_init(&font, &fontSmallMetrics, &atlas);
+	if (!uploadCompressedTexture(
+		&atlas, fontLargeTexture, fontLargePalette, FONT_LARGE_WIDTH,
+		FONT_LARGE_HEIGHT, GP0_COLOR_4BPP
+	)) {
+		puts("Failed to upload large font");
+		for (;;)
+			__asm__ volatile("");
+	}
+	font_init(&fontLarge, &fontLargeMetrics, &atlas);
+	if (!uploadCompressedTexture(
+		&logo, logoTexture, logoPalette, TEXTURE_WIDTH, TEXTURE_HEIGHT,
 		TEXTURE_COLOR_DEPTH
-	);
+	)) {
+		puts("Failed to upload logo");
+		logo.width = 0;
+	}
+	cover_init();
 
 	DMAChain dmaChains[2];
 	bool     usingSecondFrame = false;
@@ -568,16 +764,28 @@ int main(int argc, const char **argv) {
 	int framedelayer2 = 0;
 	int firstboot = 1;
 	int dirDepth = 0;
-	int gamePerPage = 18;
+	int gamePerPage = LIST_ROWS;
 	uint16_t dirFix = 0;
 	int slowboot = 0;
+	uint32_t dirIDs[QUICK_MAX_DEPTH + 1] = { PICOSTATION_ROOT_ID };
+	QuickEntry quickEntries[QUICK_MAX_ENTRIES];
+	int quickmenu = 1;
+	int quickCount = -1;
+	int quickSelected = 0;
 	char games[MAX_LINES][MAX_LENGTH];
 	char dirs[MAX_LINES][MAX_LENGTH];
 	uint16_t indexes[MAX_LINES];
 	uint16_t indexes2[MAX_LINES];
-	uint16_t previousButtons = getButtonPress(0);
+	uint32_t gameIDs[MAX_LINES];
+	uint32_t dirEntryIDs[MAX_LINES];
+	uint16_t marqueeIndex    = 0;
+	uint32_t marqueeTime     = 0;
+	int      scrollFraction  = 0;
+
+	flushRowWidths();
+
 	for (;;) {
-		int bufferX = usingSecondFrame ? SCREEN_WIDTH : 0;
+		int bufferX = (usingSecondFrame && (FRAMEBUFFER_COUNT > 1)) ? SCREEN_WIDTH : 0;
 		int bufferY = 0;
 
 		DMAChain *chain  = &dmaChains[usingSecondFrame];
@@ -597,45 +805,142 @@ int main(int argc, const char **argv) {
 		);
 		ptr[3] = gp0_fbOrigin(bufferX, bufferY);
 
+		// In interlaced mode the framebuffer being drawn to is also the one
+		// being displayed. Drawing commands skip the lines of the field
+		// currently on screen as long as the texpage command above doesn't
+		// unlock the display area, but VRAM fills always write every line, so
+		// the background is cleared with a rectangle instead.
+#ifdef MENU_HIRES
 		ptr    = allocatePacket(chain, 3);
-		ptr[0] = gp0_rgb(64, 64, 64) | gp0_vramFill();
-		ptr[1] = gp0_xy(bufferX, bufferY);
+		ptr[0] = gp0_rgb(64, 64, 64) | gp0_rectangle(false, false, false);
+		ptr[1] = gp0_xy(0, 0);
 		ptr[2] = gp0_xy(SCREEN_WIDTH, SCREEN_HEIGHT);
+#else
+		if (backgroundReady) {
+			ptr    = allocatePacket(chain, 4);
+			ptr[0] = gp0_vramBlit();
+			ptr[1] = gp0_xy(0, BACKGROUND_Y);
+			ptr[2] = gp0_xy(bufferX, bufferY);
+			ptr[3] = gp0_xy(SCREEN_WIDTH, SCREEN_HEIGHT);
+		} else {
+			ptr    = allocatePacket(chain, 3);
+			ptr[0] = gp0_rgb(64, 64, 64) | gp0_vramFill();
+			ptr[1] = gp0_xy(bufferX, bufferY);
+			ptr[2] = gp0_xy(SCREEN_WIDTH, SCREEN_HEIGHT);
+		}
+#endif
 		if (firstboot == 0 && loadingmenu == 0 && creditsmenu == 0){
 			ptr    = allocatePacket(chain, 3);
 			ptr[0] = gp0_rgb(48, 48, 48) | gp0_rectangle(false, false, false);
-			ptr[1] = gp0_xy(0, 18 + (1+selectedindex-startnumber)*10);
-			ptr[2] = gp0_xy(320, 12);
+			ptr[1] = gp0_xy(0, LIST_TOP - 2 + (selectedindex-startnumber)*ROW_HEIGHT);
+			ptr[2] = gp0_xy(SCREEN_WIDTH, ROW_HEIGHT + 2);
 		}
-		if (firstboot == 0 && loadingmenu == 0){
+		if (firstboot == 0 && loadingmenu == 0 && logo.width){
 			ptr    = allocatePacket(chain, 5);
 			ptr[0] = gp0_texpage(logo.page, false, false);
 			ptr[1] = gp0_rectangle(true, true, true);
-			ptr[2] = gp0_xy(96, 2);
+			ptr[2] = gp0_xy((SCREEN_WIDTH - logo.width) / 2, 2);
 			ptr[3] = gp0_uv(logo.u, logo.v, logo.clut);
 			ptr[4] = gp0_xy(logo.width, logo.height);
 		}
 
 
-		char controllerbuffer[256];
-		
-		//get the controller button press
-
-		snprintf(controllerbuffer, sizeof(controllerbuffer), "%i", getButtonPress(0));
-		//printString(chain, &font, 56,100, controllerbuffer);
-		uint16_t buttons = getButtonPress(0);
-		uint16_t pressedButtons = ~previousButtons & buttons;
+		// Poll the controllers once for the whole frame, then let the
+		// settings store and music carry on loading in the background.
+		input_update();
+		settings_update();
+		stream_update();
+		xa_update();
+#ifndef MENU_HIRES
+		updateBackground();
+#endif
+
+		// Take input from the first connected pad, so that the menu also
+		// works with a controller in any slot of a multitap.
+		const InputState *pad = input_getState(0);
+
+		for (int i = 0; i < INPUT_NUM_PADS; i++) {
+			if (input_getState(i)->connected) {
+				pad = input_getState(i);
+				break;
+			}
+		}
 		if (dirDepth > 0){
 			dirFix = 1;
 		} else  {
 			dirFix = 0;
 		}
 		int goup = 0;
-		if (firstboot == 1){
+		if (quickmenu == 1){
+			// Show recently played and favorite games straight from the
+			// memory card, before the SD card listing is fetched.
+			if (!settings_isReady()) {
+				printString(
+					chain, &font, MESSAGE_X, MESSAGE_Y,
+					"READING MEMORY CARD...");
+			} else {
+				if (quickCount < 0){
+					quickCount = quick_load(quickEntries, QUICK_MAX_ENTRIES);
+				}
+				if (quickCount == 0){
+					quickmenu = 0;
+				}
+			}
+
+			if (quickCount > 0){
+				if((pad->repeated & BUTTON_MASK_UP) && (quickSelected > 0)){
+					quickSelected--;
+					playUISound(moveSound);
+				}
+				if((pad->repeated & BUTTON_MASK_DOWN) && (quickSelected < quickCount - 1)){
+					quickSelected++;
+					playUISound(moveSound);
+				}
+				if(pad->pressed & (BUTTON_MASK_X | BUTTON_MASK_START)){
+					slowboot  = (pad->pressed & BUTTON_MASK_START) ? 1 : 0;
+					quickmenu = 2;
+					playUISound(confirmSound);
+				}
+				if(pad->pressed & (BUTTON_MASK_CIRCLE | BUTTON_MASK_TRIANGLE)){
+					quickmenu = 0;
+					playUISound(backSound);
+				}
+
+				ptr    = allocatePacket(chain, 3);
+				ptr[0] = gp0_rgb(48, 48, 48) | gp0_rectangle(false, false, false);
+				ptr[1] = gp0_xy(0, LIST_TOP - 2 + quickSelected*ROW_HEIGHT);
+				ptr[2] = gp0_xy(SCREEN_WIDTH, ROW_HEIGHT + 2);
+
+				printString(chain, &font, TEXT_LEFT, HEADER_Y, "Favorites and recently played");
+				for (int i = 0; i < quickCount; i++) {
+					char buffer[QUICK_NAME_LENGTH + 2];
+
+					snprintf(buffer, sizeof(buffer), "%s%s", quickEntries[i].favorite ? "* " : "  ", quickEntries[i].name);
+					printStringEllipsis(
+						chain, &font, LIST_LEFT, LIST_TOP + i*ROW_HEIGHT,
+						SCREEN_WIDTH - LIST_RIGHT_MARGIN - LIST_LEFT, -1, buffer
+					);
+				}
+				printString(chain, &font, TEXT_LEFT, FOOTER_Y, "\x95: Fast Boot / \x96 Regular Boot / O: All Games");
+			}
+		} else if (quickmenu == 2){
+			printString(
+				chain, &fontLarge, MESSAGE_X, MESSAGE_Y,
+				"LOADING...");
+			if(framedelayer < 2){
+				framedelayer++;
+			} else {
+				launchQuickEntry(&quickEntries[quickSelected], slowboot, games, indexes, gameIDs);
+				// The game is gone from the card; fall back to the full
+				// listing.
+				quickmenu    = 0;
+				framedelayer = 0;
+			}
+		} else if (firstboot == 1){
 			printf("entered firstboot\n");
 			
 			printString(
-				chain, &font, 40, 80,
+				chain, &font, MESSAGE_X, MESSAGE_Y,
 				"LOADING GAME LIST FROM SD CARD...");
 				// We gotta render few layers to be able to show this text
 				if(framedelayer2 < 2){
@@ -649,41 +954,47 @@ int main(int argc, const char **argv) {
 						}
 					}
 					printf("buffer empty done\n");
-					list_and_parse(100, 1, games, &gameLineCount, &firstboot,indexes);
-					list_and_parse(100, 2, dirs, &dirLineCount, &firstboot,indexes2);
+					// IDs are only tracked as deep as quick entries can go.
+					uint32_t parentID = (dirDepth <= QUICK_MAX_DEPTH) ? dirIDs[dirDepth] : PICOSTATION_ROOT_ID;
+					list_and_parse(100, 1, parentID, games, &gameLineCount, &firstboot,indexes, gameIDs);
+					list_and_parse(100, 2, parentID, dirs, &dirLineCount, &firstboot,indexes2, dirEntryIDs);
+					// Cover indices and row widths are only valid within the
+					// listing they were fetched for.
+					cover_flush();
+					flushRowWidths();
 					printf("finished game loading\n");
 					framedelayer2 = 0;
 
 				}
 		} else if (firstboot == 2){
 			printString(
-				chain, &font, 40, 80,
+				chain, &font, MESSAGE_X, MESSAGE_Y,
 				"THERE ARE NO GAMES ON THE SD CARD");
 		} else if (creditsmenu == 1){
 			printString(
-				chain, &font, 40, 40,
+				chain, &font, MESSAGE_X, SCREEN_HEIGHT / 6,
 				"Picostation Game Loader Alpha Release"
 			);
 			printString(
-				chain, &font, 40, 80,
+				chain, &font, MESSAGE_X, (SCREEN_HEIGHT * 2) / 6,
 				"Huge thanks to Rama, Skitchin, SpicyJpeg,\nDanhans42, NicholasNoble and ChatGPT"
 			);
 
 			printString(
-				chain, &font, 40, 120,
+				chain, &font, MESSAGE_X, (SCREEN_HEIGHT * 3) / 6,
 				"https://github.com/raijin/picostation-loader"
 			);
 			printString(
-				chain, &font, 40, 160,
+				chain, &font, MESSAGE_X, (SCREEN_HEIGHT * 4) / 6,
 				"https://psx.dev"
 			);
 
-			if(pressedButtons & BUTTON_MASK_CIRCLE)    {
+			if(pad->pressed & BUTTON_MASK_CIRCLE)    {
 				creditsmenu = 0;
 			}
 		} else if(loadingmenu == 1) {
 				printString(
-				chain, &font, 40, 80,
+				chain, &fontLarge, MESSAGE_X, MESSAGE_Y,
 				"LOADING...");
 				if(framedelayer < 2){
 					framedelayer++;
@@ -716,7 +1027,10 @@ int main(int argc, const char **argv) {
 						framedelayer = 0;
 						framedelayer2 = 0;
 						if(goup == 0){
-							dirDepth = dirDepth + 1;			
+							if (dirDepth < QUICK_MAX_DEPTH){
+								dirIDs[dirDepth + 1] = dirEntryIDs[indexes2[selectedindex-dirFix]];
+							}
+							dirDepth = dirDepth + 1;
 						} else {
 							goup = 0;
 						}
@@ -727,87 +1041,61 @@ int main(int argc, const char **argv) {
 					} else {
 						uint16_t sendData = indexes[(selectedindex-(dirLineCount+dirFix))] + 1;
 						printf("game change: %i sendindex:%i selectedindex:%i dirlinecount:%i dirfix: %i\n",sendData,(selectedindex-(dirLineCount+dirFix)), selectedindex,dirLineCount,dirFix);
-						uint8_t high = (sendData >> 8) & 0xFF; // üst 8 bit
-						uint8_t low  = sendData & 0xFF; 
-						printf("High: %x, low: %x \n", high,low);
-						uint8_t test[] = {CDROM_TEST_DSP_CMD, 0xF2, high, low} ;
-						issueCDROMCommand(CDROM_CMD_TEST ,test,sizeof(test));
-						delayMicroseconds(200);
-						DirectoryEntry file;
-
-						char gameID[2048];
-						memset(gameID, 0, 2048);
-
-						if (!getFileInfo("SYSTEM.CNF;1", &file))
-							strcpy(gameID, "cdrom:\\PS.EXE;1\0");
+						const char *name = games[selectedindex-(dirLineCount+dirFix)];
+						QuickEntry entry;
 
-						// need one more character for the null terminator
-						size_t stringLength = file.length + 1;
-
-						// round up to the nearest multiple of 2048 bytes
-						size_t numSectors = (stringLength + 2047) / 2048;
-						
-
-						startCDROMRead(file.lba, gameID, numSectors, 2048, true, true);
-
-						// insert the null terminator at the end
-						gameID[file.length] = 0;
-						printf("File contents:\n%s\n", gameID);
-
-						
-						
-						char firstLine[500];
-						memset(firstLine, 0, 500);
-
-						int i = 0;
-						int j = 0;
-						while (gameID[i] != '\0' && gameID[i] != '\n' && i < sizeof(firstLine) - 1) {
-							if (gameID[i] != ' ' && gameID[i] != '\t') { // Boşluk karakterini kontrol et
-								firstLine[j] = gameID[i]; // j, firstLine dizisinin indeksidir
-								j++; // j'yi artır
-							}
-							i++; // i'yi artır
-						}
-						firstLine[j] = '\0';
-						 if (strncmp(firstLine, "BOOT=", 5) == 0) {
-							memmove(firstLine, firstLine + 5, strlen(firstLine) - 4);
+						if ((dirDepth <= QUICK_MAX_DEPTH) && quick_setupEntry(&entry, &dirIDs[1], dirDepth, gameIDs[sendData - 1], name)){
+							quick_recordLaunch(&entry);
 						}
-						printf("got the string: %s\n",firstLine);
-
-						sendGameID(firstLine);
-						//issueCDROMCommand(CDROM_CMD_TEST ,test,sizeof(test));
-						initFilesystem();
-						if(slowboot == 0)
-							
-							softFastReboot();
-						else
-						 	softReset();
+						launchGame(sendData, slowboot);
 					}
 						
 				}
 				
 		} else {
-			if(pressedButtons & BUTTON_MASK_UP)   {
-				if (selectedindex > 0){
-					selectedindex = selectedindex - 1;
-					if(startnumber - selectedindex == 1){
-						startnumber = startnumber - gamePerPage;
-					}
-				}
-				printf("DEBUG:UP  :%d, startnumber:%d\n", selectedindex, startnumber);
+			// Up and down move by more than one row at a time when held for
+			// long enough, while the left stick scrolls continuously at a
+			// speed proportional to its deflection. Scrolling is tracked in
+			// 1/256ths of a row so that slow speeds still move eventually.
+			int scrollRows = 0;
+			int scrollSpeed =
+				input_getAxisSpeed(pad->leftY, SCROLL_MAX_SPEED);
+
+			if (scrollSpeed) {
+				scrollFraction += (scrollSpeed * 256) / refreshRate;
+				scrollRows      = scrollFraction / 256;
+				scrollFraction -= scrollRows * 256;
+			} else {
+				scrollFraction = 0;
 			}
-			if(pressedButtons & BUTTON_MASK_DOWN)    {
-				
-				if (selectedindex < (dirFix+gameLineCount+dirLineCount-1)){
-					selectedindex = selectedindex + 1;
-					if(selectedindex - startnumber > (gamePerPage-1)){
-						startnumber = startnumber + gamePerPage;
-					}
+
+			if(pad->repeated & BUTTON_MASK_UP)   {
+				scrollRows -= pad->step;
+			}
+			if(pad->repeated & BUTTON_MASK_DOWN)    {
+				scrollRows += pad->step;
+			}
+
+			// Pages always start at a multiple of gamePerPage, so the page can
+			// be worked out from the selection alone.
+			if (scrollRows) {
+				int lastindex = dirFix+gameLineCount+dirLineCount-1;
+				int newindex  = selectedindex + scrollRows;
+
+				if (newindex > lastindex){
+					newindex = lastindex;
 				}
-				printf("DEBUG:DOWN  :%d, startnumber:%d\n", selectedindex, startnumber);
+				if (newindex < 0){
+					newindex = 0;
+				}
+				if (newindex != selectedindex){
+					playUISound(moveSound);
+				}
+				selectedindex = newindex;
+				startnumber   = selectedindex - (selectedindex % gamePerPage);
 			}
 
-			if(pressedButtons & BUTTON_MASK_RIGHT)    {
+			if(pad->repeated & BUTTON_MASK_RIGHT)    {
 				if((dirFix+gameLineCount+dirLineCount)>gamePerPage){
 					if (selectedindex < (gameLineCount+dirLineCount) - gamePerPage){
 						selectedindex = selectedindex +gamePerPage;
@@ -822,7 +1110,7 @@ int main(int argc, const char **argv) {
 			}
 
 
-			if(pressedButtons & BUTTON_MASK_LEFT)    {
+			if(pad->repeated & BUTTON_MASK_LEFT)    {
 				
 				if (selectedindex > (gamePerPage-1)){
 					selectedindex = selectedindex - gamePerPage;
@@ -835,16 +1123,18 @@ int main(int argc, const char **argv) {
 				printf("DEBUG:LEFT  :%d, startnumber:%d\n", selectedindex, startnumber);
 			}
 
-			if(pressedButtons & BUTTON_MASK_START)    {
+			if(pad->pressed & BUTTON_MASK_START)    {
 				printf("DEBUG: selectedindex :%d\n", selectedindex);
 				loadingmenu = 1;
 				slowboot = 1;
+				playUISound(confirmSound);
 			}
 
-			if(pressedButtons & BUTTON_MASK_X)    {
+			if(pad->pressed & BUTTON_MASK_X)    {
 				printf("DEBUG:X selectedindex  :%d\n", selectedindex);
 				loadingmenu = 1;
 				slowboot = 0;
+				playUISound(confirmSound);
 				//		 Rama's code 
 				//		StartCommand();
 				//		WriteParam( 0x50 );
@@ -855,41 +1145,60 @@ int main(int argc, const char **argv) {
 				//		AckWithTimeout(500000);
 			}
 
-			if((pressedButtons & BUTTON_MASK_L1) && (pressedButtons & BUTTON_MASK_R1))    {
+			if((pad->pressed & BUTTON_MASK_L1) && (pad->pressed & BUTTON_MASK_R1))    {
 				uint8_t test[] = {CDROM_TEST_DSP_CMD, 0xfa, 0xBE, 0xEF} ;
 				issueCDROMCommand(CDROM_CMD_TEST,test,sizeof(test));
 			}
 
-			if(pressedButtons & BUTTON_MASK_SELECT)    {
+			if(pad->pressed & BUTTON_MASK_SELECT)    {
 				creditsmenu = 1;
 			}
 
-			if(pressedButtons & BUTTON_MASK_TRIANGLE)    {
+			if(pad->pressed & BUTTON_MASK_TRIANGLE)    {
 			//	firstboot=1;
 			}
 
-			if(pressedButtons & BUTTON_MASK_SQUARE){
+			// Square adds the selected game to the favorites shown on the
+			// quick list at boot, or removes it.
+			if(pad->pressed & BUTTON_MASK_SQUARE){
+				int gameindex = selectedindex-(dirLineCount+dirFix);
+				QuickEntry entry;
 
+				if ((gameindex >= 0) && (gameindex < gameLineCount) && (dirDepth <= QUICK_MAX_DEPTH) && quick_setupEntry(&entry, &dirIDs[1], dirDepth, gameIDs[indexes[gameindex]], games[gameindex])){
+					quick_toggleFavorite(&entry);
+				}
 			}
 
 
 
+			// Restart the marquee whenever the selection changes, so the new
+			// row is shown from its beginning.
+			if (selectedindex != marqueeIndex) {
+				marqueeIndex = selectedindex;
+				marqueeTime  = 0;
+			} else {
+				marqueeTime++;
+			}
+
+			cover_beginFrame();
 			for (int i = startnumber; i < startnumber + gamePerPage; i++) {
 			
 				char buffer[62];
+				bool selected = (i == selectedindex);
+				int  rowY     = LIST_TOP + (i-startnumber)*ROW_HEIGHT;
 				if(dirFix == 1 && i == 0){
 					snprintf(buffer, sizeof(buffer), "\x93 Go Back");
-					printString(chain, &font, 5, 30+(i-startnumber)*10, buffer);	
+					printString(chain, &font, LIST_LEFT, rowY, buffer);	
 				}
 				else if (gameLineCount+dirLineCount < 1 || i > (gameLineCount+dirLineCount+dirFix-1)){
 					break;
 				}
 				else if(i < dirLineCount+dirFix){
 					snprintf(buffer, sizeof(buffer), "\x92 %s", dirs[i-dirFix],indexes2[i-dirFix]);
-					printString(chain, &font, 5, 30+(i-startnumber)*10, buffer);	
+					printListRow(chain, &font, LIST_LEFT, rowY, buffer, &dirWidths[i-dirFix], selected, marqueeTime);
 				} else {
-					snprintf(buffer, sizeof(buffer), "\x8f %s",games[i-(dirFix+dirLineCount)]);
-					printString(chain, &font, 5, 30+(i-startnumber)*10, buffer);	
+					cover_draw(chain, indexes[i-(dirFix+dirLineCount)] + 1, LIST_LEFT, rowY, COVER_ROW_SIZE);
+					printListRow(chain, &font, LIST_LEFT + COVER_ROW_SIZE + 3, rowY, games[i-(dirFix+dirLineCount)], &gameWidths[i-(dirFix+dirLineCount)], selected, marqueeTime);
 				}
 				/*
 				if(i == selectedindex){
@@ -905,18 +1214,29 @@ int main(int argc, const char **argv) {
 					break;
 				}*/
 			}
+			// Queue the next page's thumbnails behind the visible ones, then
+			// let the loader issue at most one read for this frame.
+			for (int i = startnumber + gamePerPage; i < startnumber + 2*gamePerPage; i++) {
+				if (i < dirLineCount+dirFix)
+					continue;
+				if (i > (gameLineCount+dirLineCount+dirFix-1))
+					break;
+
+				cover_prefetch(indexes[i-(dirFix+dirLineCount)] + 1);
+			}
+			cover_update();
+
 			char fbuffer[60];
 			//snprintf(fbuffer, sizeof(fbuffer), "selind: %i,stnum: %i,games: %i,dirs: %i, dirfix:%i, dd:%i", selectedindex,startnumber,gameLineCount,dirLineCount,dirFix,dirDepth);
 			//snprintf(fbuffer, sizeof(fbuffer),"selected index:%i, possible index:%i",(selectedindex-(dirLineCount+dirFix)),(indexes[(selectedindex-(dirLineCount+dirFix))] + 1));
 			snprintf(fbuffer, sizeof(fbuffer), "Page: %i/%i",((startnumber/gamePerPage)+1),(((gameLineCount+dirLineCount+dirFix)/gamePerPage)+1));
-			printString(chain, &font, 16, 20, fbuffer);
-			printString(chain, &font, 16, 212, "\x95: Fast Boot / \x96 Regular Boot");
+			printString(chain, &font, TEXT_LEFT, HEADER_Y, fbuffer);
+			printString(chain, &font, TEXT_LEFT, FOOTER_Y, "\x95: Fast Boot / \x96 Regular Boot");
 			
 			//					printf("finished prints\n");
 
 
 		}
-		previousButtons = buttons;
 		*(chain->nextPacket) = gp0_endTag(0);
 		waitForGP0Ready();
 		waitForVblank();
@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "controller.h"
+#include "memcard.h"
+#include "sio.h"
+
+#define MEMCARD_RETRIES 3
+
+// Offsets into read and write responses. The first byte is the one received
+// while sending the command, i.e. the card's status flags.
+#define READ_LENGTH        (9 + MEMCARD_FRAME_SIZE + 2)
+#define READ_ID_OFFSET     1
+#define READ_ADDR_OFFSET   7
+#define READ_DATA_OFFSET   9
+#define READ_CHECK_OFFSET  (READ_DATA_OFFSET + MEMCARD_FRAME_SIZE)
+#define READ_END_OFFSET    (READ_CHECK_OFFSET + 1)
+
+#define WRITE_LENGTH       (5 + MEMCARD_FRAME_SIZE + 4)
+#define WRITE_ID_OFFSET    1
+#define WRITE_DATA_OFFSET  5
+#define WRITE_CHECK_OFFSET (WRITE_DATA_OFFSET + MEMCARD_FRAME_SIZE)
+#define WRITE_END_OFFSET   (WRITE_LENGTH - 1)
+
+#define END_GOOD         'G'
+#define END_BAD_CHECKSUM 'N'
+#define END_BAD_SECTOR   0xff
+
+typedef enum {
+	_OP_NONE  = 0,
+	_OP_READ  = 1,
+	_OP_WRITE = 2
+} MemcardOperation;
+
+static MemcardOperation _operation = _OP_NONE;
+static SIOTransfer      _transfer;
+static uint8_t          *_readBuffer;
+static int              _retries;
+
+static uint8_t _request[READ_LENGTH], _response[READ_LENGTH];
+
+static uint8_t _getChecksum(int frame, const uint8_t *data) {
+	uint8_t checksum = (frame >> 8) ^ (frame & 0xff);
+
+	for (int i = 0; i < MEMCARD_FRAME_SIZE; i++)
+		checksum ^= data[i];
+
+	return checksum;
+}
+
+static bool _start(MemcardOperation operation, int port, int length) {
+	_operation = operation;
+	_retries   = MEMCARD_RETRIES;
+
+	sio_setupTransfer(
+		&_transfer, port, ADDR_MEMORY_CARD, _request, _response, length,
+		length
+	);
+	return sio_submit(&_transfer);
+}
+
+bool memcard_startRead(int port, int frame, void *data) {
+	if (_operation != _OP_NONE)
+		return false;
+
+	memset(_request, 0, READ_LENGTH);
+	_request[0] = CMD_CARD_READ;
+	_request[3] = frame >> 8;
+	_request[4] = frame & 0xff;
+
+	_readBuffer = (uint8_t *) data;
+	return _start(_OP_READ, port, READ_LENGTH);
+}
+
+bool memcard_startWrite(int port, int frame, const void *data) {
+	if (_operation != _OP_NONE)
+		return false;
+
+	memset(_request, 0, WRITE_LENGTH);
+	_request[0] = CMD_CARD_WRITE;
+	_request[3] = frame >> 8;
+	_request[4] = frame & 0xff;
+
+	memcpy(&_request[WRITE_DATA_OFFSET], data, MEMCARD_FRAME_SIZE);
+	_request[WRITE_CHECK_OFFSET] = _getChecksum(frame, data);
+
+	return _start(_OP_WRITE, port, WRITE_LENGTH);
+}
+
+static MemcardStatus _checkRead(void) {
+	int frame = (_request[3] << 8) | _request[4];
+
+	if (
+		(_transfer.respLength < READ_LENGTH) ||
+		(_response[READ_ID_OFFSET]     != 0x5a) ||
+		(_response[READ_ID_OFFSET + 1] != 0x5d)
+	)
+		return MEMCARD_NO_CARD;
+
+	// The card echoes the frame number back before the data. A frame number
+	// of 0xffff means the requested one was out of range.
+	int confirmed =
+		(_response[READ_ADDR_OFFSET] << 8) | _response[READ_ADDR_OFFSET + 1];
+
+	if (confirmed != frame)
+		return MEMCARD_BAD_SECTOR;
+	if (
+		(_response[READ_END_OFFSET] != END_GOOD) ||
+		(_response[READ_CHECK_OFFSET] !=
+			_getChecksum(frame, &_response[READ_DATA_OFFSET]))
+	)
+		return MEMCARD_BAD_CHECKSUM;
+
+	memcpy(_readBuffer, &_response[READ_DATA_OFFSET], MEMCARD_FRAME_SIZE);
+	return MEMCARD_OK;
+}
+
+static MemcardStatus _checkWrite(void) {
+	if (
+		(_transfer.respLength < WRITE_LENGTH) ||
+		(_response[WRITE_ID_OFFSET]     != 0x5a) ||
+		(_response[WRITE_ID_OFFSET + 1] != 0x5d)
+	)
+		return MEMCARD_NO_CARD;
+
+	switch (_response[WRITE_END_OFFSET]) {
+		case END_GOOD:
+			return MEMCARD_OK;
+
+		case END_BAD_SECTOR:
+			return MEMCARD_BAD_SECTOR;
+
+		case END_BAD_CHECKSUM:
+		default:
+			return MEMCARD_BAD_CHECKSUM;
+	}
+}
+
+MemcardStatus memcard_update(void) {
+	if (_operation == _OP_NONE)
+		return MEMCARD_IDLE;
+	if (!sio_isDone(&_transfer))
+		return MEMCARD_BUSY;
+
+	MemcardStatus status =
+		(_operation == _OP_READ) ? _checkRead() : _checkWrite();
+
+	// Checksum errors are usually caused by noise on the bus, so the transfer
+	// is simply repeated. A missing card or invalid frame is reported right
+	// away.
+	if ((status == MEMCARD_BAD_CHECKSUM) && (_retries > 0)) {
+		_retries--;
+		sio_submit(&_transfer);
+		return MEMCARD_BUSY;
+	}
+
+	_operation = _OP_NONE;
+	return status;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Memory cards are accessed in 128-byte frames (sectors). A card holds 1024
+// frames, grouped into 16 blocks of 64 frames; block 0 holds the directory.
+#define MEMCARD_FRAME_SIZE       128
+#define MEMCARD_NUM_FRAMES       1024
+#define MEMCARD_FRAMES_PER_BLOCK 64
+#define MEMCARD_NUM_BLOCKS       16
+
+typedef enum {
+	MEMCARD_IDLE         = 0, // No operation started since the last result
+	MEMCARD_BUSY         = 1,
+	MEMCARD_OK           = 2,
+	MEMCARD_NO_CARD      = 3,
+	MEMCARD_BAD_CHECKSUM = 4, // Checksum still wrong after all retries
+	MEMCARD_BAD_SECTOR   = 5
+} MemcardStatus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Start reading a frame in the background. The data is only copied to
+/// the buffer once its checksum has been verified.
+/// @return False if another operation is still in progress.
+bool memcard_startRead(int port, int frame, void *data);
+
+/// @brief Start writing a frame in the background. The data is copied, so the
+/// buffer may be reused right away.
+/// @return False if another operation is still in progress.
+bool memcard_startWrite(int port, int frame, const void *data);
+
+/// @brief Check on the current operation, retrying it if the transfer failed.
+/// Never blocks. Once a result other than MEMCARD_BUSY has been returned, the
+/// driver goes back to MEMCARD_IDLE.
+MemcardStatus memcard_update(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "picostation.h"
+#include "includes/cdrom.h"
+#include "ps1/cdrom.h"
+
+// The ID is passed to the Picostation through the same DSP test command used
+// for the listing and covers. The Picostation looks the game up on the whole
+// card, changes to its directory and serves a reply on the next read of
+// SELECT_LBA. Until it has done so, reads return whatever it served last, so
+// the sector is read again a few times before giving up.
+#define SELECT_LBA         100
+#define SELECT_CMD         0xf6
+#define SELECT_MAX_RETRIES 16
+
+#define SELECT_STATUS_OK        0
+#define SELECT_STATUS_NOT_FOUND 1
+
+#define FNV_PRIME 0x01000193
+
+typedef struct {
+	char     magic[8];
+	uint32_t id;
+	uint16_t status, index;
+	uint8_t  _reserved[112];
+} SelectReply;
+
+static const char _selectMagic[8] = "<select>";
+
+uint32_t picostation_appendID(uint32_t id, char value) {
+	return (id ^ (uint8_t) value) * FNV_PRIME;
+}
+
+uint32_t picostation_getID(uint32_t parentID, const char *name) {
+	uint32_t id = picostation_appendID(parentID, '/');
+
+	for (; *name; name++)
+		id = picostation_appendID(id, *name);
+
+	return id;
+}
+
+PicostationSelectResult picostation_selectByID(uint32_t id) {
+	uint32_t    sector[2048 / 4];
+	SelectReply *reply = (SelectReply *) sector;
+
+	uint8_t request[] = {
+		CDROM_TEST_DSP_CMD, SELECT_CMD,
+		(id >> 24) & 0xff, (id >> 16) & 0xff, (id >> 8) & 0xff, id & 0xff
+	};
+
+	issueCDROMCommand(CDROM_CMD_TEST, request, sizeof(request));
+
+	for (int i = 0; i < SELECT_MAX_RETRIES; i++) {
+		memset(sector, 0, sizeof(sector));
+		startCDROMRead(SELECT_LBA, sector, 1, 2048, false, true);
+
+		if (
+			memcmp(reply->magic, _selectMagic, sizeof(_selectMagic)) ||
+			(reply->id != id)
+		)
+			continue;
+
+		if (reply->status != SELECT_STATUS_OK)
+			return PICOSTATION_SELECT_NOT_FOUND;
+
+		return PICOSTATION_SELECT_OK;
+	}
+
+	return PICOSTATION_SELECT_UNSUPPORTED;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Games can be selected directly through a stable ID instead of walking the
+// directory listing. The ID is a 32-bit FNV-1a hash of the game's path on the
+// SD card, built one path element at a time ("/dir/subdir/game") from the
+// names shown in the listing, so it stays valid when other files are added or
+// removed and indices shift around.
+#define PICOSTATION_ROOT_ID 0x811c9dc5
+
+typedef enum {
+	PICOSTATION_SELECT_OK          = 0,
+	PICOSTATION_SELECT_NOT_FOUND   = 1,
+	PICOSTATION_SELECT_UNSUPPORTED = 2
+} PicostationSelectResult;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Return the ID of a directory or game, given the ID of its parent
+/// directory (PICOSTATION_ROOT_ID for the root of the card) and its name.
+uint32_t picostation_getID(uint32_t parentID, const char *name);
+
+/// @brief Append a character to an ID being built from a name one character
+/// at a time, starting from picostation_getID(parentID, ""). Used to hash names
+/// that are too long to be kept in full.
+uint32_t picostation_appendID(uint32_t id, char value);
+
+/// @brief Ask the Picostation to enter the directory containing a game and
+/// select it, as if the 0xF0 and 0xF2 commands had been issued for each level.
+/// Blocks until the Picostation replies.
+/// @return PICOSTATION_SELECT_UNSUPPORTED if no valid reply was received,
+/// which is the case with firmware predating the command.
+PicostationSelectResult picostation_selectByID(uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "quicklist.h"
+#include "settings.h"
+
+// Entries are stored as "recentN" and "favN" keys, each holding the depth, the
+// ID, the path (all as little endian values) and the name without its null
+// terminator.
+#define ENTRY_HEADER_SIZE 5
+#define MAX_ENTRY_SIZE \
+	(ENTRY_HEADER_SIZE + QUICK_MAX_DEPTH * 4 + QUICK_NAME_LENGTH - 1)
+
+static uint8_t *_writeID(uint8_t *ptr, uint32_t id) {
+	for (int i = 0; i < 32; i += 8)
+		*(ptr++) = (id >> i) & 0xff;
+
+	return ptr;
+}
+
+static uint32_t _readID(const uint8_t *ptr) {
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t) ptr[3] << 24);
+}
+
+static int _serialize(uint8_t *output, const QuickEntry *entry) {
+	uint8_t *ptr = output;
+
+	*(ptr++) = entry->depth;
+	ptr      = _writeID(ptr, entry->id);
+
+	for (int i = 0; i < entry->depth; i++)
+		ptr = _writeID(ptr, entry->path[i]);
+
+	int nameLength = strlen(entry->name);
+
+	memcpy(ptr, entry->name, nameLength);
+	return (ptr - output) + nameLength;
+}
+
+static bool _deserialize(QuickEntry *entry, const uint8_t *input, int length) {
+	if (length < ENTRY_HEADER_SIZE)
+		return false;
+
+	int depth      = input[0];
+	int nameLength = length - (ENTRY_HEADER_SIZE + depth * 4);
+
+	if (
+		(depth > QUICK_MAX_DEPTH) || (nameLength < 0) ||
+		(nameLength >= QUICK_NAME_LENGTH)
+	)
+		return false;
+
+	entry->depth    = depth;
+	entry->favorite = false;
+	entry->id       = _readID(&input[1]);
+	input          += ENTRY_HEADER_SIZE;
+
+	for (int i = 0; i < depth; i++, input += 4)
+		entry->path[i] = _readID(input);
+
+	memcpy(entry->name, input, nameLength);
+	entry->name[nameLength] = 0;
+	return true;
+}
+
+// Indices change as files are added to the card, so games are told apart by
+// their ID alone.
+static bool _isSameGame(const QuickEntry *a, const QuickEntry *b) {
+	return a->id == b->id;
+}
+
+static int _loadList(const char *prefix, QuickEntry *entries, int maxEntries) {
+	int count = 0;
+
+	for (int i = 0; i < maxEntries; i++) {
+		char    key[16];
+		uint8_t value[MAX_ENTRY_SIZE];
+
+		snprintf(key, sizeof(key), "%s%d", prefix, i);
+		int length = settings_get(key, value, sizeof(value));
+
+		if ((length > (int) sizeof(value)) || (length < 0))
+			continue;
+		if (_deserialize(&entries[count], value, length))
+			count++;
+	}
+
+	return count;
+}
+
+static void _saveList(
+	const char *prefix, const QuickEntry *entries, int count, int maxEntries
+) {
+	for (int i = 0; i < maxEntries; i++) {
+		char    key[16];
+		uint8_t value[MAX_ENTRY_SIZE];
+
+		snprintf(key, sizeof(key), "%s%d", prefix, i);
+
+		if (i < count)
+			settings_set(key, value, _serialize(value, &entries[i]));
+		else
+			settings_remove(key);
+	}
+}
+
+// Remove all copies of a game from a list and return the new length.
+static int _removeGame(QuickEntry *entries, int count, const QuickEntry *entry) {
+	int output = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (!_isSameGame(&entries[i], entry))
+			entries[output++] = entries[i];
+	}
+
+	return output;
+}
+
+bool quick_setupEntry(
+	QuickEntry *entry, const uint32_t *path, int depth, uint32_t id,
+	const char *name
+) {
+	if (depth > QUICK_MAX_DEPTH)
+		return false;
+
+	memset(entry, 0, sizeof(QuickEntry));
+
+	entry->depth = depth;
+	entry->id    = id;
+	memcpy(entry->path, path, depth * sizeof(uint32_t));
+	strncpy(entry->name, name, QUICK_NAME_LENGTH - 1);
+	return true;
+}
+
+int quick_load(QuickEntry *entries, int maxEntries) {
+	QuickEntry favorites[QUICK_MAX_FAVORITES], recent[QUICK_MAX_RECENT];
+
+	int numFavorites = _loadList("fav", favorites, QUICK_MAX_FAVORITES);
+	int numRecent    = _loadList("recent", recent, QUICK_MAX_RECENT);
+	int count        = 0;
+
+	for (int i = 0; (i < numFavorites) && (count < maxEntries); i++) {
+		entries[count]          = favorites[i];
+		entries[count].favorite = true;
+		count++;
+	}
+
+	for (int i = 0; i < numFavorites; i++)
+		numRecent = _removeGame(recent, numRecent, &favorites[i]);
+
+	for (int i = 0; (i < numRecent) && (count < maxEntries); i++)
+		entries[count++] = recent[i];
+
+	return count;
+}
+
+void quick_recordLaunch(const QuickEntry *entry) {
+	QuickEntry recent[QUICK_MAX_RECENT + 1];
+
+	int count = _loadList("recent", &recent[1], QUICK_MAX_RECENT);
+
+	recent[0] = *entry;
+	count     = _removeGame(&recent[1], count, entry) + 1;
+
+	if (count > QUICK_MAX_RECENT)
+		count = QUICK_MAX_RECENT;
+
+	_saveList("recent", recent, count, QUICK_MAX_RECENT);
+}
+
+bool quick_isFavorite(const QuickEntry *entry) {
+	QuickEntry favorites[QUICK_MAX_FAVORITES];
+
+	int count = _loadList("fav", favorites, QUICK_MAX_FAVORITES);
+
+	return _removeGame(favorites, count, entry) != count;
+}
+
+bool quick_toggleFavorite(const QuickEntry *entry) {
+	QuickEntry favorites[QUICK_MAX_FAVORITES];
+
+	int  count    = _loadList("fav", favorites, QUICK_MAX_FAVORITES);
+	int  newCount = _removeGame(favorites, count, entry);
+	bool added    = (newCount == count);
+
+	if (added) {
+		// Drop the oldest favorite if the list is full.
+		if (newCount == QUICK_MAX_FAVORITES) {
+			newCount--;
+			memmove(
+				&favorites[0], &favorites[1], newCount * sizeof(QuickEntry)
+			);
+		}
+
+		favorites[newCount++] = *entry;
+	}
+
+	_saveList("fav", favorites, newCount, QUICK_MAX_FAVORITES);
+	return added;
+}
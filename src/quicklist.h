@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Recently launched and favorite games are kept in the settings store, so that
+// they can be shown (and launched) right after boot without waiting for the
+// SD card listing. Each entry holds the game's stable ID (see picostation.h),
+// plus the IDs of the directories leading to it from the root of the card.
+// Older firmware can only select games by index, so the directories are then
+// looked up one level at a time in fresh listings; as indices change whenever
+// files are added to the card, they are never stored.
+#define QUICK_MAX_DEPTH     8
+#define QUICK_NAME_LENGTH   64
+#define QUICK_MAX_RECENT    5
+#define QUICK_MAX_FAVORITES 8
+#define QUICK_MAX_ENTRIES   (QUICK_MAX_RECENT + QUICK_MAX_FAVORITES)
+
+typedef struct {
+	uint8_t  depth;
+	bool     favorite;
+	uint32_t id;
+	uint32_t path[QUICK_MAX_DEPTH];
+	char     name[QUICK_NAME_LENGTH];
+} QuickEntry;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Fill in an entry for a game, given the IDs of the directories
+/// leading to it (excluding the root). Returns false if the game is nested too
+/// deeply to be recorded.
+bool quick_setupEntry(
+	QuickEntry *entry, const uint32_t *path, int depth, uint32_t id,
+	const char *name
+);
+
+/// @brief Load the quick list, favorites first, followed by any recently
+/// played games that are not also favorites. The settings store must be
+/// ready.
+/// @return Number of entries loaded.
+int quick_load(QuickEntry *entries, int maxEntries);
+
+/// @brief Move a game to the top of the recently played list.
+void quick_recordLaunch(const QuickEntry *entry);
+
+/// @brief Return whether a game is in the favorites list.
+bool quick_isFavorite(const QuickEntry *entry);
+
+/// @brief Add a game to the favorites list, or remove it if already present.
+/// @return True if the game is now a favorite.
+bool quick_toggleFavorite(const QuickEntry *entry);
+
+#ifdef __cplusplus
+}
+#endif
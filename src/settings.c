@@ -0,0 +1,484 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "memcard.h"
+#include "settings.h"
+
+// The store is saved as a regular single block save file, so that it shows up
+// (and can be deleted) in the BIOS memory card manager. The first two frames
+// of the block hold the file's title and icon, the rest holds the store itself:
+// an 8-byte header followed by a list of entries, each made up of a key length
+// byte, a value length byte, the key and the value.
+#define TITLE_FRAMES  2
+#define STORE_SIZE    (SETTINGS_DATA_FRAMES * MEMCARD_FRAME_SIZE)
+#define HEADER_SIZE   8
+#define STORE_MAGIC   "PSET"
+
+#define DIR_FREE        0xa0
+#define DIR_FIRST_BLOCK 0x51
+#define DIR_NAME_OFFSET 0x0a
+#define DIR_NAME_LENGTH 20
+
+// Consecutive failed writes after which saving is given up on.
+#define MAX_WRITE_ERRORS 4
+
+typedef enum {
+	SETTINGS_SM_IDLE        = 0,
+	SETTINGS_SM_READ_HEADER = 1,
+	SETTINGS_SM_READ_DIR    = 2,
+	SETTINGS_SM_READ_DATA   = 3,
+	SETTINGS_SM_WRITE_TITLE = 4,
+	SETTINGS_SM_WRITE_DATA  = 5,
+	SETTINGS_SM_WRITE_DIR   = 6,
+	SETTINGS_SM_DISABLED    = 7 // No usable card, store is kept in RAM only
+} SettingsStateMachineState;
+
+static SettingsStateMachineState _state = SETTINGS_SM_DISABLED;
+static bool                      _ready = false;
+
+static int      _block, _freeBlock, _frame;
+static bool     _creating;
+static uint32_t _dirtyFrames;
+static int      _idleFrames, _writeErrors;
+
+static uint8_t _frameBuffer[MEMCARD_FRAME_SIZE];
+static uint8_t _store[STORE_SIZE];
+
+static int _getLength(void) {
+	return _store[4] | (_store[5] << 8);
+}
+
+static void _setLength(int length) {
+	_store[4] = length & 0xff;
+	_store[5] = length >> 8;
+}
+
+static void _clearStore(void) {
+	memset(_store, 0, STORE_SIZE);
+	memcpy(_store, STORE_MAGIC, 4);
+}
+
+static void _markDirty(int start, int end) {
+	// The header (which holds the length) is always rewritten as well.
+	_dirtyFrames |= 1;
+
+	for (
+		int i = start / MEMCARD_FRAME_SIZE;
+		i <= ((end - 1) / MEMCARD_FRAME_SIZE); i++
+	)
+		_dirtyFrames |= 1 << i;
+
+	_idleFrames = 0;
+}
+
+static int _findEntry(const char *key, int keyLength) {
+	int offset = HEADER_SIZE;
+	int end    = HEADER_SIZE + _getLength();
+
+	while (offset < end) {
+		int entryKeyLength   = _store[offset];
+		int entryValueLength = _store[offset + 1];
+
+		if (
+			(entryKeyLength == keyLength) &&
+			!memcmp(&_store[offset + 2], key, keyLength)
+		)
+			return offset;
+
+		offset += 2 + entryKeyLength + entryValueLength;
+	}
+
+	return -1;
+}
+
+static void _removeEntry(int offset) {
+	int entryLength = 2 + _store[offset] + _store[offset + 1];
+	int end         = HEADER_SIZE + _getLength();
+
+	memmove(
+		&_store[offset], &_store[offset + entryLength],
+		end - (offset + entryLength)
+	);
+	memset(&_store[end - entryLength], 0, entryLength);
+	_setLength(_getLength() - entryLength);
+	_markDirty(offset, end);
+}
+
+int settings_get(const char *key, void *value, int maxLength) {
+	int offset = _findEntry(key, strlen(key));
+
+	if (offset < 0)
+		return -1;
+
+	int keyLength   = _store[offset];
+	int valueLength = _store[offset + 1];
+
+	if (maxLength > valueLength)
+		maxLength = valueLength;
+
+	memcpy(value, &_store[offset + 2 + keyLength], maxLength);
+	return valueLength;
+}
+
+bool settings_set(const char *key, const void *value, int length) {
+	int keyLength = strlen(key);
+
+	if ((keyLength > SETTINGS_MAX_KEY) || (length > SETTINGS_MAX_VALUE))
+		return false;
+
+	// Entries are replaced by removing the old one and appending the new one
+	// at the end, so the existing entry must be taken into account when
+	// checking for free space.
+	int offset    = _findEntry(key, keyLength);
+	int freeSpace = STORE_SIZE - (HEADER_SIZE + _getLength());
+
+	if (offset >= 0) {
+		freeSpace += 2 + _store[offset] + _store[offset + 1];
+
+		if (
+			(_store[offset + 1] == length) &&
+			!memcmp(&_store[offset + 2 + keyLength], value, length)
+		)
+			return true;
+	}
+	if ((2 + keyLength + length) > freeSpace)
+		return false;
+	if (offset >= 0)
+		_removeEntry(offset);
+
+	int end = HEADER_SIZE + _getLength();
+
+	_store[end]     = keyLength;
+	_store[end + 1] = length;
+	memcpy(&_store[end + 2], key, keyLength);
+	memcpy(&_store[end + 2 + keyLength], value, length);
+
+	_setLength(_getLength() + 2 + keyLength + length);
+	_markDirty(end, end + 2 + keyLength + length);
+	return true;
+}
+
+void settings_remove(const char *key) {
+	int offset = _findEntry(key, strlen(key));
+
+	if (offset >= 0)
+		_removeEntry(offset);
+}
+
+static void _encodeTitle(uint8_t *output, const char *title) {
+	// Titles are stored in Shift-JIS. Only the full width variants of ASCII
+	// letters, digits and spaces are displayed properly by the BIOS.
+	for (; *title; title++) {
+		char     ch = *title;
+		uint16_t sjis;
+
+		if ((ch >= 'A') && (ch <= 'Z'))
+			sjis = 0x8260 + (ch - 'A');
+		else if ((ch >= 'a') && (ch <= 'z'))
+			sjis = 0x8281 + (ch - 'a');
+		else if ((ch >= '0') && (ch <= '9'))
+			sjis = 0x824f + (ch - '0');
+		else
+			sjis = 0x8140;
+
+		*(output++) = sjis >> 8;
+		*(output++) = sjis & 0xff;
+	}
+}
+
+static void _buildTitleFrame(uint8_t *frame) {
+	memset(frame, 0, MEMCARD_FRAME_SIZE);
+
+	frame[0] = 'S';
+	frame[1] = 'C';
+	frame[2] = 0x11; // Static icon, 1 frame
+	frame[3] = 1;    // Block count
+	_encodeTitle(&frame[4], "PICOSTATION LOADER");
+
+	// Icon palette: transparent, white and dark blue.
+	frame[0x60 + 2] = 0xff;
+	frame[0x60 + 3] = 0x7f;
+	frame[0x60 + 4] = 0x00;
+	frame[0x60 + 5] = 0x50;
+}
+
+static void _buildIconFrame(uint8_t *frame) {
+	// 16x16 4bpp icon: a white frame around a blue square.
+	for (int y = 0; y < 16; y++) {
+		for (int x = 0; x < 16; x += 2) {
+			bool    edgeY = (y == 1) || (y == 14);
+			uint8_t left  = (edgeY || (x == 0)) ? 1 : 2;
+			uint8_t right = (edgeY || (x == 14)) ? 1 : 2;
+
+			if ((y == 0) || (y == 15))
+				left = right = 0;
+
+			frame[y * 8 + x / 2] = left | (right << 4);
+		}
+	}
+}
+
+static void _buildDirFrame(uint8_t *frame) {
+	memset(frame, 0, MEMCARD_FRAME_SIZE);
+
+	frame[0] = DIR_FIRST_BLOCK;
+	frame[5] = (MEMCARD_FRAMES_PER_BLOCK * MEMCARD_FRAME_SIZE) >> 8;
+	frame[8] = 0xff; // No next block
+	frame[9] = 0xff;
+	memcpy(&frame[DIR_NAME_OFFSET], SETTINGS_FILE_NAME, DIR_NAME_LENGTH);
+
+	uint8_t checksum = 0;
+
+	for (int i = 0; i < (MEMCARD_FRAME_SIZE - 1); i++)
+		checksum ^= frame[i];
+
+	frame[MEMCARD_FRAME_SIZE - 1] = checksum;
+}
+
+static int _getFrame(int offset) {
+	return _block * MEMCARD_FRAMES_PER_BLOCK + offset;
+}
+
+static void _finishLoading(void) {
+	_ready       = true;
+	_state       = SETTINGS_SM_IDLE;
+	_dirtyFrames = 0;
+}
+
+static void _disable(void) {
+	_ready = true;
+	_state = SETTINGS_SM_DISABLED;
+}
+
+// Returns false if saving has been given up on.
+static bool _handleWriteError(MemcardStatus status) {
+	if ((status == MEMCARD_NO_CARD) || (++_writeErrors >= MAX_WRITE_ERRORS)) {
+		_disable();
+		return false;
+	}
+
+	// Try again after the usual delay.
+	_idleFrames = 0;
+	_state      = SETTINGS_SM_IDLE;
+	return true;
+}
+
+static void _writeNextFrame(void) {
+	if (!_dirtyFrames) {
+		// New files only become visible once all of their frames have been
+		// written.
+		if (_creating) {
+			_buildDirFrame(_frameBuffer);
+			memcard_startWrite(SETTINGS_PORT, _block, _frameBuffer);
+			_state = SETTINGS_SM_WRITE_DIR;
+		} else {
+			_state = SETTINGS_SM_IDLE;
+		}
+
+		return;
+	}
+
+	// The bit is cleared before the write rather than after it, so that
+	// frames changed while being written are written again.
+	_frame = __builtin_ctz(_dirtyFrames);
+
+	_dirtyFrames &= ~(1 << _frame);
+	memcard_startWrite(
+		SETTINGS_PORT, _getFrame(TITLE_FRAMES + _frame),
+		&_store[_frame * MEMCARD_FRAME_SIZE]
+	);
+	_state = SETTINGS_SM_WRITE_DATA;
+}
+
+static void _startSaving(void) {
+	if (_block >= 0) {
+		_writeNextFrame();
+		return;
+	}
+
+	if (_freeBlock < 0) {
+		// The card is full.
+		_disable();
+		return;
+	}
+
+	_block    = _freeBlock;
+	_creating = true;
+	_frame    = 0;
+
+	_buildTitleFrame(_frameBuffer);
+	memcard_startWrite(SETTINGS_PORT, _getFrame(0), _frameBuffer);
+	_state = SETTINGS_SM_WRITE_TITLE;
+}
+
+void settings_init(void) {
+	_clearStore();
+
+	_block       = -1;
+	_freeBlock   = -1;
+	_creating    = false;
+	_dirtyFrames = 0;
+	_idleFrames  = 0;
+	_writeErrors = 0;
+	_ready       = false;
+
+	// Start by reading the card's header frame to make sure it is formatted.
+	if (memcard_startRead(SETTINGS_PORT, 0, _frameBuffer))
+		_state = SETTINGS_SM_READ_HEADER;
+	else
+		_disable();
+}
+
+void settings_update(void) {
+	MemcardStatus status = memcard_update();
+
+	if (status == MEMCARD_BUSY)
+		return;
+
+	switch (_state) {
+		case SETTINGS_SM_IDLE:
+			if (!_dirtyFrames)
+				break;
+			if (++_idleFrames < SETTINGS_WRITE_DELAY)
+				break;
+
+			_startSaving();
+			break;
+
+		case SETTINGS_SM_READ_HEADER:
+			if (
+				(status != MEMCARD_OK) ||
+				(_frameBuffer[0] != 'M') || (_frameBuffer[1] != 'C')
+			) {
+				_disable();
+				break;
+			}
+
+			_frame = 1;
+			memcard_startRead(SETTINGS_PORT, _frame, _frameBuffer);
+			_state = SETTINGS_SM_READ_DIR;
+			break;
+
+		case SETTINGS_SM_READ_DIR:
+			if (status != MEMCARD_OK) {
+				_disable();
+				break;
+			}
+
+			// Directory frame N describes block N.
+			if (((_frameBuffer[0] & 0xf0) == DIR_FREE) && (_freeBlock < 0))
+				_freeBlock = _frame;
+			if (
+				(_frameBuffer[0] == DIR_FIRST_BLOCK) && !memcmp(
+					&_frameBuffer[DIR_NAME_OFFSET], SETTINGS_FILE_NAME,
+					DIR_NAME_LENGTH
+				)
+			)
+				_block = _frame;
+
+			if (_block >= 0) {
+				_frame = 0;
+				memcard_startRead(
+					SETTINGS_PORT, _getFrame(TITLE_FRAMES), _store
+				);
+				_state = SETTINGS_SM_READ_DATA;
+			} else if (++_frame < MEMCARD_NUM_BLOCKS) {
+				memcard_startRead(SETTINGS_PORT, _frame, _frameBuffer);
+			} else {
+				_finishLoading();
+			}
+			break;
+
+		case SETTINGS_SM_READ_DATA: {
+			if (status != MEMCARD_OK) {
+				_clearStore();
+				_disable();
+				break;
+			}
+
+			// Only read as many frames as the store actually uses.
+			if (memcmp(_store, STORE_MAGIC, 4)) {
+				_clearStore();
+				_finishLoading();
+				break;
+			}
+
+			int used = (HEADER_SIZE + _getLength() + MEMCARD_FRAME_SIZE - 1)
+				/ MEMCARD_FRAME_SIZE;
+
+			if ((used > SETTINGS_DATA_FRAMES) || (++_frame >= used)) {
+				if (used > SETTINGS_DATA_FRAMES)
+					_clearStore();
+
+				_finishLoading();
+				break;
+			}
+
+			memcard_startRead(
+				SETTINGS_PORT, _getFrame(TITLE_FRAMES + _frame),
+				&_store[_frame * MEMCARD_FRAME_SIZE]
+			);
+		} break;
+
+		case SETTINGS_SM_WRITE_TITLE:
+			if (status != MEMCARD_OK) {
+				_block    = -1;
+				_creating = false;
+				_handleWriteError(status);
+				break;
+			}
+
+			if (!_frame) {
+				_frame = 1;
+				_buildIconFrame(_frameBuffer);
+				memcard_startWrite(SETTINGS_PORT, _getFrame(1), _frameBuffer);
+				break;
+			}
+
+			// All frames in use must be written to a new file.
+			_markDirty(0, HEADER_SIZE + _getLength());
+			_writeNextFrame();
+			break;
+
+		case SETTINGS_SM_WRITE_DATA:
+			if (status != MEMCARD_OK) {
+				_dirtyFrames |= 1 << _frame;
+				_handleWriteError(status);
+				break;
+			}
+
+			_writeErrors = 0;
+			_writeNextFrame();
+			break;
+
+		case SETTINGS_SM_WRITE_DIR:
+			if (status != MEMCARD_OK) {
+				// Rewriting any frame is enough to retry creating the entry.
+				_dirtyFrames |= 1;
+				_handleWriteError(status);
+				break;
+			}
+
+			_creating    = false;
+			_writeErrors = 0;
+			_state       = SETTINGS_SM_IDLE;
+			break;
+
+		default:
+			break;
+	}
+}
+
+bool settings_isReady(void) {
+	return _ready;
+}
+
+void settings_flush(void) {
+	while (
+		(_state != SETTINGS_SM_DISABLED) &&
+		(_dirtyFrames || _creating || (_state != SETTINGS_SM_IDLE))
+	) {
+		_idleFrames = SETTINGS_WRITE_DELAY;
+		settings_update();
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Loader settings, favorites and recently played games are kept in a small
+// key/value store, saved as a single block file on the memory card in slot 1.
+// Values are arbitrary binary blobs of up to 255 bytes.
+#define SETTINGS_PORT        0
+#define SETTINGS_FILE_NAME   "BASCUS-00000PICOLDR"
+#define SETTINGS_DATA_FRAMES 16
+#define SETTINGS_MAX_KEY     32
+#define SETTINGS_MAX_VALUE   255
+
+// Frames to wait after the last change before writing the store back, so that
+// several changes in a row are saved together.
+#define SETTINGS_WRITE_DELAY 120
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Start loading the store from the memory card in the background.
+/// Must be called after input_init(), as both share the controller bus.
+void settings_init(void);
+
+/// @brief Advance the load/save state machine. Must be called once per
+/// frame; never blocks.
+void settings_update(void);
+
+/// @brief Return whether loading has finished (or failed, in which case the
+/// store starts out empty and is only kept in RAM). Changes made before that
+/// are overwritten by the loaded data.
+bool settings_isReady(void);
+
+/// @brief Copy a value into the provided buffer.
+/// @return Length of the value, or -1 if the key doesn't exist.
+int settings_get(const char *key, void *value, int maxLength);
+
+/// @brief Add or replace a value. The store is written back to the card
+/// SETTINGS_WRITE_DELAY frames after the last change.
+/// @return False if the key or value are too long or the store is full.
+bool settings_set(const char *key, const void *value, int length);
+
+/// @brief Remove a value, if present.
+void settings_remove(const char *key);
+
+/// @brief Block until all pending changes have been written to the card. Only
+/// meant to be used right before leaving the loader.
+void settings_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
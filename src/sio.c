@@ -0,0 +1,303 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ps1/registers.h"
+#include "includes/system.h"
+#include "sio.h"
+
+// Delays in microseconds, same as the ones previously used by the blocking
+// implementation in controller.c.
+#define DTR_DELAY   150
+#define DSR_TIMEOUT 120
+#define PACKET_GAP  20
+
+// Time to wait for a received byte that didn't show up by the time its
+// acknowledge was handled. A byte takes 32 us to transfer at 250000bps.
+#define RX_TIMEOUT  40
+
+// Timer 2 is clocked from the system clock divided by 8.
+#define US_TO_TICKS(us) (((us) * (F_CPU / 8 / 1000)) / 1000)
+
+#define SIO_CTRL_BASE \
+	(SIO_CTRL_TX_ENABLE | SIO_CTRL_RX_ENABLE | SIO_CTRL_DSR_IRQ_ENABLE)
+
+typedef enum {
+	_STATE_IDLE        = 0, // No transfer in progress
+	_STATE_SELECT      = 1, // DTR asserted, waiting before sending the address
+	_STATE_ADDRESS_ACK = 2, // Address sent, waiting for the device to respond
+	_STATE_DATA_ACK    = 3, // Data byte sent, waiting for an acknowledge
+	_STATE_RELEASE     = 4, // Transfer over, waiting before releasing DTR
+	_STATE_GAP         = 5, // DTR released, waiting before the next transfer
+	_STATE_RECEIVE     = 6  // Byte acknowledged, waiting for it to be received
+} SIOState;
+
+static volatile SIOState _state = _STATE_IDLE;
+static SIOTransfer       *volatile _queueHead = NULL;
+static SIOTransfer       *_queueTail = NULL;
+static uint16_t          _reqOffset;
+
+static void _startTimer(int time) {
+	// Timer 2 is used in one-shot mode: writing to the control register resets
+	// the counter, and a single IRQ is fired once it reaches the target value.
+	TIMER_CTRL(2)   = TIMER_CTRL_PRESCALE;
+	TIMER_RELOAD(2) = US_TO_TICKS(time);
+	TIMER_CTRL(2)   = 0
+		| TIMER_CTRL_RELOAD
+		| TIMER_CTRL_IRQ_ON_RELOAD
+		| TIMER_CTRL_PRESCALE;
+}
+
+static void _stopTimer(void) {
+	TIMER_CTRL(2) = TIMER_CTRL_PRESCALE;
+	IRQ_STAT      = ~(1 << IRQ_TIMER2);
+}
+
+static void _startTransfer(void) {
+	SIOTransfer *transfer = _queueHead;
+
+	if (!transfer) {
+		_state = _STATE_IDLE;
+		return;
+	}
+
+	transfer->status     = SIO_STATUS_ACTIVE;
+	transfer->respLength = 0;
+	_reqOffset           = 0;
+
+	// Assert DTR on the port the device is connected to. Devices may take some
+	// time to prepare for incoming bytes, so the address is only sent once
+	// the timer fires.
+	SIO_CTRL(0) = SIO_CTRL_BASE
+		| SIO_CTRL_DTR
+		| SIO_CTRL_ACKNOWLEDGE
+		| (transfer->port ? SIO_CTRL_CS_PORT_2 : SIO_CTRL_CS_PORT_1);
+
+	_state = _STATE_SELECT;
+	_startTimer(DTR_DELAY);
+}
+
+static void _finishTransfer(void) {
+	SIOTransfer *transfer = _queueHead;
+
+	_queueHead = transfer->next;
+
+	if (!_queueHead)
+		_queueTail = NULL;
+
+	transfer->next   = NULL;
+	transfer->status = SIO_STATUS_DONE;
+
+	_startTransfer();
+}
+
+static void _release(void) {
+	_state = _STATE_RELEASE;
+	_startTimer(DTR_DELAY);
+}
+
+static void _sendNextByte(SIOTransfer *transfer) {
+	uint8_t value = 0;
+
+	// Pad the request with zeroes if the response is longer.
+	if (_reqOffset < transfer->reqLength)
+		value = transfer->request[_reqOffset++];
+
+	SIO_DATA(0) = value;
+
+	_state = _STATE_DATA_ACK;
+	_startTimer(DSR_TIMEOUT);
+}
+
+static void _receiveByte(SIOTransfer *transfer) {
+	transfer->response[transfer->respLength++] = SIO_DATA(0);
+
+	if (transfer->respLength < transfer->maxRespLength)
+		_sendNextByte(transfer);
+	else
+		_release();
+}
+
+// Interrupts are dispatched by the exception handler, which doesn't run while
+// they are disabled. Code waiting for a transfer with interrupts disabled
+// (e.g. from within another handler) calls the handlers itself instead.
+static void _pollInterrupts(void) {
+	if (cop0_getReg(COP0_STATUS) & COP0_STATUS_IEc)
+		return;
+
+	// The SIO0 handler may cancel a pending timeout, so it must run first.
+	if (acknowledgeInterrupt(IRQ_SIO0))
+		sio_handleInterrupt();
+	if (acknowledgeInterrupt(IRQ_TIMER2))
+		sio_handleTimerInterrupt();
+}
+
+void sio_init(void) {
+	// Reset the serial interface and initialize it with the settings used by
+	// controllers and memory cards (250000bps, 8 data bits). An IRQ is raised
+	// whenever the device pulses DSR to acknowledge a byte.
+	SIO_CTRL(0) = SIO_CTRL_RESET;
+
+	SIO_MODE(0) = 0
+		| SIO_MODE_BAUD_DIV1
+		| SIO_MODE_DATA_8;
+	SIO_BAUD(0) = F_CPU / 250000;
+	SIO_CTRL(0) = SIO_CTRL_BASE;
+
+	_stopTimer();
+
+	_state     = _STATE_IDLE;
+	_queueHead = NULL;
+	_queueTail = NULL;
+}
+
+void sio_setupTransfer(
+	SIOTransfer *transfer, int port, uint8_t address, const uint8_t *request,
+	uint8_t *response, int reqLength, int maxRespLength
+) {
+	transfer->next          = NULL;
+	transfer->request       = request;
+	transfer->response      = response;
+	transfer->port          = port;
+	transfer->address       = address;
+	transfer->reqLength     = reqLength;
+	transfer->maxRespLength = maxRespLength;
+	transfer->respLength    = 0;
+	transfer->status        = SIO_STATUS_IDLE;
+}
+
+bool sio_submit(SIOTransfer *transfer) {
+	bool enable = disableInterrupts();
+	bool queued = false;
+
+	if (
+		(transfer->status != SIO_STATUS_QUEUED) &&
+		(transfer->status != SIO_STATUS_ACTIVE)
+	) {
+		transfer->next   = NULL;
+		transfer->status = SIO_STATUS_QUEUED;
+
+		if (_queueTail)
+			_queueTail->next = transfer;
+		else
+			_queueHead = transfer;
+
+		_queueTail = transfer;
+		queued     = true;
+
+		if (_state == _STATE_IDLE)
+			_startTransfer();
+	}
+
+	if (enable)
+		enableInterrupts();
+
+	return queued;
+}
+
+int sio_wait(SIOTransfer *transfer) {
+	while (!sio_isDone(transfer))
+		_pollInterrupts();
+
+	return transfer->respLength;
+}
+
+void sio_flush(void) {
+	while (_queueHead || (_state != _STATE_IDLE))
+		_pollInterrupts();
+}
+
+void sio_handleInterrupt(void) {
+	// Reset the serial interface's flag to ensure the interrupt can be
+	// triggered again. Acknowledges received while no byte is pending (e.g.
+	// from sendPacketNoAcknowledge()) are ignored.
+	SIO_CTRL(0) |= SIO_CTRL_ACKNOWLEDGE;
+
+	SIOTransfer *transfer = _queueHead;
+
+	switch (_state) {
+		case _STATE_ADDRESS_ACK:
+			_stopTimer();
+
+			// Discard whatever was received while sending the address.
+			while (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY)
+				SIO_DATA(0);
+
+			_sendNextByte(transfer);
+			break;
+
+		case _STATE_DATA_ACK:
+			_stopTimer();
+
+			// The acknowledge is normally only sent once the byte has been
+			// fully transferred. Rather than spinning here if it hasn't been
+			// received yet, give it a little more time.
+			if (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY) {
+				_receiveByte(transfer);
+			} else {
+				_state = _STATE_RECEIVE;
+				_startTimer(RX_TIMEOUT);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+void sio_handleTimerInterrupt(void) {
+	SIOTransfer *transfer = _queueHead;
+
+	switch (_state) {
+		case _STATE_SELECT:
+			while (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY)
+				SIO_DATA(0);
+
+			SIO_DATA(0) = transfer->address;
+
+			_state = _STATE_ADDRESS_ACK;
+			_startTimer(DSR_TIMEOUT);
+			break;
+
+		case _STATE_ADDRESS_ACK:
+			// No device is connected.
+			_release();
+			break;
+
+		case _STATE_DATA_ACK:
+			// The device does not acknowledge the last byte of a packet, so a
+			// timeout here is the normal way for a transfer to end. The byte
+			// itself has still been received.
+			if (
+				(SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY) &&
+				(transfer->respLength < transfer->maxRespLength)
+			)
+				transfer->response[transfer->respLength++] = SIO_DATA(0);
+
+			_release();
+			break;
+
+		case _STATE_RECEIVE:
+			// If the byte never arrived, end the transfer early. The caller
+			// sees a short response.
+			if (SIO_STAT(0) & SIO_STAT_RX_NOT_EMPTY)
+				_receiveByte(transfer);
+			else
+				_release();
+			break;
+
+		case _STATE_RELEASE:
+			// Release DTR, allowing the device to go idle.
+			SIO_CTRL(0) = SIO_CTRL_BASE;
+
+			_state = _STATE_GAP;
+			_startTimer(PACKET_GAP);
+			break;
+
+		case _STATE_GAP:
+			_finishTransfer();
+			break;
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interrupt driven driver for the controller and memory card bus. Transfers
+// are queued and carried out in the background: each byte is sent from the
+// SIO0 (DSR acknowledge) interrupt handler, while the delays around DTR and the
+// acknowledge timeout are timed by timer 2 rather than busy waiting.
+typedef enum {
+	SIO_STATUS_IDLE   = 0, // Never submitted
+	SIO_STATUS_QUEUED = 1,
+	SIO_STATUS_ACTIVE = 2,
+	SIO_STATUS_DONE   = 3
+} SIOStatus;
+
+typedef struct SIOTransfer {
+	struct SIOTransfer *next;
+
+	const uint8_t *request;
+	uint8_t       *response;
+	uint8_t       port, address;
+	uint16_t      reqLength, maxRespLength;
+
+	// Filled in by the driver. respLength is zero if no device acknowledged
+	// the address byte.
+	volatile uint16_t  respLength;
+	volatile SIOStatus status;
+} SIOTransfer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Reset SIO0 and timer 2 and configure them for use by the driver.
+/// The SIO0 and timer 2 interrupts must be enabled and dispatched to
+/// sio_handleInterrupt() and sio_handleTimerInterrupt().
+void sio_init(void);
+
+/// @brief Fill in a transfer descriptor. The request and response buffers
+/// must remain valid until the transfer is done.
+void sio_setupTransfer(
+	SIOTransfer *transfer, int port, uint8_t address, const uint8_t *request,
+	uint8_t *response, int reqLength, int maxRespLength
+);
+
+/// @brief Queue a transfer, starting it immediately if the bus is idle. Safe
+/// to call from both the main loop and a background worker, but not from
+/// interrupt handlers.
+/// @return False if the transfer is already queued or in progress.
+bool sio_submit(SIOTransfer *transfer);
+
+/// @brief Return whether a transfer has completed.
+static inline bool sio_isDone(const SIOTransfer *transfer) {
+	return (transfer->status == SIO_STATUS_DONE);
+}
+
+/// @brief Block until a transfer has completed, then return the number of
+/// bytes received. Can also be called with interrupts disabled, in which case
+/// the interrupt handlers are polled.
+int sio_wait(SIOTransfer *transfer);
+
+/// @brief Block until all queued transfers have completed.
+void sio_flush(void);
+
+void sio_handleInterrupt(void);
+void sio_handleTimerInterrupt(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,307 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "gpu.h"
+#include "vram.h"
+#include "ps1/gpucmd.h"
+
+// All textures and palettes live in the parts of VRAM not covered by the
+// framebuffers. Rather than hardcoding where each image goes, the area is
+// divided into 16x16 word cells and tracked with a bitmap; allocations take a
+// rectangle of free cells, first fit, scanning from the top left.
+//
+// The GPU can only sample a texture from within the texture page it is bound
+// to. A page is 64 words wide and 256 lines tall, but the U coordinate covers
+// 256 pixels so 8bpp and 16bpp textures may extend into the pages to their
+// right (2 and 4 pages respectively). Allocations never cross a 256-line
+// boundary.
+
+#define _CELLS_PER_PAGE_Y (VRAM_PAGE_HEIGHT / VRAM_CELL_SIZE)
+#define _CLUT_SLOTS       (256 / 16)
+
+static uint32_t _usedCells[VRAM_CELLS_Y][VRAM_CELLS_X / 32];
+
+// Palettes are much smaller than a cell, so they are packed into a single
+// 256x16 block allocated on first use. Each row holds sixteen 16-color slots
+// or a single 256-color one.
+static int      _clutBlockX = -1, _clutBlockY = -1;
+static uint16_t _clutSlots[VRAM_CELL_SIZE];
+static int      _numCLUTs;
+
+static int _getWidthDivider(GP0ColorDepth colorDepth) {
+	switch (colorDepth) {
+		case GP0_COLOR_4BPP:
+			return 4;
+		case GP0_COLOR_8BPP:
+			return 2;
+		default:
+			return 1;
+	}
+}
+
+static inline bool _isCellUsed(int cx, int cy) {
+	return (_usedCells[cy][cx / 32] >> (cx % 32)) & 1u;
+}
+
+static void _markCells(int cx, int cy, int cw, int ch, bool used) {
+	for (int y = cy; y < (cy + ch); y++) {
+		for (int x = cx; x < (cx + cw); x++) {
+			if (used)
+				_usedCells[y][x / 32] |= 1u << (x % 32);
+			else
+				_usedCells[y][x / 32] &= ~(1u << (x % 32));
+		}
+	}
+}
+
+static bool _isAreaFree(int cx, int cy, int cw, int ch) {
+	for (int y = cy; y < (cy + ch); y++) {
+		for (int x = cx; x < (cx + cw); x++) {
+			if (_isCellUsed(x, y))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// Find and claim a free area of the given size in VRAM words. maxSpan is the
+// furthest (in words) the area may extend from the left edge of its texture
+// page.
+static bool _allocArea(int width, int height, int maxSpan, int *x, int *y) {
+	int cw = (width  + VRAM_CELL_SIZE - 1) / VRAM_CELL_SIZE;
+	int ch = (height + VRAM_CELL_SIZE - 1) / VRAM_CELL_SIZE;
+
+	if ((ch > _CELLS_PER_PAGE_Y) || (width > maxSpan))
+		return false;
+
+	for (int cy = 0; cy <= (VRAM_CELLS_Y - ch); cy++) {
+		if (((cy % _CELLS_PER_PAGE_Y) + ch) > _CELLS_PER_PAGE_Y)
+			continue;
+
+		for (int cx = 0; cx <= (VRAM_CELLS_X - cw); cx++) {
+			int areaX = cx * VRAM_CELL_SIZE;
+
+			if (((areaX % VRAM_PAGE_WIDTH) + width) > maxSpan)
+				continue;
+			if (!_isAreaFree(cx, cy, cw, ch))
+				continue;
+
+			_markCells(cx, cy, cw, ch, true);
+			*x = areaX;
+			*y = cy * VRAM_CELL_SIZE;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void vram_init(void) {
+	memset(_usedCells, 0, sizeof(_usedCells));
+	memset(_clutSlots, 0, sizeof(_clutSlots));
+
+	_clutBlockX = -1;
+	_clutBlockY = -1;
+	_numCLUTs   = 0;
+}
+
+void vram_reserve(int x, int y, int width, int height) {
+	int cx = x / VRAM_CELL_SIZE;
+	int cy = y / VRAM_CELL_SIZE;
+	int cw = (x + width  + VRAM_CELL_SIZE - 1) / VRAM_CELL_SIZE - cx;
+	int ch = (y + height + VRAM_CELL_SIZE - 1) / VRAM_CELL_SIZE - cy;
+
+	_markCells(cx, cy, cw, ch, true);
+}
+
+bool vram_allocTexture(
+	TextureInfo *info, int width, int height, GP0ColorDepth colorDepth
+) {
+	int divider = _getWidthDivider(colorDepth);
+	int x, y;
+
+	if ((width > 256) || (height > 256))
+		return false;
+	if (!_allocArea(
+		(width + divider - 1) / divider, height, 256 / divider, &x, &y
+	))
+		return false;
+
+	info->page   = gp0_page(
+		x / VRAM_PAGE_WIDTH, y / VRAM_PAGE_HEIGHT, GP0_BLEND_SEMITRANS,
+		colorDepth
+	);
+	info->clut   = 0;
+	info->u      = (uint8_t)  ((x % VRAM_PAGE_WIDTH) * divider);
+	info->v      = (uint8_t)  (y % VRAM_PAGE_HEIGHT);
+	info->width  = (uint16_t) width;
+	info->height = (uint16_t) height;
+	return true;
+}
+
+bool vram_allocCLUT(TextureInfo *info, GP0ColorDepth colorDepth) {
+	if (_clutBlockX < 0) {
+		if (!_allocArea(256, VRAM_CELL_SIZE, 256, &_clutBlockX, &_clutBlockY)) {
+			_clutBlockX = -1;
+			return false;
+		}
+	}
+
+	for (int row = 0; row < VRAM_CELL_SIZE; row++) {
+		if (colorDepth == GP0_COLOR_8BPP) {
+			if (_clutSlots[row])
+				continue;
+
+			_clutSlots[row] = 0xffff;
+			info->clut      = gp0_clut(_clutBlockX / 16, _clutBlockY + row);
+			_numCLUTs++;
+			return true;
+		}
+
+		for (int slot = 0; slot < _CLUT_SLOTS; slot++) {
+			if (_clutSlots[row] & (1 << slot))
+				continue;
+
+			_clutSlots[row] |= 1 << slot;
+			info->clut       = gp0_clut(
+				(_clutBlockX / 16) + slot, _clutBlockY + row
+			);
+			_numCLUTs++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void vram_getTextureOrigin(const TextureInfo *info, int *x, int *y) {
+	int divider = _getWidthDivider((info->page >> 7) & GP0_COLOR_BITMASK);
+
+	*x = (info->page & 15) * VRAM_PAGE_WIDTH + info->u / divider;
+	*y = ((info->page >> 4) & 1) * VRAM_PAGE_HEIGHT + info->v;
+}
+
+void vram_getCLUTOrigin(const TextureInfo *info, int *x, int *y) {
+	*x = (info->clut & 0x3f) * 16;
+	*y = info->clut >> 6;
+}
+
+void vram_freeTexture(TextureInfo *info) {
+	if (!info->width)
+		return;
+
+	GP0ColorDepth colorDepth = (info->page >> 7) & GP0_COLOR_BITMASK;
+	int           divider    = _getWidthDivider(colorDepth);
+	int           x, y;
+
+	// CLUT 0 would sit inside the first framebuffer, so it doubles as the
+	// "no palette" marker.
+	if (info->clut && (_clutBlockX >= 0)) {
+		vram_getCLUTOrigin(info, &x, &y);
+
+		int row = y - _clutBlockY;
+
+		if (colorDepth == GP0_COLOR_8BPP)
+			_clutSlots[row] = 0;
+		else
+			_clutSlots[row] &= ~(1 << ((x - _clutBlockX) / 16));
+
+		_numCLUTs--;
+	}
+
+	vram_getTextureOrigin(info, &x, &y);
+	_markCells(
+		x / VRAM_CELL_SIZE,
+		y / VRAM_CELL_SIZE,
+		((info->width + divider - 1) / divider + VRAM_CELL_SIZE - 1)
+			/ VRAM_CELL_SIZE,
+		(info->height + VRAM_CELL_SIZE - 1) / VRAM_CELL_SIZE,
+		false
+	);
+
+	info->width  = 0;
+	info->height = 0;
+	info->clut   = 0;
+}
+
+void vram_getStats(VRAMStats *stats) {
+	stats->totalCells       = VRAM_CELLS_X * VRAM_CELLS_Y;
+	stats->freeCells        = 0;
+	stats->largestFreeCells = 0;
+	stats->numCLUTs         = _numCLUTs;
+
+	// Find the largest free rectangle in each 256-line band, which is the
+	// largest texture that could still be allocated (ignoring the per-page
+	// width limit). This is only meant for debugging, so a simple O(n^2) scan
+	// over column heights is good enough.
+	for (int band = 0; band < VRAM_CELLS_Y; band += _CELLS_PER_PAGE_Y) {
+		uint8_t heights[VRAM_CELLS_X];
+
+		memset(heights, 0, sizeof(heights));
+
+		for (int cy = band; cy < (band + _CELLS_PER_PAGE_Y); cy++) {
+			for (int cx = 0; cx < VRAM_CELLS_X; cx++) {
+				if (_isCellUsed(cx, cy)) {
+					heights[cx] = 0;
+				} else {
+					heights[cx]++;
+					stats->freeCells++;
+				}
+			}
+
+			for (int left = 0; left < VRAM_CELLS_X; left++) {
+				int height = heights[left];
+
+				for (int right = left; (right < VRAM_CELLS_X) && height; right++) {
+					if (heights[right] < height)
+						height = heights[right];
+
+					int area = height * (right - left + 1);
+
+					if (area > stats->largestFreeCells)
+						stats->largestFreeCells = area;
+				}
+			}
+		}
+	}
+
+	stats->fragmentation = stats->freeCells
+		? (100 - (stats->largestFreeCells * 100) / stats->freeCells)
+		: 0;
+}
+
+bool vram_uploadTexture(
+	TextureInfo *info, const void *data, int width, int height
+) {
+	int x, y;
+
+	if (!vram_allocTexture(info, width, height, GP0_COLOR_16BPP))
+		return false;
+
+	vram_getTextureOrigin(info, &x, &y);
+	uploadTexture(info, data, x, y, width, height);
+	return true;
+}
+
+bool vram_uploadIndexedTexture(
+	TextureInfo *info, const void *image, const void *palette, int width,
+	int height, GP0ColorDepth colorDepth
+) {
+	int x, y, paletteX, paletteY;
+
+	if (!vram_allocTexture(info, width, height, colorDepth))
+		return false;
+	if (!vram_allocCLUT(info, colorDepth)) {
+		vram_freeTexture(info);
+		return false;
+	}
+
+	vram_getTextureOrigin(info, &x, &y);
+	vram_getCLUTOrigin(info, &paletteX, &paletteY);
+	uploadIndexedTexture(
+		info, image, palette, x, y, paletteX, paletteY, width, height,
+		colorDepth
+	);
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "gpu.h"
+#include "ps1/gpucmd.h"
+
+// VRAM is 1024x512 16-bit words. The allocator tracks it as a grid of 16x16
+// cells; every texture is rounded up to whole cells and placed so that it never
+// straddles a texture page boundary the GPU can't sample across.
+#define VRAM_WIDTH      1024
+#define VRAM_HEIGHT     512
+#define VRAM_CELL_SIZE  16
+#define VRAM_CELLS_X    (VRAM_WIDTH  / VRAM_CELL_SIZE)
+#define VRAM_CELLS_Y    (VRAM_HEIGHT / VRAM_CELL_SIZE)
+
+#define VRAM_PAGE_WIDTH  64
+#define VRAM_PAGE_HEIGHT 256
+
+typedef struct {
+	int totalCells, freeCells;
+	int largestFreeCells; // Largest free rectangle within a single page row
+	int fragmentation;    // Percentage of free cells outside that rectangle
+	int numCLUTs;
+} VRAMStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Mark the whole VRAM as free and drop all CLUT slots.
+void vram_init(void);
+
+/// @brief Permanently mark an area (e.g. a framebuffer) as used.
+void vram_reserve(int x, int y, int width, int height);
+
+/// @brief Find room for a texture and fill in page, UV and size. Width is in
+/// pixels, not VRAM words. The CLUT field is left zeroed.
+/// @return False if there is no free area large enough.
+bool vram_allocTexture(
+	TextureInfo *info, int width, int height, GP0ColorDepth colorDepth
+);
+
+/// @brief Allocate a 16 or 256 color palette slot and store it in info->clut.
+bool vram_allocCLUT(TextureInfo *info, GP0ColorDepth colorDepth);
+
+/// @brief Release the area and palette (if any) held by a texture.
+void vram_freeTexture(TextureInfo *info);
+
+/// @brief Recover the VRAM coordinates of a texture or its palette.
+void vram_getTextureOrigin(const TextureInfo *info, int *x, int *y);
+void vram_getCLUTOrigin(const TextureInfo *info, int *x, int *y);
+
+void vram_getStats(VRAMStats *stats);
+
+bool vram_uploadTexture(
+	TextureInfo *info, const void *data, int width, int height
+);
+bool vram_uploadIndexedTexture(
+	TextureInfo *info, const void *image, const void *palette, int width,
+	int height, GP0ColorDepth colorDepth
+);
+
+#ifdef __cplusplus
+}
+#endif
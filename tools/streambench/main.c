@@ -0,0 +1,235 @@
+/*
+ * Host-side bench for the stream driver (src/includes/stream.c). The driver is
+ * built unchanged and run against a simulated SPU and CD-ROM drive (see sim.h)
+ * for a few minutes of simulated playback, after which underruns, buffer
+ * occupancy and read latency are reported. Meant to be used to try out changes
+ * to the buffering policy without having to listen for dropouts on hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream.h"
+#include "sim.h"
+
+#define _FRAME_RATE    60
+#define _MAX_STREAMS   SIM_MAX_SONGS
+#define _SONG_SECONDS  120
+
+typedef struct BenchStream{
+	StreamContext ctx;
+	char          name[24];
+
+	uint32_t minBuffered, maxBuffered, samples;
+	uint64_t totalBuffered;
+} BenchStream;
+
+static BenchStream _streams[_MAX_STREAMS];
+
+static void _printUsage(const char *program){
+	fprintf(
+		stderr,
+		"Usage: %s [options]\n"
+		"  -t seconds   Length of simulated playback (default 300)\n"
+		"  -n streams   Number of streams playing at once, 1-%d (default 1)\n"
+		"  -c chunks    Ring buffer size in chunks (default 32)\n"
+		"  -i bytes     Interleave size, a multiple of 16 (default 2048)\n"
+		"  -r rate      Sample rate in Hz (default 44100)\n"
+		"  -s ms        Minimum seek time (default 80)\n"
+		"  -S ms        Maximum seek time (default 300)\n"
+		"  -e percent   Chance of a read being retried (default 2)\n"
+		"  -o count     Other reads per minute (default 20)\n"
+		"  -l ms        Length of other reads (default 200)\n"
+		"  -p           Count timer 1 at the PAL rather than NTSC hblank rate\n"
+		"  -x seed      Random seed (default 1)\n",
+		program, _MAX_STREAMS
+	);
+}
+
+static void _printLatency(const char *label, const SimLatency *latency){
+	if(!latency->count){
+		printf("%-24s none\n", label);
+		return;
+	}
+
+	printf(
+		"%-24s avg %4u ms, p99 %4u ms, max %4u ms\n", label,
+		(uint32_t) (latency->total / latency->count),
+		sim_getPercentile(latency, 99), latency->max
+	);
+}
+
+int main(int argc, char **argv){
+	SimConfig config = {
+		.seqLatency          = 20,
+		.seekMin             = 80,
+		.seekMax             = 300,
+		.retryChance         = 2,
+		.retryPenalty        = 500,
+		.otherReadsPerMinute = 20,
+		.otherReadLength     = 200,
+		.seed                = 1
+	};
+
+	int seconds    = 300;
+	int numStreams = 1;
+	int numChunks  = 32;
+	int interleave = 2048;
+	int sampleRate = 44100;
+	int option;
+
+	while((option = getopt(argc, argv, "t:n:c:i:r:s:S:e:o:l:px:h")) != -1){
+		switch(option){
+			case 't': seconds                    = atoi(optarg); break;
+			case 'n': numStreams                 = atoi(optarg); break;
+			case 'c': numChunks                  = atoi(optarg); break;
+			case 'i': interleave                 = atoi(optarg); break;
+			case 'r': sampleRate                 = atoi(optarg); break;
+			case 's': config.seekMin             = atoi(optarg); break;
+			case 'S': config.seekMax             = atoi(optarg); break;
+			case 'e': config.retryChance         = atoi(optarg); break;
+			case 'o': config.otherReadsPerMinute = atoi(optarg); break;
+			case 'l': config.otherReadLength     = atoi(optarg); break;
+			case 'p': config.pal                 = true;         break;
+			case 'x': config.seed                = strtoul(optarg, NULL, 0); break;
+
+			default:
+				_printUsage(argv[0]);
+				return 1;
+		}
+	}
+
+	if(
+		(seconds <= 0) || (numStreams < 1) || (numStreams > _MAX_STREAMS) ||
+		(numChunks < 4) || (interleave < 16) || (interleave % 16) ||
+		(sampleRate <= 0) || (config.seekMin < 0) ||
+		(config.seekMax < config.seekMin)
+	){
+		_printUsage(argv[0]);
+		return 1;
+	}
+
+	// Each stream's ring buffer holds numChunks interleaved blocks for both
+	// channels. Streams whose ring doesn't fit would just never start, so
+	// don't bother running.
+	uint64_t ringLength = (uint64_t) numStreams * numChunks * interleave * 2;
+
+	if(ringLength > sim_getAllocatableSPURAM()){
+		fprintf(
+			stderr,
+			"%d streams of %d chunks of %d bytes need %llu bytes of SPU RAM, "
+			"only %u can be allocated\n",
+			numStreams, numChunks, interleave, (unsigned long long) ringLength,
+			sim_getAllocatableSPURAM()
+		);
+		return 1;
+	}
+
+	if(!sim_init(&config)){
+		fprintf(stderr, "Failed to map the PS1 I/O registers\n");
+		return 1;
+	}
+
+	for(int i = 0; i < numStreams; i++){
+		BenchStream *bench = &_streams[i];
+
+		snprintf(bench->name, sizeof(bench->name), "SONG%d.VAG;1", i);
+		sim_addSong(bench->name, 2, interleave, sampleRate, _SONG_SECONDS);
+
+		streamContext_create(&bench->ctx);
+		streamContext_loadSong(&bench->ctx, bench->name, numChunks);
+		streamContext_play(&bench->ctx, MAX_VOLUME);
+
+		bench->minBuffered = UINT32_MAX;
+	}
+
+	// stream_update() is called once per frame, like the menu's main loop.
+	uint64_t frames = (uint64_t) seconds * _FRAME_RATE;
+
+	for(uint64_t frame = 0; frame < frames; frame++){
+		sim_run(SIM_SAMPLE_RATE / _FRAME_RATE);
+		stream_update();
+		sim_sync();
+
+		for(int i = 0; i < numStreams; i++){
+			BenchStream *bench  = &_streams[i];
+			Stream      *stream = &bench->ctx.stream;
+
+			if(!stream_isPlaying(stream)){
+				continue;
+			}
+
+			uint32_t buffered = stream->_bufferedChunks;
+
+			if(buffered < bench->minBuffered){
+				bench->minBuffered = buffered;
+			}
+			if(buffered > bench->maxBuffered){
+				bench->maxBuffered = buffered;
+			}
+
+			bench->totalBuffered += buffered;
+			bench->samples++;
+		}
+	}
+
+	double elapsed = (double) sim_getTime() / SIM_SAMPLE_RATE;
+
+	printf(
+		"\nSimulated %.1f s (%s), %d stream(s), %d chunks of %d bytes x 2 channels\n",
+		elapsed, config.pal ? "PAL" : "NTSC", numStreams, numChunks, interleave
+	);
+	printf(
+		"Drive: %u stream reads, %u other reads, %u retries, busy %.1f%%\n",
+		simStats.streamReads, simStats.otherReads, simStats.retries,
+		(100.0 * simStats.driveBusySamples) / sim_getTime()
+	);
+	_printLatency("Read to first sector:", &simStats.firstSector);
+	_printLatency("Read to last sector:", &simStats.lastSector);
+	printf(
+		"SPU IRQs: %u from voices, %u from DMA transfers\n",
+		simStats.spuIRQs, simStats.dmaIRQs
+	);
+
+	uint32_t problems = simStats.dmaIRQs;
+
+	for(int i = 0; i < numStreams; i++){
+		BenchStream         *bench = &_streams[i];
+		const StreamContext *ctx   = &bench->ctx;
+		const SimSongStats  *stats = &simStats.songs[i];
+
+		printf(
+			"\n%s: %u chunks played, %u underruns, %u near underruns, "
+			"%u glitches, silent for %.2f s\n",
+			bench->name, stats->chunks, ctx->stream.underruns,
+			ctx->stream.nearUnderruns, stats->glitches,
+			(double) stats->silentSamples / SIM_SAMPLE_RATE
+		);
+
+		if(bench->samples){
+			printf(
+				"  Buffered: min %u, avg %.1f, max %u chunks\n",
+				bench->minBuffered,
+				(double) bench->totalBuffered / bench->samples,
+				bench->maxBuffered
+			);
+		} else {
+			printf("  Never started playing\n");
+		}
+
+		printf(
+			"  Policy: latency %d chunks, margin %d chunks, refill at %d free\n",
+			ctx->latency, ctx->margin, ctx->refillChunks
+		);
+
+		problems += ctx->stream.underruns + stats->glitches;
+		if(!bench->samples){
+			problems++;
+		}
+	}
+
+	// Exit with an error if anything was audible, so that the bench can be
+	// used from scripts.
+	return problems ? 2 : 0;
+}
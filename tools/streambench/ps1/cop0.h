@@ -0,0 +1,31 @@
+/*
+ * Host replacement for ps1-bare-metal's ps1/cop0.h, used by the stream bench.
+ * The status register is a plain variable, so that disableInterrupts() and
+ * enableInterrupts() in system.h work as usual and the simulator can tell
+ * whether interrupts are enabled.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+	COP0_STATUS = 12 // Status register
+} COP0Register;
+
+typedef enum {
+	COP0_STATUS_IEc = 1 <<  0, // Current interrupt enable
+	COP0_STATUS_Im2 = 1 << 10, // IRQ mask 2 (hardware interrupt)
+	COP0_STATUS_CU0 = 1 << 28, // Coprocessor 0 privilege level
+	COP0_STATUS_CU2 = 1 << 30  // Coprocessor 2 enable
+} COP0StatusFlag;
+
+extern uint32_t simCOP0Status;
+
+static inline void cop0_setReg(const COP0Register reg, uint32_t value) {
+	if (reg == COP0_STATUS)
+		simCOP0Status = value;
+}
+static inline uint32_t cop0_getReg(const COP0Register reg) {
+	return (reg == COP0_STATUS) ? simCOP0Status : 0;
+}
@@ -0,0 +1,697 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ps1/registers.h"
+#include "cdrom.h"
+#include "filesystem.h"
+#include "spu.h"
+#include "system.h"
+#include "stream.h"
+#include "sim.h"
+
+// The simulator stands in for spu.c, cdrom.c and filesystem.c, providing only
+// the functions used by stream.c. Interrupts are delivered between samples,
+// with the COP0 IEc bit cleared while a handler runs as on real hardware.
+
+uint32_t simCOP0Status = COP0_STATUS_IEc;
+SimStats simStats;
+
+static SimConfig _config;
+static uint64_t  _now;
+static uint32_t  _random;
+
+static uint32_t _getRandom(void){
+	// xorshift32, good enough for latencies.
+	_random ^= _random << 13;
+	_random ^= _random >> 17;
+	_random ^= _random << 5;
+	return _random;
+}
+
+static uint64_t _msToSamples(uint32_t ms){
+	return ((uint64_t) ms * SIM_SAMPLE_RATE) / 1000;
+}
+
+static void _addLatency(SimLatency *latency, uint64_t samples){
+	uint32_t ms = (samples * 1000) / SIM_SAMPLE_RATE;
+
+	latency->count++;
+	latency->total += ms;
+	latency->max    = max(latency->max, ms);
+	latency->histogram[min(ms, SIM_HISTOGRAM_MS - 1)]++;
+}
+
+/* Simulated disc */
+
+// Songs are placed far apart, so that switching between them always costs a
+// full seek.
+#define _SONG_BASE_LBA 1000
+#define _SONG_SPACING  50000
+
+// Every ADPCM block of a song carries a tag in place of sample data, giving the
+// song, chunk, channel and block it belongs to.
+#define _TAG_MAGIC 0xa5
+
+typedef struct SimSong{
+	char     name[32];
+	uint32_t lba, numSectors, numChunks;
+	int      channels, interleave, sampleRate;
+} SimSong;
+
+static SimSong _songs[SIM_MAX_SONGS];
+static int     _numSongs;
+
+void sim_addSong(const char *name, int channels, int interleave, int sampleRate, int seconds){
+	if(_numSongs == SIM_MAX_SONGS){
+		return;
+	}
+
+	SimSong *song  = &_songs[_numSongs];
+	int     samples = (interleave / 16) * 28;
+
+	snprintf(song->name, sizeof(song->name), "%s", name);
+	song->lba        = _SONG_BASE_LBA + _numSongs * _SONG_SPACING;
+	song->numChunks  = ((uint64_t) seconds * sampleRate + samples - 1) / samples;
+	song->channels   = channels;
+	song->interleave = interleave;
+	song->sampleRate = sampleRate;
+	song->numSectors =
+		(song->numChunks * interleave * channels + 2047) / 2048;
+
+	_numSongs++;
+}
+
+static void _fillHeader(const SimSong *song, uint8_t *output){
+	VAGHeader *header = (VAGHeader *) output;
+
+	header->magic      = concat4_8('V', 'A', 'G', 'i');
+	header->interleave = song->interleave;
+	header->length     = bswap32(song->numChunks * song->interleave);
+	header->sampleRate = bswap32(song->sampleRate);
+	header->channels   = song->channels;
+	memcpy(header->name, song->name, sizeof(header->name));
+}
+
+static void _fillBody(int index, uint32_t sector, uint8_t *output){
+	const SimSong *song = &_songs[index];
+
+	uint32_t chunkLength = song->interleave * song->channels;
+	uint32_t offset      = sector * 2048;
+	int      lastBlock   = song->interleave / 16 - 1;
+
+	for(int i = 0; i < 2048; i += 16, offset += 16){
+		uint32_t chunk = offset / chunkLength;
+		uint32_t part  = offset % chunkLength;
+		uint8_t  *block = &output[i];
+
+		if(chunk >= song->numChunks){
+			break;
+		}
+
+		int channel    = part / song->interleave;
+		int blockIndex = (part % song->interleave) / 16;
+
+		block[1]  = (blockIndex == lastBlock) ? (LOOP_END | LOOP_SUSTAIN) : 0;
+		block[2]  = _TAG_MAGIC;
+		block[3]  = index;
+		block[4]  = chunk;
+		block[5]  = chunk >> 8;
+		block[6]  = chunk >> 16;
+		block[7]  = chunk >> 24;
+		block[8]  = channel;
+		block[9]  = blockIndex;
+		block[10] = blockIndex >> 8;
+	}
+}
+
+static void _readSector(uint32_t lba, uint8_t *output){
+	memset(output, 0, 2048);
+
+	for(int i = 0; i < _numSongs; i++){
+		const SimSong *song = &_songs[i];
+
+		if(lba == song->lba){
+			_fillHeader(song, output);
+			return;
+		}
+		if((lba > song->lba) && (lba <= (song->lba + song->numSectors))){
+			_fillBody(i, lba - song->lba - 1, output);
+			return;
+		}
+	}
+}
+
+uint32_t getLbaToFile(const char *filename){
+	for(int i = 0; i < _numSongs; i++){
+		if(!strcmp(filename, _songs[i].name)){
+			return _songs[i].lba;
+		}
+	}
+
+	return 0;
+}
+
+/* Simulated SPU */
+
+#define _SPU_RAM_SIZE 0x80000
+#define _NUM_CHANNELS 24
+
+typedef struct SimVoice{
+	bool     active;
+	uint32_t addr, position; // Position is in 4.12 samples within the block
+
+	// Last tagged chunk started by the voice, used to check continuity.
+	int      song, channel;
+	int64_t  lastChunk;
+} SimVoice;
+
+static uint8_t     _spuRAM[_SPU_RAM_SIZE];
+static SimVoice    _voices[_NUM_CHANNELS];
+static ChannelMask _reservedChannels;
+static uint32_t    _endx;
+static bool        _spuIRQPending;
+
+// The SPU IRQ flag is set when a voice or a DMA transfer touches the IRQ address
+// and stays set until the IRQ is disabled. The simulator only sees the driver's
+// register writes once it returns, so when the IRQ fires the enable bit is
+// cleared on the driver's behalf; if the driver has set it again by the time
+// sim_sync() is called, it has been acknowledged and re-armed.
+static void _checkIRQ(uint32_t addr, uint32_t length, bool fromDMA){
+	if(!(SPU_CTRL & SPU_CTRL_IRQ_ENABLE) || (SPU_STAT & SPU_STAT_IRQ)){
+		return;
+	}
+
+	uint32_t irqAddr = SPU_IRQ_ADDR * 8;
+
+	if((irqAddr < addr) || (irqAddr >= (addr + length))){
+		return;
+	}
+
+	SPU_STAT      |= SPU_STAT_IRQ;
+	SPU_CTRL      &= ~SPU_CTRL_IRQ_ENABLE;
+	_spuIRQPending = true;
+
+	if(fromDMA){
+		simStats.dmaIRQs++;
+	} else {
+		simStats.spuIRQs++;
+	}
+}
+
+static void _enterBlock(Channel ch){
+	SimVoice      *voice = &_voices[ch];
+	const uint8_t *block = &_spuRAM[voice->addr];
+
+	_checkIRQ(voice->addr, 16, false);
+
+	if(block[2] != _TAG_MAGIC){
+		return;
+	}
+
+	int      song       = block[3];
+	int64_t  chunk      = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t) block[7] << 24);
+	int      channel    = block[8];
+	int      blockIndex = block[9] | (block[10] << 8);
+
+	if(blockIndex){
+		return;
+	}
+
+	// Anything other than the next chunk of the same song and channel means
+	// stale or misplaced data was played.
+	SimSongStats *stats = &simStats.songs[song];
+	bool         glitch = false;
+
+	if(voice->lastChunk >= 0){
+		glitch =
+			(song != voice->song) || (channel != voice->channel) ||
+			(chunk != ((voice->lastChunk + 1) % _songs[song].numChunks));
+	}
+
+	voice->song      = song;
+	voice->channel   = channel;
+	voice->lastChunk = chunk;
+
+	if(channel){
+		return;
+	}
+
+	stats->chunks++;
+	if(glitch){
+		stats->glitches++;
+	}
+}
+
+static void _nextBlock(Channel ch){
+	SimVoice *voice = &_voices[ch];
+	uint8_t  flags  = _spuRAM[voice->addr + 1];
+
+	if(flags & LOOP_START){
+		SPU_CH_LOOP_ADDR(ch) = voice->addr / 8;
+	}
+	if(!(flags & LOOP_END)){
+		voice->addr = (voice->addr + 16) % _SPU_RAM_SIZE;
+		_enterBlock(ch);
+		return;
+	}
+
+	_endx      |= 1 << ch;
+	voice->addr = SPU_CH_LOOP_ADDR(ch) * 8;
+
+	// Without the sustain flag the voice is released and falls silent.
+	if(!(flags & LOOP_SUSTAIN)){
+		voice->active       = false;
+		SPU_CH_ADSR_VOL(ch) = 0;
+		return;
+	}
+
+	_enterBlock(ch);
+}
+
+static void _keyOn(Channel ch){
+	SimVoice *voice = &_voices[ch];
+
+	voice->active       = true;
+	voice->addr         = (SPU_CH_ADDR(ch) * 8) % _SPU_RAM_SIZE;
+	voice->position     = 0;
+	_endx              &= ~(1 << ch);
+	SPU_CH_ADSR_VOL(ch) = 0x7fff;
+
+	_enterBlock(ch);
+}
+
+static void _runVoices(void){
+	ChannelMask mask = _reservedChannels;
+
+	for(Channel ch = 0; mask; ch++, mask >>= 1){
+		if(!(mask & 1)){
+			continue;
+		}
+
+		SimVoice *voice = &_voices[ch];
+
+		if(voice->active){
+			voice->position += SPU_CH_FREQ(ch);
+
+			while(voice->active && (voice->position >= (28 << 12))){
+				voice->position -= 28 << 12;
+				_nextBlock(ch);
+			}
+		}
+
+		// Count time spent silent by the first channel of each stream.
+		if(
+			(voice->song >= 0) && !voice->channel &&
+			(!voice->active || (voice->addr == DUMMY_BLOCK_OFFSET))
+		){
+			simStats.songs[voice->song].silentSamples++;
+		}
+	}
+
+	SPU_FLAG_STATUS1 = _endx & 0xffff;
+	SPU_FLAG_STATUS2 = _endx >> 16;
+}
+
+void sim_sync(void){
+	ChannelMask on  = SPU_FLAG_ON1  | (SPU_FLAG_ON2  << 16);
+	ChannelMask off = SPU_FLAG_OFF1 | (SPU_FLAG_OFF2 << 16);
+
+	SPU_FLAG_ON1  = 0;
+	SPU_FLAG_ON2  = 0;
+	SPU_FLAG_OFF1 = 0;
+	SPU_FLAG_OFF2 = 0;
+
+	stopChannels(off);
+	for(Channel ch = 0; on; ch++, on >>= 1){
+		if(on & 1){
+			_keyOn(ch);
+		}
+	}
+
+	if(SPU_CTRL & SPU_CTRL_IRQ_ENABLE){
+		SPU_STAT &= ~SPU_STAT_IRQ;
+	}
+}
+
+ChannelMask reserveChannels(int count){
+	ChannelMask mask = 0;
+
+	for(Channel ch = 0; (ch < NUM_CHANNELS) && (count > 0); ch++){
+		if(_reservedChannels & (1 << ch)){
+			continue;
+		}
+
+		mask |= 1 << ch;
+		count--;
+	}
+	if(count){
+		return 0;
+	}
+
+	_reservedChannels |= mask;
+	return mask;
+}
+
+void releaseChannels(ChannelMask mask){
+	_reservedChannels &= ~mask;
+
+	for(Channel ch = 0; mask; ch++, mask >>= 1){
+		if(mask & 1){
+			_voices[ch].song      = -1;
+			_voices[ch].channel   = -1;
+			_voices[ch].lastChunk = -1;
+		}
+	}
+}
+
+void stopChannels(ChannelMask mask){
+	for(Channel ch = 0; mask; ch++, mask >>= 1){
+		if(mask & 1){
+			_voices[ch].active  = false;
+			SPU_CH_ADSR_VOL(ch) = 0;
+		}
+	}
+}
+
+// Transfers complete instantly, which is close enough as SPU DMA is far faster
+// than the drive.
+size_t upload(uint32_t offset, const void *data, size_t length, bool wait){
+	length = roundup(length, 16);
+
+	if((offset + length) > _SPU_RAM_SIZE){
+		length = _SPU_RAM_SIZE - offset;
+	}
+
+	memcpy(&_spuRAM[offset], data, length);
+	_checkIRQ(offset, length, true);
+	return length;
+}
+
+size_t queueUpload(uint32_t offset, const void *data, size_t length, volatile bool *done){
+	length = upload(offset, data, length, false);
+
+	if(done){
+		*done = true;
+	}
+	return length;
+}
+
+void waitForSPUTransfer(volatile bool *done){}
+
+size_t download(uint32_t offset, void *data, size_t length, bool wait){
+	length = roundup(length, 16);
+
+	memcpy(data, &_spuRAM[offset], length);
+	_checkIRQ(offset, length, true);
+	return length;
+}
+
+// SPU RAM is handed out once and never reused, which is all a single run needs.
+// The range is the same as the one spu.c's allocator hands out.
+#define _ALLOC_START DUMMY_BLOCK_END
+#define _ALLOC_END   SPU_RAM_END
+
+static uint32_t _allocOffsets[SPU_MAX_ALLOCATIONS];
+static uint32_t _allocEnd;
+static int      _numAllocations;
+
+SPUBlock allocSPURAM(size_t length, bool pinned){
+	length = roundup(length, SPU_RAM_ALIGN);
+
+	if((_numAllocations == SPU_MAX_ALLOCATIONS) || ((_allocEnd + length) > _ALLOC_END)){
+		return SPU_NO_BLOCK;
+	}
+
+	_allocOffsets[_numAllocations] = _allocEnd;
+	_allocEnd                     += length;
+	return _numAllocations++;
+}
+
+void freeSPURAM(SPUBlock block){}
+
+uint32_t getSPURAMOffset(SPUBlock block){
+	return _allocOffsets[block];
+}
+
+uint32_t sim_getAllocatableSPURAM(void){
+	return _ALLOC_END - _ALLOC_START;
+}
+
+/* Simulated CD-ROM drive */
+
+#define _SECTOR_SAMPLES (SIM_SAMPLE_RATE / SIM_SECTOR_RATE)
+
+typedef enum{
+	_READ_NONE   = 0,
+	_READ_DATA   = 1, // startCDROMRead()
+	_READ_STREAM = 2, // startCDROMStreamRead()
+	_READ_OTHER  = 3  // Simulated read by the rest of the menu
+} SimReadType;
+
+typedef struct SimDrive{
+	SimReadType type;
+	uint32_t    lba, numSectors, sector, nextLba;
+	uint64_t    startTime, nextSectorTime, nextOtherTime;
+
+	uint8_t             *data;
+	size_t              sectorSize, numSlots;
+	CDROMSectorCallback callback;
+} SimDrive;
+
+static SimDrive _drive;
+
+static void _scheduleOtherRead(void){
+	if(!_config.otherReadsPerMinute){
+		_drive.nextOtherTime = UINT64_MAX;
+		return;
+	}
+
+	// Spread reads randomly between 0.5x and 1.5x the average interval.
+	uint32_t interval = 60000 / _config.otherReadsPerMinute;
+
+	_drive.nextOtherTime = _now +
+		_msToSamples(interval / 2 + _getRandom() % (interval + 1));
+}
+
+static void _startRead(SimReadType type, uint32_t lba, uint32_t numSectors){
+	uint32_t latency;
+
+	if(lba == _drive.nextLba){
+		latency = _config.seqLatency;
+	} else {
+		latency = _config.seekMin +
+			_getRandom() % (_config.seekMax - _config.seekMin + 1);
+	}
+	if((int)(_getRandom() % 100) < _config.retryChance){
+		latency += _config.retryPenalty;
+		simStats.retries++;
+	}
+
+	_drive.type           = type;
+	_drive.lba            = lba;
+	_drive.numSectors     = numSectors;
+	_drive.sector         = 0;
+	_drive.startTime      = _now;
+	_drive.nextSectorTime = _now + _msToSamples(latency);
+}
+
+void startCDROMRead(uint32_t lba, void *ptr, size_t numSectors, size_t sectorSize, bool doubleSpeed, bool wait){
+	_drive.data       = ptr;
+	_drive.sectorSize = sectorSize;
+	_startRead(_READ_DATA, lba, numSectors);
+
+	if(wait){
+		waitForCDROMRead();
+	}
+}
+
+void startCDROMStreamRead(uint32_t lba, void *slots, size_t numSlots, size_t numSectors, bool doubleSpeed, CDROMSectorCallback callback){
+	_drive.data       = slots;
+	_drive.sectorSize = 2048;
+	_drive.numSlots   = numSlots;
+	_drive.callback   = callback;
+	_startRead(_READ_STREAM, lba, numSectors);
+
+	simStats.streamReads++;
+}
+
+bool isCDROMReadDone(void){
+	return (_drive.type == _READ_NONE);
+}
+
+// Errors are modelled as extra latency (see _startRead()), so reads never fail.
+bool isCDROMReadFailed(void){
+	return false;
+}
+
+void waitForCDROMRead(void){
+	while(!isCDROMReadDone()){
+		sim_run(1);
+	}
+}
+
+static void _runDrive(void){
+	if(_drive.type == _READ_NONE){
+		if(_now < _drive.nextOtherTime){
+			return;
+		}
+
+		// Other reads land anywhere on the disc, so the next stream read has
+		// to seek back.
+		_startRead(
+			_READ_OTHER, _getRandom() % 300000,
+			(_config.otherReadLength * SIM_SECTOR_RATE + 999) / 1000
+		);
+		_scheduleOtherRead();
+		simStats.otherReads++;
+	}
+
+	simStats.driveBusySamples++;
+
+	if(_now < _drive.nextSectorTime){
+		return;
+	}
+
+	uint32_t lba = _drive.lba + _drive.sector;
+
+	if(_drive.type == _READ_DATA){
+		uint8_t sector[2048];
+
+		_readSector(lba, sector);
+		memcpy(
+			&_drive.data[_drive.sector * _drive.sectorSize], sector,
+			min(_drive.sectorSize, 2048)
+		);
+	} else if(_drive.type == _READ_STREAM){
+		uint8_t *slot =
+			&_drive.data[(_drive.sector % _drive.numSlots) * 2048];
+
+		if(!_drive.sector){
+			_addLatency(&simStats.firstSector, _now - _drive.startTime);
+		}
+
+		_readSector(lba, slot);
+
+		simCOP0Status &= ~COP0_STATUS_IEc;
+		_drive.callback(slot);
+		simCOP0Status |= COP0_STATUS_IEc;
+		sim_sync();
+	}
+
+	_drive.nextSectorTime += _SECTOR_SAMPLES;
+
+	if(++_drive.sector < _drive.numSectors){
+		return;
+	}
+
+	if(_drive.type == _READ_STREAM){
+		_addLatency(&simStats.lastSector, _now - _drive.startTime);
+	}
+
+	_drive.type    = _READ_NONE;
+	_drive.nextLba = _drive.lba + _drive.numSectors;
+}
+
+/* Timer */
+
+// Writing to a timer's control register resets its counter. Writes can't be
+// trapped, so the simulator sets a read-only status bit the driver never writes
+// after each check; if it is found cleared, the register has been written to
+// since (even if with the same value).
+#define _TIMER_WRITTEN_MARKER TIMER_CTRL_OVERFLOWED
+
+static uint64_t _timerStart;
+static uint32_t _hblankRate;
+
+static void _runTimer(void){
+	if(!(TIMER_CTRL(1) & _TIMER_WRITTEN_MARKER)){
+		_timerStart    = _now;
+		TIMER_CTRL(1) |= _TIMER_WRITTEN_MARKER;
+	}
+
+	// Only counting horizontal blanking periods is modelled, as that is the
+	// only mode the driver uses.
+	TIMER_VALUE(1) = ((_now - _timerStart) * _hblankRate) / SIM_SAMPLE_RATE;
+}
+
+/* Main simulation loop */
+
+bool sim_init(const SimConfig *config){
+	void *io   = mmap(
+		(void *) IO_BASE, 0x1000, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0
+	);
+	void *bios = mmap(
+		(void *) DEV2_BASE, 0x1000, PROT_READ,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0
+	);
+
+	if((io != (void *) IO_BASE) || (bios != (void *) DEV2_BASE)){
+		return false;
+	}
+
+	_config     = *config;
+	_random     = config->seed ? config->seed : 1;
+	_now        = 0;
+	_timerStart = 0;
+	_hblankRate = config->pal ? SIM_HBLANK_RATE_PAL : SIM_HBLANK_RATE_NTSC;
+
+	TIMER_CTRL(1) = _TIMER_WRITTEN_MARKER;
+
+	memset(&simStats, 0, sizeof(simStats));
+	memset(&_drive, 0, sizeof(_drive));
+	_drive.nextLba = UINT32_MAX;
+	_scheduleOtherRead();
+
+	for(Channel ch = 0; ch < NUM_CHANNELS; ch++){
+		_voices[ch].song      = -1;
+		_voices[ch].channel   = -1;
+		_voices[ch].lastChunk = -1;
+	}
+
+	// Same silent looping block as set up by initSPU().
+	_spuRAM[DUMMY_BLOCK_OFFSET + 1] = LOOP_START | LOOP_END;
+	_allocEnd       = _ALLOC_START;
+	_numAllocations = 0;
+
+	SPU_CTRL = SPU_CTRL_ENABLE | SPU_CTRL_UNMUTE;
+	return true;
+}
+
+void sim_run(uint32_t samples){
+	for(; samples; samples--){
+		_now++;
+		_runTimer();
+
+		_runVoices();
+		_runDrive();
+
+		if(_spuIRQPending && (simCOP0Status & COP0_STATUS_IEc)){
+			_spuIRQPending = false;
+
+			simCOP0Status &= ~COP0_STATUS_IEc;
+			stream_handleSPUInterrupt();
+			simCOP0Status |= COP0_STATUS_IEc;
+			sim_sync();
+		}
+	}
+}
+
+uint64_t sim_getTime(void){
+	return _now;
+}
+
+uint32_t sim_getPercentile(const SimLatency *latency, int percent){
+	uint64_t target = ((uint64_t) latency->count * percent + 99) / 100;
+	uint64_t total  = 0;
+
+	for(uint32_t ms = 0; ms < SIM_HISTOGRAM_MS; ms++){
+		total += latency->histogram[ms];
+
+		if(total >= target){
+			return ms;
+		}
+	}
+
+	return SIM_HISTOGRAM_MS;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Simulated SPU and CD-ROM drive, used to run the stream driver on a host. The
+// PS1's I/O registers are mapped to their usual addresses, so that the driver's
+// register accesses work unchanged; the simulator then acts on the values
+// written to them between calls into the driver. Time is counted in samples at
+// 44100 Hz.
+#define SIM_SAMPLE_RATE       44100
+#define SIM_HBLANK_RATE_NTSC  15734
+#define SIM_HBLANK_RATE_PAL   15625
+#define SIM_SECTOR_RATE       150 // Sectors per second at double speed
+#define SIM_MAX_SONGS         4
+#define SIM_HISTOGRAM_MS      4000
+
+typedef struct SimConfig {
+	// Time taken to start a read, in milliseconds. Reads continuing from where
+	// the last one stopped only take seqLatency; any other read seeks for a
+	// random time between seekMin and seekMax.
+	int seqLatency, seekMin, seekMax;
+
+	// Chance of a read having to be retried, in percent, and the time lost.
+	int retryChance, retryPenalty;
+
+	// Reads made by the rest of the menu (covers, listings), which take the
+	// drive away from the streams for readLength milliseconds plus a seek.
+	int otherReadsPerMinute, otherReadLength;
+
+	// Video standard, which sets the horizontal blanking rate timer 1 counts
+	// at.
+	bool pal;
+
+	uint32_t seed;
+} SimConfig;
+
+typedef struct SimLatency {
+	uint32_t count;
+	uint64_t total;
+	uint32_t max;
+	uint32_t histogram[SIM_HISTOGRAM_MS]; // In milliseconds
+} SimLatency;
+
+typedef struct SimSongStats {
+	uint32_t chunks, glitches;
+	uint64_t silentSamples;
+} SimSongStats;
+
+typedef struct SimStats {
+	uint32_t streamReads, otherReads, retries;
+	uint64_t driveBusySamples;
+
+	// From the start of a read to its first and last sectors.
+	SimLatency firstSector, lastSector;
+
+	uint32_t spuIRQs, dmaIRQs;
+	SimSongStats songs[SIM_MAX_SONGS];
+} SimStats;
+
+extern SimStats simStats;
+
+/// @brief Map the I/O registers and reset the simulated hardware.
+/// @return False if the registers could not be mapped.
+bool sim_init(const SimConfig *config);
+
+/// @brief Add an interleaved VAG file to the simulated disc, filled with
+/// tagged ADPCM blocks that let the simulator check chunks are played in order.
+void sim_addSong(const char *name, int channels, int interleave, int sampleRate, int seconds);
+
+/// @brief Return how many bytes of SPU RAM can be allocated in total, i.e.
+/// everything between the dummy block and the end of SPU RAM.
+uint32_t sim_getAllocatableSPURAM(void);
+
+/// @brief Advance time, playing the voices and delivering SPU IRQs and CD-ROM
+/// sectors as they occur.
+void sim_run(uint32_t samples);
+
+/// @brief Act on the registers written since the last call. Must be called
+/// after calling into the driver.
+void sim_sync(void);
+
+uint64_t sim_getTime(void);
+uint32_t sim_getPercentile(const SimLatency *latency, int percent);